@@ -4,11 +4,16 @@
 
 #include "Callback/Context.h"
 
+#include <condition_variable>
 #include <deque>
 #include <filesystem>
+#include <functional>
 #include <memory>
+#include <mutex>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include <UsageEnvironment.hh>
 #include <boost/circular_buffer.hpp>
@@ -16,14 +21,14 @@
 #include <gsl/gsl>
 
 #include "Callback/AsyncDebouncer.h"
+#include "Callback/CurlMultiReactor.h"
+#include "Callback/RetentionManager.h"
+#include "Callback/UringFileWriter.h"
 #include "Detector/Detector.h"
-#include "Util/CurlMultiWrapper.h"
 #include "Util/CurlWrapper.h"
-
-#if __linux__
-#include <aio.h>
-#include <signal.h>
-#endif
+#include "Util/MediaCatalog.h"
+#include "VideoSource/Mp4Muxer.h"
+#include "VideoSource/PreRollBuffer.h"
 
 namespace callback {
 
@@ -44,16 +49,27 @@ public:
 
   void Register();
   void SaveFileAtEndpoint(const std::filesystem::path &dst = {});
+  // Save the frame that triggered detection as a JPEG, encoding runs on a
+  // worker thread so the event loop only pays for a copy of the frame
+  void SaveFrame(const detector::Payload &data,
+                 const std::filesystem::path &dst = {});
+
+  // Record the compressed stream around each motion event as a fragmented
+  // MP4 clip, starting with what the pre-roll buffer holds. Fragments are
+  // appended as they are cut, so the clip can be watched while it records.
+  void SetPreRollBuffer(std::shared_ptr<video_source::PreRollBuffer> pPreRoll);
 
   void operator()(detector::Payload data);
 
   [[nodiscard]] size_t GetPendingRequestOperations() const {
-    return socketCtxs_.size();
+    return pendingRequests_;
   }
   [[nodiscard]] size_t GetPendingFileOperations() const {
-    return easyCtxs_.size();
+    return easyCtxs_.size() + pendingFrames_;
   }
 
+  [[nodiscard]] bool IsRecordingClip() const { return bool(pClip_); }
+
   [[nodiscard]] const boost::circular_buffer<std::filesystem::path> &
   GetSavedFilePaths() const;
   [[nodiscard]] const std::filesystem::path &GetDstPath() const noexcept {
@@ -62,11 +78,37 @@ public:
 
   void SetLimitSavedFilePaths(size_t limit);
 
+  // Record saved media in the catalog and take over the files it already
+  // lists, so the saved file limit holds across restarts. The catalog must be
+  // for the destination directory.
+  void SetCatalog(std::shared_ptr<util::MediaCatalog> pCatalog);
+  [[nodiscard]] std::shared_ptr<util::MediaCatalog> GetCatalog() const {
+    return pCatalog_;
+  }
+
+  // Leave deleting old files to the retention manager instead of removing
+  // them here once the limit is reached. Set before the catalog.
+  void SetRetentionManager(std::shared_ptr<RetentionManager> pRetention);
+
   size_t defaultJpgBufferSize{2 * 1024 * 1024}; // default to 2Mb
   static constexpr size_t defaultSavedFilePathsSize{200};
 
   std::chrono::seconds debounceTime{30};
 
+  // Save the analysed frame on motion instead of fetching a snapshot
+  bool saveDetectionFrame{false};
+  bool drawRois{false};
+  int jpegQuality{90};
+
+  // Width of the thumbnail written to thumbs/ next to each saved file, 0 to
+  // skip them. They are made on the worker thread.
+  int thumbnailWidth{0};
+  int thumbnailQuality{70};
+
+  // Keep recording a clip this long after motion stops
+  std::chrono::seconds clipPostRoll{5};
+  size_t maxClipBytes{64 * 1024 * 1024};
+
 private:
   boost::url url_;
   std::string user_;
@@ -74,10 +116,13 @@ private:
   std::filesystem::path dstPath_;
 
   boost::circular_buffer<std::filesystem::path> savedFilePaths_;
+  std::shared_ptr<util::MediaCatalog> pCatalog_;
+  std::shared_ptr<RetentionManager> pRetention_;
 
   gsl::not_null<std::shared_ptr<TaskScheduler>> pSched_;
-  util::CurlMultiWrapper wCurlMulti_;
-  TaskToken token_{};
+  gsl::not_null<std::shared_ptr<CurlMultiReactor>> pReactor_;
+  size_t pendingRequests_{0};
+  bool hadMotion_{false};
 
 #if _WIN32
   struct Win32Overlapped {
@@ -92,39 +137,106 @@ private:
   using _CurlEasyContext =
       CurlEasyContext<Win32Overlapped, void *, AsyncFileSave>;
 #elif __linux__
-  struct LinuxAioFile {
-    aiocb _aiocb{};
+  struct LinuxUringFile {
     std::vector<char> buf;
     std::filesystem::path dstPath;
-
-    ~LinuxAioFile() noexcept;
   };
-  using _CurlEasyContext = CurlEasyContext<LinuxAioFile, void *, AsyncFileSave>;
+  using _CurlEasyContext =
+      CurlEasyContext<LinuxUringFile, void *, AsyncFileSave>;
+
+  gsl::not_null<std::shared_ptr<UringFileWriter>> pWriter_;
 #endif
-  using _CurlSocketContext = CurlSocketContext<AsyncFileSave>;
 
   std::unordered_map<size_t, std::shared_ptr<_CurlEasyContext>> easyCtxs_;
   std::vector<char> spareBuf_;
-  std::unordered_map<curl_socket_t, std::shared_ptr<_CurlSocketContext>>
-      socketCtxs_;
-
-  void CheckMultiInfo();
-
-  static int SocketCallback(CURL *easy, curl_socket_t s, int action,
-                            AsyncFileSave *AsyncFileSave,
-                            _CurlSocketContext *curlSocketContext);
-  static int TimeoutCallback(CURLM *multi, int timeoutMs,
-                             AsyncFileSave *AsyncFileSave);
-
-  static void BackgroundHandlerProc(void *curlSocketContext_clientData,
-                                    int mask);
-  static void TimeoutHandlerProc(void *asyncFileSave_clientData);
-  static void DebounceUpdateProc(void *asyncFileSave_clientData);
-
-#ifdef __linux__
-  static void AioSigHandler(int sig, siginfo_t *si, void *ucontext);
-  static void InstallHandlers();
-#endif //  __linux__
+
+  void OnTransferDone(std::shared_ptr<_CurlEasyContext> pCtx,
+                      CURLcode result);
+
+  // a frame to encode, or with img empty, data that is already encoded
+  struct FrameJob {
+    cv::Mat img;
+    std::vector<cv::Rect> rois;
+    std::filesystem::path dstPath;
+    std::vector<uchar> encoded;
+    // encoded from img alongside the full size image
+    std::vector<uchar> thumbnail;
+    // encode only a thumbnail, from img or else the JPEG at thumbnailSrc
+    bool thumbnailOnly{false};
+    std::filesystem::path thumbnailSrc;
+    std::chrono::system_clock::time_point timeStamp;
+    std::chrono::system_clock::time_point captureTime;
+    bool append{false};
+    // called once written instead of recording the file as saved
+    std::function<void(bool ok)> onWritten;
+    bool ok{false};
+  };
+
+  struct Clip {
+    video_source::Mp4Muxer muxer;
+    std::filesystem::path dstPath;
+    std::chrono::system_clock::time_point startTime;
+    // of the frame that started the clip
+    std::chrono::system_clock::time_point captureTime;
+    uint32_t roiCount{0};
+    cv::Rect roiBounds;
+    std::deque<std::shared_ptr<FrameJob>> fragments;
+    size_t bytes{0};
+    bool created{false};
+    bool writing{false};
+    bool finished{false};
+    bool failed{false};
+  };
+
+  // finished jobs keep their image and JPEG storage for the next save
+  static constexpr size_t maxSpareFrameJobs{2};
+  std::vector<std::shared_ptr<FrameJob>> spareFrameJobs_;
+  size_t pendingFrames_{0};
+
+  std::mutex frameMtx_;
+  std::condition_variable_any frameCv_;
+  std::deque<std::shared_ptr<FrameJob>> framesToEncode_;
+  std::deque<std::shared_ptr<FrameJob>> framesEncoded_;
+  EventTriggerId framesEncodedTrigger_{0};
+  std::jthread encoderThread_;
+
+  std::shared_ptr<video_source::PreRollBuffer> pPreRoll_;
+  std::shared_ptr<Clip> pClip_;
+  std::vector<uint8_t> clipOutput_;
+  uint64_t clipSeq_{0};
+  std::chrono::steady_clock::time_point clipLastMotion_;
+  bool thumbnailDirCreated_{false};
+
+  [[nodiscard]] std::filesystem::path
+  ResolveDstPath(const std::filesystem::path &dst,
+                 std::string_view extension = ".jpg") const;
+  void QueueThumbnail(const cv::Mat &img,
+                      const std::filesystem::path &mediaPath);
+  void WriteThumbnail(const std::filesystem::path &mediaPath,
+                      std::vector<uchar> &thumbnail);
+  [[nodiscard]] bool EncodeThumbnail(const cv::Mat &img,
+                                     std::vector<uchar> &thumbnail) const;
+  void RecordSavedFile(const std::filesystem::path &path,
+                       std::chrono::system_clock::time_point timeStamp,
+                       uint32_t roiCount = 0, const cv::Rect &roiBounds = {},
+                       std::chrono::system_clock::time_point captureTime = {});
+  void TrackSavedFile(const std::filesystem::path &path);
+  void RemoveOldestSavedFile();
+
+  void UpdateClip(const detector::Payload &data);
+  void QueueClipFragments(const detector::Payload &data);
+  // Finish the clip where the muxer starts a new file and record the rest in
+  // a new one
+  void SplitClip(const detector::Payload &data);
+  void FinishClip(const detector::Payload &data);
+  void WriteNextFragment(std::shared_ptr<Clip> pClip);
+
+  void QueueFrameJob(std::shared_ptr<FrameJob> pJob);
+  void WriteEncoded(std::shared_ptr<FrameJob> pJob);
+  void EncodeFrames(std::stop_token stopToken);
+  void OnFrameEncoded(std::shared_ptr<FrameJob> pJob);
+  void FinishFrame(std::shared_ptr<FrameJob> pJob, bool ok);
+  static void FramesEncodedProc(void *asyncFileSave_clientData);
 
 #if _WIN32
   static VOID
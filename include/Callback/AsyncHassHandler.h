@@ -3,16 +3,18 @@
 #include "Callback/AsyncDebouncer.h"
 #include "Callback/BaseHassHandler.h"
 #include "Callback/Context.h"
+#include "Callback/CurlMultiReactor.h"
+#include "Callback/HassStateBatcher.h"
 
+#include <chrono>
 #include <gsl/gsl>
 #include <memory>
 #include <string_view>
-#include <unordered_map>
+#include <vector>
 
 #include <UsageEnvironment.hh>
 #include <boost/url.hpp>
 
-#include "Util/CurlMultiWrapper.h"
 #include "Util/CurlWrapper.h"
 
 namespace callback {
@@ -29,37 +31,35 @@ public:
   AsyncHassHandler &operator=(const AsyncHassHandler &) = delete;
   AsyncHassHandler &operator=(AsyncHassHandler &&) = delete;
 
-  virtual ~AsyncHassHandler() noexcept;
+  virtual ~AsyncHassHandler() noexcept = default;
 
   void Register();
 
+  // State changes are held at most this long so updates from other feeds on
+  // the same scheduler go out together, zero posts immediately
+  std::chrono::milliseconds batchWindow{0};
+
 protected:
-  void UpdateState_Impl(std::string_view state,
-                        const json &attributes) override;
+  void UpdateState_Impl(const HassState &state) override;
 
 private:
   gsl::not_null<std::shared_ptr<TaskScheduler>> pSched_;
-  util::CurlMultiWrapper wCurlMulti_;
-  TaskToken timeoutTaskToken_{};
+  gsl::not_null<std::shared_ptr<CurlMultiReactor>> pReactor_;
+  gsl::not_null<std::shared_ptr<HassStateBatcher>> pBatcher_;
 
   using _CurlEasyContext = CurlEasyContext<std::vector<char>, std::string>;
-  using _CurlSocketContext = CurlSocketContext<AsyncHassHandler>;
-  std::unordered_map<size_t, std::shared_ptr<_CurlEasyContext>> easyCtxs_;
-  std::unordered_map<curl_socket_t, std::shared_ptr<_CurlSocketContext>>
-      socketCtxs_;
-
-  void GetInitialState();
-  void CheckMultiInfo();
 
-  static int SocketCallback(CURL *easy, curl_socket_t s, int action,
-                            AsyncHassHandler *asyncHassHandler,
-                            _CurlSocketContext *curlSocketContext);
-  static int TimeoutCallback(CURLM *multi, int timeoutMs,
-                             AsyncHassHandler *asyncHassHandler);
+  // finished easy handles are kept for the next request, this keeps their
+  // connection and buffers warm
+  static constexpr size_t maxIdleContexts{4};
+  std::vector<std::shared_ptr<_CurlEasyContext>> idleCtxs_;
 
-  static void BackgroundHandlerProc(void *curlSocketContext_clientData,
-                                    int mask);
-  static void TimeoutHandlerProc(void *asyncHassHandler_clientData);
+  std::shared_ptr<_CurlEasyContext> AcquireContext();
+  void Submit(std::shared_ptr<_CurlEasyContext> pCtx);
+  void OnTransferDone(std::shared_ptr<_CurlEasyContext> pCtx,
+                      CURLcode result);
+  void GetInitialState();
+  void PostNextState();
 };
 
 } // namespace callback
@@ -3,6 +3,9 @@
 #include "Detector/Detector.h"
 #include "Util/CurlWrapper.h"
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <span>
 #include <string>
 #include <vector>
@@ -16,6 +19,23 @@ namespace callback {
 
 using json = nlohmann::json;
 
+// Compact form of an entity state. It is rebuilt and compared on every
+// detection, and only turned into JSON when an update is actually sent.
+struct HassState {
+  enum class Value : uint8_t { Unknown, Off, On, Count };
+
+  Value value{Value::Unknown};
+  size_t count{0};            // state of a Count sensor
+  std::vector<cv::Rect> rois; // reported by binary sensors only
+  // capture time of the frame behind the state, left out of comparisons as
+  // it changes with every frame
+  std::chrono::system_clock::time_point frameTime{};
+
+  bool operator==(const HassState &other) const {
+    return value == other.value && count == other.count && rois == other.rois;
+  }
+};
+
 class BaseHassHandler {
 
 public:
@@ -28,17 +48,26 @@ public:
 
   virtual ~BaseHassHandler() noexcept = default;
 
-  void operator()(std::optional<detector::RegionsOfInterest> rois = {});
+  // frameTime is when the camera captured the analysed frame, reported as the
+  // frame_time attribute when known
+  void operator()(std::optional<detector::RegionsOfInterest> rois = {},
+                  std::chrono::system_clock::time_point frameTime = {});
 
   std::chrono::duration<double> debounceTime{30.0};
   std::string friendlyName;
   std::string entityId;
 
+  // Negotiate HTTP/2 with Home Assistant so that concurrent updates share a
+  // single multiplexed connection. Requires HTTP/2 support on the server, which
+  // the supervisor proxy does not provide, so this is disabled by default.
+  // Cleared by whichever transfer finds curl lacks HTTP/2, while others may
+  // be preparing theirs on other threads.
+  std::atomic_bool useHttp2{false};
+
 protected:
-  virtual void UpdateState_Impl(std::string_view state,
-                                const json &attributes = {}) = 0;
+  virtual void UpdateState_Impl(const HassState &state) = 0;
 
-  void UpdateStateInternal(std::string_view state, const json &attributes);
+  void UpdateStateInternal(const HassState &state);
   void UpdateBinarySensor(std::optional<detector::RegionsOfInterest> rois);
   void UpdateSensor(std::optional<detector::RegionsOfInterest> rois);
 
@@ -46,6 +75,17 @@ protected:
     return nextState_ != currentState_;
   }
   [[nodiscard]] bool IsStateBecomingUnknown() const;
+  [[nodiscard]] bool HasInitialState() const { return hasInitialState_; }
+  [[nodiscard]] const HassState &GetNextState() const { return nextState_; }
+
+  // Record that Home Assistant has accepted state
+  void AcceptState(const HassState &state);
+
+  // Write state as the JSON body Home Assistant expects into out, reusing its
+  // storage
+  void SerializeState(const HassState &state, std::string &out) const;
+
+  void PrepareConnection(util::CurlWrapper &wCurl);
 
   void PrepareGetRequest(util::CurlWrapper &wCurl, std::vector<char> &buf);
   void HandleGetResponse(util::CurlWrapper &wCurl, std::span<const char> buf);
@@ -58,8 +98,10 @@ private:
   boost::url url_;
   std::string token_;
 
-  json currentState_ = {};
-  json nextState_ = {};
+  HassState currentState_;
+  HassState nextState_;
+  HassState detectedState_; // scratch for the detection thread
+  bool hasInitialState_{false};
 };
 
 } // namespace callback
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Callback/Context.h"
+
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+#include <UsageEnvironment.hh>
+#include <gsl/gsl>
+
+#include "Util/CurlMultiWrapper.h"
+#include "Util/CurlWrapper.h"
+
+namespace callback {
+
+// Drives a single curl multi handle from a live555 TaskScheduler. Every async
+// handler bound to the same scheduler submits its transfers here, so the
+// scheduler carries one curl timer and one set of sockets, and all transfers
+// share the multi handle's DNS and connection caches.
+class CurlMultiReactor : public std::enable_shared_from_this<CurlMultiReactor> {
+
+public:
+  // Called on the scheduler thread once the transfer is finished and the easy
+  // handle has been removed from the multi handle
+  using Completion = std::function<void(CURLcode result)>;
+
+  // Returns the reactor bound to pSched, creating it on first use
+  [[nodiscard]] static std::shared_ptr<CurlMultiReactor>
+  ForScheduler(std::shared_ptr<TaskScheduler> pSched);
+
+  explicit CurlMultiReactor(std::shared_ptr<TaskScheduler> pSched);
+  CurlMultiReactor(const CurlMultiReactor &) = delete;
+  CurlMultiReactor(CurlMultiReactor &&) = delete;
+  CurlMultiReactor &operator=(const CurlMultiReactor &) = delete;
+  CurlMultiReactor &operator=(CurlMultiReactor &&) = delete;
+
+  virtual ~CurlMultiReactor() noexcept;
+
+  // The reactor keeps pWCurl alive until onDone has been called
+  void Submit(std::shared_ptr<util::CurlWrapper> pWCurl, Completion onDone);
+
+  [[nodiscard]] size_t GetPendingTransfers() const {
+    return transfers_.size();
+  }
+  [[nodiscard]] size_t GetOpenSockets() const { return socketCtxs_.size(); }
+
+private:
+  struct Transfer {
+    std::shared_ptr<util::CurlWrapper> pWCurl;
+    Completion onDone;
+  };
+
+  gsl::not_null<std::shared_ptr<TaskScheduler>> pSched_;
+  util::CurlMultiWrapper wCurlMulti_;
+  TaskToken timeoutTaskToken_{};
+
+  using _CurlSocketContext = CurlSocketContext<CurlMultiReactor>;
+  std::unordered_map<CURL *, Transfer> transfers_;
+  std::unordered_map<curl_socket_t, std::shared_ptr<_CurlSocketContext>>
+      socketCtxs_;
+
+  void CheckMultiInfo();
+
+  static int SocketCallback(CURL *easy, curl_socket_t s, int action,
+                            CurlMultiReactor *curlMultiReactor,
+                            _CurlSocketContext *curlSocketContext);
+  static int TimeoutCallback(CURLM *multi, int timeoutMs,
+                             CurlMultiReactor *curlMultiReactor);
+
+  static void BackgroundHandlerProc(void *curlSocketContext_clientData,
+                                    int mask);
+  static void TimeoutHandlerProc(void *curlMultiReactor_clientData);
+};
+
+} // namespace callback
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <unordered_map>
+
+#include <UsageEnvironment.hh>
+#include <gsl/gsl>
+
+namespace callback {
+
+// Coalesces Home Assistant state updates from every feed on a scheduler. The
+// first update opens a window and all updates queued before it closes are
+// flushed together, so a motion burst across many cameras goes out as one
+// burst of requests on the shared connection instead of N separate exchanges.
+// An update is never held longer than the delay it was queued with.
+class HassStateBatcher {
+
+public:
+  using Flush = std::function<void()>;
+
+  // Returns the batcher bound to pSched, creating it on first use
+  [[nodiscard]] static std::shared_ptr<HassStateBatcher>
+  ForScheduler(std::shared_ptr<TaskScheduler> pSched);
+
+  explicit HassStateBatcher(std::shared_ptr<TaskScheduler> pSched);
+  HassStateBatcher(const HassStateBatcher &) = delete;
+  HassStateBatcher(HassStateBatcher &&) = delete;
+  HassStateBatcher &operator=(const HassStateBatcher &) = delete;
+  HassStateBatcher &operator=(HassStateBatcher &&) = delete;
+
+  virtual ~HassStateBatcher() noexcept;
+
+  // Queue flush to run within maxDelay. Queuing again under the same key
+  // before the window closes replaces the earlier flush, so only the latest
+  // state of an entity is sent.
+  void Enqueue(const void *key, Flush flush,
+               std::chrono::microseconds maxDelay);
+
+  void FlushNow();
+
+  [[nodiscard]] size_t GetQueuedUpdates() const { return queued_.size(); }
+  [[nodiscard]] size_t GetFlushedBatches() const { return flushedBatches_; }
+  [[nodiscard]] size_t GetFlushedUpdates() const { return flushedUpdates_; }
+
+private:
+  using sc = std::chrono::steady_clock;
+
+  gsl::not_null<std::shared_ptr<TaskScheduler>> pSched_;
+  TaskToken flushTaskToken_{nullptr};
+  sc::time_point deadline_{sc::time_point::max()};
+
+  std::unordered_map<const void *, Flush> queued_;
+  size_t flushedBatches_{0};
+  size_t flushedUpdates_{0};
+
+  static void FlushProc(void *hassStateBatcher_clientData);
+};
+
+} // namespace callback
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Util/MediaCatalog.h"
+
+namespace callback {
+
+// Keeps saved media within per-feed and global budgets. Files to delete are
+// picked from the feeds' catalogs, oldest first, and removed in batches on a
+// worker thread so a slow disk never holds up the event loop.
+class RetentionManager {
+
+public:
+  // A limit of 0 is no limit
+  struct Budget {
+    uintmax_t maxBytes{0};
+    size_t maxFiles{0};
+    std::chrono::seconds maxAge{0};
+  };
+
+  struct Usage {
+    uintmax_t bytes{0};
+    size_t files{0};
+    uintmax_t removedBytes{0};
+    size_t removedFiles{0};
+  };
+
+  explicit RetentionManager(const std::filesystem::path &root,
+                            Budget globalBudget = {});
+  RetentionManager(const RetentionManager &) = delete;
+  RetentionManager(RetentionManager &&) = delete;
+  RetentionManager &operator=(const RetentionManager &) = delete;
+  RetentionManager &operator=(RetentionManager &&) = delete;
+  ~RetentionManager() noexcept = default;
+
+  void AddFeed(std::string feedId,
+               std::shared_ptr<util::MediaCatalog> pCatalog, Budget budget);
+
+  // Wake the worker to check the budgets, cheap enough to call on every save
+  void Notify();
+
+  [[nodiscard]] std::vector<std::pair<std::string, Usage>> GetUsage() const;
+  // Usage per feed and of the disk holding root as a JSON object
+  [[nodiscard]] std::string DumpUsage() const;
+
+  // Age budgets are also checked this often without a save, set before the
+  // first feed is added
+  std::chrono::seconds checkInterval{60};
+  size_t batchSize{64};
+
+private:
+  struct Feed {
+    std::string id;
+    std::shared_ptr<util::MediaCatalog> pCatalog;
+    Budget budget;
+    Usage usage;
+  };
+
+  std::filesystem::path root_;
+  Budget globalBudget_;
+
+  mutable std::mutex mtx_;
+  std::condition_variable_any cv_;
+  bool pending_{false};
+  std::vector<Feed> feeds_;
+
+  // last member, so it is joined before the rest is destroyed
+  std::jthread worker_;
+
+  void Run(std::stop_token stopToken);
+  void Enforce(std::stop_token stopToken);
+};
+
+} // namespace callback
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace callback {
+
+// One shared instance of T per key, kept alive by whoever holds it. The
+// registry only keeps weak references, the entries of released instances are
+// dropped on the next lookup.
+template <class T, class Key> class SharedRegistry {
+
+public:
+  // Returns the instance for key, creating it from args when there is none
+  template <class... Args>
+  [[nodiscard]] std::shared_ptr<T> GetOrCreate(const Key &key,
+                                               Args &&...args) {
+    std::scoped_lock lk(mtx_);
+    std::erase_if(instances_,
+                  [](const auto &entry) { return entry.second.expired(); });
+    auto &wpInstance = instances_[key];
+    auto pInstance = wpInstance.lock();
+    if (!pInstance) {
+      pInstance = std::make_shared<T>(std::forward<Args>(args)...);
+      wpInstance = pInstance;
+    }
+    return pInstance;
+  }
+
+  // Entries, including released instances not yet dropped
+  [[nodiscard]] size_t Size() const {
+    std::scoped_lock lk(mtx_);
+    return instances_.size();
+  }
+
+private:
+  mutable std::mutex mtx_;
+  std::unordered_map<Key, std::weak_ptr<T>> instances_;
+};
+
+} // namespace callback
@@ -27,8 +27,7 @@ public:
   virtual ~SyncHassHandler() noexcept = default;
 
 protected:
-  void UpdateState_Impl(std::string_view state,
-                        const json &attributes) override;
+  void UpdateState_Impl(const HassState &state) override;
 
 private:
   std::vector<char> buf_; // for CURL responses
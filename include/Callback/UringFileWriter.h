@@ -0,0 +1,102 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+#include <UsageEnvironment.hh>
+#include <gsl/gsl>
+
+struct io_uring;
+
+namespace callback {
+
+// Writes whole files through io_uring. Each file is a single hard-linked chain
+// of open, write, optional fsync and close on a registered descriptor, so it
+// costs one submission and never blocks the event loop. Completions are reaped
+// from an eventfd watched by the TaskScheduler, no signals or helper threads.
+// Where io_uring is unavailable (old kernels, container seccomp profiles)
+// files are written synchronously instead.
+class UringFileWriter {
+
+public:
+  // Bytes written, or a negative errno
+  using Completion = std::function<void(int result)>;
+
+  // Returns the writer bound to pSched, creating it on first use
+  [[nodiscard]] static std::shared_ptr<UringFileWriter>
+  ForScheduler(std::shared_ptr<TaskScheduler> pSched);
+
+  explicit UringFileWriter(std::shared_ptr<TaskScheduler> pSched);
+  UringFileWriter(const UringFileWriter &) = delete;
+  UringFileWriter(UringFileWriter &&) = delete;
+  UringFileWriter &operator=(const UringFileWriter &) = delete;
+  UringFileWriter &operator=(UringFileWriter &&) = delete;
+
+  virtual ~UringFileWriter() noexcept;
+
+  // Create or truncate path and write data to it, data must stay valid until
+  // onDone runs. With durable the data is flushed to disk before close.
+  void WriteFile(std::filesystem::path path, std::span<const char> data,
+                 Completion onDone, bool durable = false);
+  // As WriteFile, but append to path, creating it if needed. Appends to one
+  // file are only ordered if each waits for the last to complete.
+  void AppendFile(std::filesystem::path path, std::span<const char> data,
+                  Completion onDone, bool durable = false);
+
+  [[nodiscard]] bool IsAsync() const { return bool(pRing_); }
+  [[nodiscard]] size_t GetPendingWrites() const { return requests_.size(); }
+
+  static constexpr unsigned maxOpenFiles{64};
+
+private:
+  enum class Op : uint64_t { Open, Write, Fsync, Close };
+
+  struct Request {
+    std::filesystem::path path;
+    std::span<const char> data;
+    Completion onDone;
+    bool durable{false};
+    bool append{false};
+    unsigned slot{0};
+    int result{0};
+  };
+
+  gsl::not_null<std::shared_ptr<TaskScheduler>> pSched_;
+  std::unique_ptr<io_uring> pRing_;
+  int eventFd_{-1};
+  size_t inFlightSqes_{0};
+
+  uint64_t nextId_{1};
+  std::unordered_map<uint64_t, Request> requests_;
+  std::vector<unsigned> freeSlots_;
+  std::deque<uint64_t> waiting_; // requests without a free descriptor slot
+
+  void Enqueue(Request req);
+  // False if no descriptor slot is free. A chain that fails to submit is
+  // written synchronously and its completion added to done.
+  bool Submit(uint64_t id, Request &req,
+              std::vector<std::pair<Completion, int>> &done);
+  void SubmitWaiting(std::vector<std::pair<Completion, int>> &done);
+  void Reap();
+  // Completions may write again, so only call them once the ring is settled
+  static void RunCompletions(std::vector<std::pair<Completion, int>> &done);
+  void Complete(uint64_t id, Op op, int res,
+                std::vector<std::pair<Completion, int>> &done);
+
+  static int WriteFileBlocking(const std::filesystem::path &path,
+                               std::span<const char> data, bool durable,
+                               bool append);
+  static void EventHandlerProc(void *uringFileWriter_clientData, int mask);
+};
+
+} // namespace callback
+
+#endif // __linux__
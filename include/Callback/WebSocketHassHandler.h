@@ -0,0 +1,150 @@
+#pragma once
+
+#include "Detector/Detector.h"
+
+#include "Callback/BaseHassHandler.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/url.hpp>
+
+#define JSON_USE_IMPLICIT_CONVERSIONS 0
+#include <nlohmann/json.hpp>
+
+#include "Util/CurlWrapper.h"
+
+namespace callback {
+
+using json = nlohmann::json;
+
+class WebSocketHassHandler;
+
+// One authenticated websocket to a Home Assistant instance, shared by every
+// WebSocketHassHandler for it. A single thread sends the state changes of all
+// of them, keeps the connection alive and reconnects it with backoff.
+class HassWebSocket {
+
+public:
+  // Returns the connection for url and token, creating it on first use
+  [[nodiscard]] static std::shared_ptr<HassWebSocket>
+  ForInstance(const boost::url &url, const std::string &token);
+
+  HassWebSocket(const boost::url &url, const std::string &token);
+  HassWebSocket(const HassWebSocket &) = delete;
+  HassWebSocket(HassWebSocket &&) = delete;
+  HassWebSocket &operator=(const HassWebSocket &) = delete;
+  HassWebSocket &operator=(HassWebSocket &&) = delete;
+  ~HassWebSocket() noexcept;
+
+  // Connects and authenticates before returning the first time, so a bad URL
+  // or token fails here
+  void Start();
+  void Add(WebSocketHassHandler *pHandler);
+  void Remove(WebSocketHassHandler *pHandler);
+  // Call with the handler's state updated under GetMutex()
+  void Notify();
+  [[nodiscard]] std::mutex &GetMutex() { return mtx_; }
+
+  std::chrono::seconds maxReconnectDelay{60};
+
+  [[nodiscard]] bool IsConnected() const { return connected_; }
+  [[nodiscard]] int GetReconnects() const { return reconnects_; }
+
+private:
+  boost::url wsUrl_;
+  std::string token_;
+
+  util::CurlWrapper wCurl_;
+  std::atomic_bool connected_{false};
+  std::atomic_int reconnects_{0};
+
+  // guarded by mtx_
+  std::vector<WebSocketHassHandler *> handlers_;
+  int64_t nextId_{1};
+  std::unordered_map<int64_t, std::pair<WebSocketHassHandler *, HassState>>
+      pendingStates_;
+  bool updatePending_{false};
+
+  bool pingOutstanding_{false};
+  std::vector<std::string> outgoing_;
+  std::string sendBuf_;
+  std::vector<char> recvBuf_; // reassembles fragmented messages
+
+  std::condition_variable_any cv_;
+  std::mutex mtx_;
+  std::once_flag startFlag_;
+  std::jthread updaterThread_;
+
+  void Run(std::stop_token stopToken);
+  void Connect();
+  void Disconnect();
+
+  void SendMessage(const json &msg);
+  void SendText(std::string_view text);
+  // Returns the next complete message, or nothing if none is waiting
+  std::optional<json> ReceiveMessage();
+  json WaitForMessage(std::chrono::milliseconds timeout);
+  void HandleMessage(const json &msg);
+};
+
+// Publishes each state change as a single message on the websocket shared by
+// all handlers for the same Home Assistant instance, instead of a REST
+// exchange per update. Home Assistant's websocket API has no command to write
+// entity state directly, so changes are fired as events of eventType carrying
+// the entity state, to be picked up by a trigger-based template entity.
+class WebSocketHassHandler : public BaseHassHandler {
+
+public:
+  WebSocketHassHandler(const boost::url &url, const std::string &token,
+                       const std::string &entityId);
+  WebSocketHassHandler(const WebSocketHassHandler &) = delete;
+  WebSocketHassHandler(WebSocketHassHandler &&) = delete;
+  WebSocketHassHandler &operator=(const WebSocketHassHandler &) = delete;
+  WebSocketHassHandler &operator=(WebSocketHassHandler &&) = delete;
+
+  // Connects and authenticates before returning unless the connection is
+  // already open, so a bad URL or token fails here
+  void Start();
+  void Stop();
+
+  ~WebSocketHassHandler() noexcept override;
+
+  std::string eventType{"motion_detection_state"};
+
+  [[nodiscard]] bool IsConnected() const { return pSocket_->IsConnected(); }
+  [[nodiscard]] int GetReconnects() const { return pSocket_->GetReconnects(); }
+  [[nodiscard]] const std::shared_ptr<HassWebSocket> &GetConnection() const {
+    return pSocket_;
+  }
+
+protected:
+  void UpdateState_Impl(const HassState &state) override;
+
+private:
+  friend class HassWebSocket;
+  using sc = std::chrono::steady_clock;
+
+  std::shared_ptr<HassWebSocket> pSocket_;
+  bool started_{false};
+
+  // guarded by the socket's mutex
+  std::optional<HassState> lastSentState_;
+  sc::time_point lastStateUpdate_;
+  std::string stateBuf_;
+
+  // The state to send if one is due, serialized into stateBuf_
+  std::optional<HassState> TakeUpdate();
+  void OnResult(const json &msg, const HassState &state);
+};
+
+} // namespace callback
@@ -28,11 +28,18 @@ public:
   virtual std::variant<int, double> GetDetectionSize() = 0;
 
   RegionsOfInterest FeedFrame(video_source::Frame frame);
+  // FeedFrame in two steps, Detect updates the model and Publish notifies the
+  // subscribers, so detection can run on another thread than the subscribers
+  RegionsOfInterest Detect(video_source::Frame frame);
+  void Publish();
   [[nodiscard]] RegionsOfInterest GetRois() const { return rois_; };
 
   virtual void ResetModel() = 0;
   [[nodiscard]] virtual cv::Mat GetModel() = 0;
 
+  // 8-bit, 255 where motion counts, at the size of the frames fed. It is
+  // applied to the foreground before regions are found, the frame itself is
+  // never masked. Empty counts motion everywhere.
   cv::Mat mask;
 
 protected:
@@ -42,7 +49,6 @@ private:
   virtual RegionsOfInterest FeedFrame_Impl(cv::Mat frame) = 0;
   RegionsOfInterest rois_;
   video_source::Frame frame_;
-  cv::Mat maskedFrame_;
 };
 
 } // namespace detector
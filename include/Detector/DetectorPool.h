@@ -0,0 +1,139 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <UsageEnvironment.hh>
+
+#include "Detector/Detector.h"
+#include "Detector/MotionGate.h"
+#include "Util/RateStatistics.h"
+
+namespace detector {
+
+// Runs detection for every feed on one set of worker threads. Each feed has a
+// strand, its frames are detected one at a time and in order as background
+// models are sequential, and a strand waiting on a busy worker is stolen by an
+// idle one. Subscribers are notified on the feed's own event loop.
+class DetectorPool {
+
+public:
+  class Strand : public std::enable_shared_from_this<Strand> {
+
+  public:
+    Strand(DetectorPool &pool, size_t home, std::string name,
+           std::shared_ptr<Detector> pDetector,
+           std::shared_ptr<TaskScheduler> pSched);
+    Strand(const Strand &) = delete;
+    Strand(Strand &&) = delete;
+    Strand &operator=(const Strand &) = delete;
+    Strand &operator=(Strand &&) = delete;
+    ~Strand() noexcept;
+
+    // Queue a frame for detection unless the gate skips it, call from the
+    // feed's event loop
+    void Post(video_source::Frame frame);
+
+    [[nodiscard]] const std::string &GetName() const { return name_; }
+    [[nodiscard]] size_t GetQueueDepth() const;
+    [[nodiscard]] size_t GetDropped() const;
+    // From capture on the camera to the end of detection for the last frame,
+    // for cameras whose clock is synchronised by RTCP
+    [[nodiscard]] std::optional<std::chrono::microseconds> GetLatency() const;
+
+    // Runs on the worker before each detection, for detector settings that
+    // must not change while it runs
+    std::function<void(Detector &, const video_source::Frame &)> prepare;
+    // Oldest frames are dropped past this, a late detection is worth less
+    // than a current one. 0 keeps every frame.
+    size_t maxQueuedFrames{2};
+    // Lowers the analysis rate while the feed has no motion, optional
+    std::shared_ptr<MotionGate> pGate;
+    // Frames detected, by stream time
+    util::RateStatistics analysedRate;
+
+  private:
+    friend class DetectorPool;
+
+    DetectorPool &pool_;
+    size_t home_;
+    std::string name_;
+    std::shared_ptr<Detector> pDetector_;
+    std::shared_ptr<TaskScheduler> pSched_;
+    EventTriggerId detectedTrigger_{0};
+
+    mutable std::mutex mtx_;
+    std::deque<video_source::Frame> frames_;
+    // set from Post until the last result is published
+    bool busy_{false};
+    bool detected_{false};
+    std::chrono::steady_clock::time_point detectedAt_;
+    size_t dropped_{0};
+    std::atomic<std::chrono::microseconds> latency_{
+        std::chrono::microseconds::min()};
+
+    void RunOne();
+    static void DetectedProc(void *strand_clientData);
+  };
+
+  explicit DetectorPool(size_t threads);
+  DetectorPool(const DetectorPool &) = delete;
+  DetectorPool(DetectorPool &&) = delete;
+  DetectorPool &operator=(const DetectorPool &) = delete;
+  DetectorPool &operator=(DetectorPool &&) = delete;
+  ~DetectorPool() noexcept = default;
+
+  // Strand for a feed whose subscribers run on pSched's loop. Call before
+  // the loop runs, event triggers cannot be created from another thread.
+  [[nodiscard]] std::shared_ptr<Strand>
+  MakeStrand(std::string name, std::shared_ptr<Detector> pDetector,
+             std::shared_ptr<TaskScheduler> pSched);
+
+  [[nodiscard]] size_t Size() const { return workers_.size(); }
+  // Frames waiting for a worker across all feeds
+  [[nodiscard]] size_t GetQueueDepth() const { return queuedFrames_; }
+  [[nodiscard]] size_t GetDropped() const { return droppedFrames_; }
+  [[nodiscard]] size_t GetDetected() const { return detectedFrames_; }
+  [[nodiscard]] size_t GetStolen() const { return stolen_; }
+  // Pool and per feed counters as a JSON object
+  [[nodiscard]] std::string DumpStats() const;
+
+private:
+  struct Worker {
+    std::mutex mtx;
+    std::deque<std::shared_ptr<Strand>> strands;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic_size_t nextHome_{0};
+
+  mutable std::mutex strandsMtx_;
+  std::vector<std::weak_ptr<Strand>> strands_;
+
+  std::mutex sleepMtx_;
+  std::condition_variable_any cv_;
+  std::atomic_size_t ready_{0};
+
+  std::atomic_size_t queuedFrames_{0};
+  std::atomic_size_t droppedFrames_{0};
+  std::atomic_size_t detectedFrames_{0};
+  std::atomic_size_t stolen_{0};
+
+  // last member, so they are joined before the rest is destroyed
+  std::vector<std::jthread> threads_;
+
+  void Submit(std::shared_ptr<Strand> pStrand);
+  std::shared_ptr<Strand> Take(size_t index);
+  void Run(size_t index, std::stop_token stopToken);
+};
+
+} // namespace detector
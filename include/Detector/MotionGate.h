@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#include <opencv2/core.hpp>
+
+#include "VideoSource/VideoSource.h"
+
+namespace detector {
+
+// Decides which frames of a feed are worth analysing. Every frame is analysed
+// while there is motion. Once nothing has been detected for a while the feed
+// goes idle and only every Nth frame is analysed, or a frame that a cheap
+// difference against the last analysed one shows has changed. The first
+// detection makes it active again.
+class MotionGate {
+
+public:
+  struct Options {
+    // idle after nothing is detected for this long, 0 never idles
+    std::chrono::milliseconds idleAfter{std::chrono::seconds(60)};
+    // analysed while idle so the background model keeps up with the scene
+    size_t idleStride{10};
+    // the difference is taken at this width, a grey level change of more than
+    // wakeLevel over wakeFraction of the pixels wakes the detector
+    int precheckWidth{160};
+    int wakeLevel{16};
+    double wakeFraction{0.0005};
+  };
+
+  enum class State : uint8_t { Active, Idle };
+
+  explicit MotionGate(Options options);
+
+  // Call for every frame before it is queued for detection
+  [[nodiscard]] bool ShouldAnalyse(const video_source::Frame &frame);
+  // Call with the result of each analysed frame
+  void OnResult(bool motion, std::chrono::steady_clock::time_point timeStamp);
+
+  [[nodiscard]] State GetState() const { return state_; }
+  [[nodiscard]] size_t GetAnalysed() const { return analysed_; }
+  [[nodiscard]] size_t GetSkipped() const { return skipped_; }
+  [[nodiscard]] size_t GetIdleTransitions() const { return toIdle_; }
+  [[nodiscard]] size_t GetActiveTransitions() const { return toActive_; }
+
+  const Options options;
+
+private:
+  std::atomic<State> state_{State::Active};
+  std::chrono::steady_clock::time_point lastMotion_{};
+  size_t sinceAnalysed_{0};
+  cv::Mat small_;
+  cv::Mat reference_;
+  cv::Mat diff_;
+
+  std::atomic_size_t analysed_{0};
+  std::atomic_size_t skipped_{0};
+  std::atomic_size_t toIdle_{0};
+  std::atomic_size_t toActive_{0};
+
+  void Downsample(const cv::Mat &img);
+  [[nodiscard]] bool HasChanged();
+};
+
+} // namespace detector
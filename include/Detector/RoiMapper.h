@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "Detector/Detector.h"
+#include "VideoSource/VideoSource.h"
+
+namespace detector {
+
+// Carries detections made on a camera's low resolution sub-stream over to a
+// frame of its main stream, so saved images and the web UI show the full
+// resolution picture with the regions in the right place.
+class RoiMapper {
+
+public:
+  // The payload with its frame replaced and its regions scaled to match,
+  // the regions stay valid until the next call. The mask keeps the resolution
+  // detection ran at. An empty frame leaves the payload as it is.
+  [[nodiscard]] Payload Map(const Payload &payload,
+                            const video_source::Frame &frame);
+
+  // Scales rect from an image of size from to one of size to, rounding out so
+  // the result still covers the same pixels
+  [[nodiscard]] static cv::Rect Scale(const cv::Rect &rect, cv::Size from,
+                                      cv::Size to);
+
+private:
+  std::vector<cv::Rect> rois_;
+};
+
+} // namespace detector
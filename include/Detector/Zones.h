@@ -0,0 +1,42 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include <opencv2/core.hpp>
+
+#include "Util/ProgramOptions.h"
+
+namespace detector {
+
+// The include and exclude zones of a feed. They can be replaced from any
+// thread while the feed runs, the detector rasterises them again before its
+// next frame.
+class Zones {
+
+public:
+  explicit Zones(std::vector<util::Zone> zones = {});
+  Zones(const Zones &) = delete;
+  Zones(Zones &&) = delete;
+  Zones &operator=(const Zones &) = delete;
+  Zones &operator=(Zones &&) = delete;
+  ~Zones() noexcept = default;
+
+  void Set(std::vector<util::Zone> zones);
+  [[nodiscard]] std::vector<util::Zone> Get() const;
+  // Changes with every Set
+  [[nodiscard]] uint64_t GetVersion() const { return version_; }
+
+  // Mask of size with 255 where motion counts, empty when it counts
+  // everywhere
+  [[nodiscard]] cv::Mat Rasterise(cv::Size size) const;
+
+private:
+  mutable std::mutex mtx_;
+  std::vector<util::Zone> zones_;
+  std::atomic_uint64_t version_{0};
+};
+
+} // namespace detector
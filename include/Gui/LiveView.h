@@ -0,0 +1,40 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <vector>
+
+#include <gsl/gsl>
+#include <opencv2/core.hpp>
+
+#include "Detector/Detector.h"
+#include "Gui/WebHandler.h"
+#include "VideoSource/VideoSource.h"
+
+namespace gui {
+
+// Feeds a feed's live view from its source, so the view keeps the source's
+// frame rate while detection skips frames. Each frame is shown with the
+// regions and model of the latest detection. They are copied when the
+// detector publishes them, as it rewrites its model while analysing the next
+// frame. Both calls come from the feed's loop.
+class LiveView {
+
+public:
+  LiveView(std::shared_ptr<WebHandler> pWebHandler, std::string_view feedId);
+
+  // Call from the detector's subscriber, while model is not being updated
+  void OnDetection(detector::RegionsOfInterest rois, const cv::Mat &model);
+  // Call from the source's subscriber
+  void OnFrame(video_source::Frame frame, double fps);
+
+private:
+  gsl::not_null<std::shared_ptr<WebHandler>> pWebHandler_;
+  std::string_view feedId_;
+
+  std::vector<cv::Rect> rois_;
+  // empty until the first detection has finished
+  cv::Mat model_;
+};
+
+} // namespace gui
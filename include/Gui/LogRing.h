@@ -0,0 +1,72 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <spdlog/common.h>
+#include <spdlog/details/log_msg.h>
+#include <spdlog/sinks/sink.h>
+
+namespace gui {
+
+// Bounded lock-free queue of log records, written by any thread and drained by
+// one. A full ring drops the new record and counts it, so logging never waits
+// on the reader.
+class LogRing {
+
+public:
+  struct Record {
+    spdlog::level::level_enum level{spdlog::level::off};
+    spdlog::log_clock::time_point time;
+    std::string payload;
+  };
+
+  // capacity is rounded up to a power of two
+  explicit LogRing(size_t capacity);
+  LogRing(const LogRing &) = delete;
+  LogRing(LogRing &&) = delete;
+  LogRing &operator=(const LogRing &) = delete;
+  LogRing &operator=(LogRing &&) = delete;
+  ~LogRing() noexcept = default;
+
+  bool Push(const spdlog::details::log_msg &msg);
+  // Single reader only, hands up to maxRecords to fn in order
+  size_t Drain(const std::function<void(const Record &)> &fn,
+               size_t maxRecords);
+
+  [[nodiscard]] size_t Capacity() const { return slots_.size(); }
+  [[nodiscard]] size_t GetDropped() const { return dropped_; }
+
+private:
+  struct Slot {
+    std::atomic_size_t sequence;
+    Record record;
+  };
+
+  std::vector<Slot> slots_;
+  size_t mask_;
+  alignas(64) std::atomic_size_t enqueuePos_{0};
+  alignas(64) size_t dequeuePos_{0};
+  std::atomic_size_t dropped_{0};
+};
+
+// spdlog sink feeding a LogRing, without the mutex of the _mt sinks
+class LogRingSink : public spdlog::sinks::sink {
+
+public:
+  explicit LogRingSink(std::shared_ptr<LogRing> pRing);
+
+  void log(const spdlog::details::log_msg &msg) override;
+  void flush() override {}
+  void set_pattern(const std::string &) override {}
+  void set_formatter(std::unique_ptr<spdlog::formatter>) override {}
+
+private:
+  std::shared_ptr<LogRing> pRing_;
+};
+
+} // namespace gui
@@ -1,6 +1,9 @@
 #pragma once
 
+#include "Detector/Zones.h"
+#include "Gui/LogRing.h"
 #include "Gui/Payload.h"
+#include "Util/MediaCatalog.h"
 
 #include <boost/url.hpp>
 #include <gsl/gsl>
@@ -8,6 +11,8 @@
 #include <opencv2/core.hpp>
 
 #include <filesystem>
+#include <functional>
+#include <memory>
 #include <shared_mutex>
 #include <string_view>
 #include <thread>
@@ -21,6 +26,20 @@ public:
   static void
   SetSavedFilesServePath(std::string_view slug,
                          const std::filesystem::path &savedFilesPath);
+  // Serve the catalog at /media/catalog/<slug> so saved media can be paged
+  // without listing the directory
+  static void
+  SetSavedFilesCatalog(std::string_view slug,
+                       std::shared_ptr<const util::MediaCatalog> pCatalog);
+  // Serve the JSON the provider returns at /media/storage
+  static void SetStorageUsageProvider(std::function<std::string()> provider);
+  // Serve the JSON the provider returns at /media/detector. It is called with
+  // the feed mapping lock held, so once it is replaced no call is running.
+  static void SetDetectorStatsProvider(std::function<std::string()> provider);
+  // Serve a feed's zones at /media/zones/<feedId>, where a PUT replaces them
+  // while the feed runs
+  static void SetZones(std::string_view feedId,
+                       std::shared_ptr<detector::Zones> pZones);
 
   explicit WebHandler(int port, std::string_view host = "0.0.0.0");
   WebHandler(const WebHandler &) = delete;
@@ -35,6 +54,7 @@ public:
 
   ~WebHandler() noexcept = default;
 
+  // Safe to call from several event loops at once, one feed per loop
   void operator()(Payload data);
 
 private:
@@ -63,18 +83,31 @@ private:
 
     explicit FeedImageData(mg_mgr *mgr)
         : imageBroadcastData_{
-              .mgr = mgr, .mtx = &modelMtx_, .marker = {'L', char(-1)}},
+              .mgr = mgr, .mtx = &imageMtx_, .marker = {'L', char(-1)}},
           modelBroadcastData_{
-              .mgr = mgr, .mtx = &imageMtx_, .marker = {'M', char(-1)}} {}
+              .mgr = mgr, .mtx = &modelMtx_, .marker = {'M', char(-1)}} {}
   };
 
+  // guarded by the feed mapping mutex, the data of each feed is only written
+  // by the loop running that feed
   using BroadcastMap =
       std::unordered_map<std::string_view, std::unique_ptr<FeedImageData>>;
   BroadcastMap feedImageDataMap_;
 
+  // nullptr once the maximum number of feeds is reached
+  FeedImageData *GetOrAddFeed(std::string_view feedId);
+
   static void BroadcastMjpegFrame(gui::WebHandler::BroadcastMap *broadcastData);
   static void BroadcastImage_TimerCallback(void *arg);
 
+  // only touched by the listener thread, apart from the ring
+  std::shared_ptr<LogRing> pLogRing_;
+  std::vector<std::pair<spdlog::level::level_enum, std::string>> logLines_;
+  size_t logLinesDropped_{0};
+
+  void BroadcastLogs();
+  static void BroadcastLogs_TimerCallback(void *arg);
+
   std::jthread listenerThread_;
 };
 
@@ -1,31 +1,105 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <filesystem>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <utility>
 
 #include <boost/url.hpp>
 
+#include <spdlog/async.h>
 #include <spdlog/sinks/callback_sink.h>
+#include <spdlog/sinks/dist_sink.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 #include <spdlog/spdlog.h>
 
-#define LOGGER spdlog::get("console")
-#define ERR_LOGGER spdlog::get("error")
+#define LOGGER logger::Console()
+#define ERR_LOGGER logger::Error()
 
 namespace logger {
 
+// Messages waiting for the console logger's thread, a full queue drops the
+// oldest rather than blocking the thread that logs
+inline constexpr size_t asyncQueueSize{8192};
+
+// spdlog::get locks the registry on every call, so the handle is looked up
+// once. The cache shares ownership of the logger, spdlog::shutdown drops the
+// registry's reference and a late message must not find it destroyed.
+class Cached {
+
+public:
+  explicit Cached(std::string name) : name_{std::move(name)} {}
+
+  spdlog::logger *Get() {
+    auto *pLogger = pLogger_.load(std::memory_order_acquire);
+    if (!pLogger) [[unlikely]] {
+      std::scoped_lock lk(mtx_);
+      if (!pOwner_) {
+        pOwner_ = spdlog::get(name_);
+      }
+      pLogger = pOwner_.get();
+      pLogger_.store(pLogger, std::memory_order_release);
+    }
+    return pLogger;
+  }
+
+private:
+  const std::string name_;
+  std::mutex mtx_;
+  std::shared_ptr<spdlog::logger> pOwner_;
+  std::atomic<spdlog::logger *> pLogger_{nullptr};
+};
+
+inline spdlog::logger *Console() {
+  static Cached cache("console");
+  return cache.Get();
+}
+
+inline spdlog::logger *Error() {
+  static Cached cache("error");
+  return cache.Get();
+}
+
 inline auto InitStdoutLogger() {
   if (!LOGGER) {
-    auto logger = spdlog::stderr_color_mt("console");
+    static std::once_flag threadPoolOnce;
+    std::call_once(threadPoolOnce,
+                   [] { spdlog::init_thread_pool(asyncQueueSize, 1); });
+    // sinks are added through the dist sink, the logger's own list is read
+    // by the logging thread without a lock
+    std::vector<spdlog::sink_ptr> sinks{
+        std::make_shared<spdlog::sinks::stderr_color_sink_mt>()};
+    auto logger = spdlog::create_async_nb<spdlog::sinks::dist_sink_mt>(
+        "console", std::move(sinks));
 #if _DEBUG
     logger->set_level(spdlog::level::debug);
 #endif
     return logger;
   } else {
-    return LOGGER;
+    return spdlog::get("console");
   }
 }
 
+// Add a sink to the console logger while other threads may be logging
+inline void AddConsoleSink(spdlog::sink_ptr pSink) {
+  auto &sinks = LOGGER->sinks();
+  if (const auto pDistSink =
+          sinks.empty()
+              ? nullptr
+              : std::dynamic_pointer_cast<spdlog::sinks::dist_sink_mt>(
+                    sinks.front())) {
+    pDistSink->add_sink(std::move(pSink));
+  } else {
+    sinks.push_back(std::move(pSink));
+  }
+}
+
+// Synchronous, errors are rare and should be written before a crash
 inline auto InitStderrLogger() {
   if (!ERR_LOGGER) {
     auto logger = spdlog::stderr_color_mt("error");
@@ -34,12 +108,56 @@ inline auto InitStderrLogger() {
 #endif
     return logger;
   } else {
-    return ERR_LOGGER;
+    return spdlog::get("error");
   }
 }
 
+// Lets a message through at most once per interval, for warnings that could
+// otherwise repeat on every frame. Safe to share between threads.
+class RateLimit {
+
+public:
+  explicit RateLimit(std::chrono::steady_clock::duration interval)
+      : interval_{interval} {}
+
+  // The number of messages suppressed since the last one let through, or
+  // nullopt to suppress this one
+  [[nodiscard]] std::optional<size_t> Allow() {
+    const auto now = std::chrono::steady_clock::now().time_since_epoch();
+    auto next = next_.load(std::memory_order_relaxed);
+    if (now.count() < next ||
+        !next_.compare_exchange_strong(next, (now + interval_).count(),
+                                       std::memory_order_relaxed)) {
+      ++suppressed_;
+      return std::nullopt;
+    }
+    return suppressed_.exchange(0);
+  }
+
+private:
+  const std::chrono::steady_clock::duration interval_;
+  std::atomic<std::chrono::steady_clock::rep> next_{0};
+  std::atomic_size_t suppressed_{0};
+};
+
 } // namespace logger
 
+// Log through LOGGER at most once per interval from this call site, the
+// arguments are not formatted for suppressed messages
+#define LOGGER_RATE_LIMITED(interval, level, ...)                              \
+  do {                                                                         \
+    static logger::RateLimit rateLimit_(interval);                             \
+    if (LOGGER->should_log(level)) {                                           \
+      if (const auto suppressed_ = rateLimit_.Allow()) {                       \
+        LOGGER->log(level, __VA_ARGS__);                                       \
+        if (*suppressed_ > 0) {                                                \
+          LOGGER->log(level, "({} similar messages suppressed)",              \
+                      *suppressed_);                                           \
+        }                                                                      \
+      }                                                                        \
+    }                                                                          \
+  } while (0)
+
 template <>
 struct fmt::formatter<boost::url> : fmt::formatter<std::string_view> {
   auto format(boost::url url, format_context &ctx) const
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <exception>
+#include <format>
+#include <mutex>
+#include <stdexcept>
+#include <string_view>
+#include <typeinfo>
+#include <utility>
+
+#include <curl/curl.h>
+
+namespace util {
+
+// Owns a CURLSH share handle. Lock callbacks are installed so the handle can
+// be attached to easy handles living on different threads.
+class CurlShareWrapper {
+public:
+  class CurlShareError : public std::runtime_error {
+  public:
+    using std::runtime_error::runtime_error;
+  };
+
+  CurlShareWrapper() noexcept;
+  CurlShareWrapper(const CurlShareWrapper &) = delete;
+  CurlShareWrapper &operator=(const CurlShareWrapper &) = delete;
+  // lock callbacks hold a pointer to this object, so it cannot move
+  CurlShareWrapper(CurlShareWrapper &&) = delete;
+  CurlShareWrapper &operator=(CurlShareWrapper &&) = delete;
+
+  ~CurlShareWrapper() noexcept;
+  CURLSH *pCurl_{nullptr};
+  CURLSH *operator&() { return pCurl_; }
+  operator bool() const { return bool(pCurl_); }
+
+  template <typename F, typename... Ts> CURLSHcode call(F func, Ts... args) {
+    const CURLSHcode res = func(pCurl_, args...);
+    if (res != CURLSHcode::CURLSHE_OK) {
+      throw CurlShareError(
+          std::format("Error {} calling CURL SHARE function {}: {}", int(res),
+                      typeid(func).name(), curl_share_strerror(res)));
+    }
+    return res;
+  }
+
+  template <typename F, typename... Ts>
+  inline CURLSHcode operator()(F func, Ts... args) {
+    return this->call(func, args...);
+  }
+
+private:
+  static void LockCallback(CURL *, curl_lock_data data, curl_lock_access,
+                           void *curlShareWrapper_userPtr);
+  static void UnlockCallback(CURL *, curl_lock_data data,
+                             void *curlShareWrapper_userPtr);
+
+  std::array<std::mutex, CURL_LOCK_DATA_LAST> mtxs_;
+};
+
+} // namespace util
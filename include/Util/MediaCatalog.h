@@ -0,0 +1,96 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace util {
+
+// Persistent index of the media saved for one feed, kept as an append-only
+// JSON lines file in the feed's save directory. Removals are appended as
+// tombstones and the file is rewritten once they outnumber the entries. It is
+// written from the event loop and queried from the web server thread.
+class MediaCatalog {
+
+public:
+  struct Entry {
+    uint64_t id{0};
+    std::chrono::system_clock::time_point timeStamp;
+    std::filesystem::path path; // relative to the catalog directory
+    uintmax_t size{0};
+    uint32_t roiCount{0};
+    std::array<int, 4> roiBounds{0, 0, 0, 0}; // x, y, width, height
+    // camera's capture time of the frame that triggered the save, the epoch
+    // when its clock is not known
+    std::chrono::system_clock::time_point captureTime{};
+  };
+
+  struct Page {
+    std::vector<Entry> entries; // newest first
+    std::optional<uint64_t> next;
+    size_t total{0};
+  };
+
+  explicit MediaCatalog(const std::filesystem::path &directory);
+  MediaCatalog(const MediaCatalog &) = delete;
+  MediaCatalog(MediaCatalog &&) = delete;
+  MediaCatalog &operator=(const MediaCatalog &) = delete;
+  MediaCatalog &operator=(MediaCatalog &&) = delete;
+  ~MediaCatalog() noexcept = default;
+
+  // Read the index, then add media it is missing and forget media that is
+  // gone, so only the difference since the last run touches the disk
+  void Load();
+
+  // Returns the id assigned to the entry
+  uint64_t Add(Entry entry);
+  bool Remove(const std::filesystem::path &path);
+
+  // Entries in [from, to] older than the entry before, at most limit of them.
+  // Page::next is the before for the following page.
+  [[nodiscard]] Page
+  Query(std::optional<std::chrono::system_clock::time_point> from,
+        std::optional<std::chrono::system_clock::time_point> to,
+        std::optional<uint64_t> before, size_t limit) const;
+
+  // Every entry, oldest first
+  [[nodiscard]] std::vector<Entry> GetEntries() const;
+  [[nodiscard]] size_t Size() const;
+  [[nodiscard]] const std::filesystem::path &GetDirectory() const {
+    return directory_;
+  }
+
+  static constexpr std::string_view indexFileName{"index.jsonl"};
+  static constexpr std::string_view thumbnailDirName{"thumbs"};
+
+  // Where the thumbnail for a media file is kept, relative paths stay relative
+  [[nodiscard]] static std::filesystem::path
+  ThumbnailPath(const std::filesystem::path &path);
+
+private:
+  std::filesystem::path directory_;
+
+  mutable std::shared_mutex mtx_;
+  std::map<uint64_t, Entry> entries_;
+  std::unordered_map<std::string, uint64_t> idsByPath_;
+  uint64_t nextId_{1};
+  size_t tombstones_{0};
+
+  std::ofstream index_;
+
+  void Insert(Entry entry);
+  void AppendLine(const std::string &line);
+  void Compact();
+  [[nodiscard]] static std::string Serialize(const Entry &entry);
+};
+
+} // namespace util
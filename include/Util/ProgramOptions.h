@@ -1,14 +1,34 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <filesystem>
 #include <string>
 #include <string_view>
 #include <variant>
+#include <vector>
 
 #include <boost/url.hpp>
+#include <nlohmann/json_fwd.hpp>
 
 namespace util {
 
+// Polygon over part of a feed's frame, in fractions of its width and height
+// so it holds at any resolution
+struct Zone {
+  enum class Kind : uint8_t { Include, Exclude };
+
+  Kind kind{Kind::Include};
+  std::vector<std::array<double, 2>> points;
+
+  bool operator==(const Zone &) const = default;
+};
+
+// {"type": "include" or "exclude", "points": [[x, y], ...]}, reading throws
+// std::invalid_argument for fewer than 3 points or a point off the frame
+void to_json(nlohmann::json &j, const Zone &zone);
+void from_json(const nlohmann::json &j, Zone &zone);
+
 struct ProgramOptions {
 
   [[nodiscard]] static std::variant<ProgramOptions, std::string>
@@ -19,15 +39,56 @@ struct ProgramOptions {
     std::string sourceToken;
     std::string sourceUsername;
     std::string sourcePassword;
+    // "udp", "tcp" for RTP interleaved on the RTSP connection, or "auto" to
+    // switch to TCP when UDP delivers nothing
+    std::string rtspTransport{"udp"};
+    // OS receive buffer for each RTP socket in bytes, 0 keeps the default
+    unsigned rtspSocketBufferSize{2 * 1024 * 1024};
+    std::chrono::milliseconds rtspReorderThreshold{100};
+    // "openh264", "ffmpeg" or "auto" for OpenH264 on H.264 and libavcodec on
+    // H.265
+    std::string decoder{"auto"};
+    // 0 lets the decoder choose
+    int decoderThreads{0};
+    // cheaper decoding of the stream motion is detected on, libavcodec only
+    bool decoderSkipNonReference{false};
+    bool decoderSkipLoopFilter{false};
 
     std::string hassEntityId;
     std::string hassFriendlyName;
 
+    // run detection on this stream, usually the camera's low resolution
+    // sub-stream, and use sourceUrl only for saved frames and the web UI
+    boost::url detectionSourceUrl{""};
+    // detection frames are scaled down to at most this width as they are
+    // decoded, 0 keeps the stream's resolution
+    int detectionWidth{0};
     std::variant<int, double> detectionSize = 0.05;
     std::chrono::seconds detectionDebounce{30};
+    // analyse every Nth frame after this long without motion, 0 analyses
+    // every frame
+    std::chrono::seconds detectionIdleAfter{60};
+    size_t detectionIdleStride{10};
+    // motion only counts inside the include zones, or anywhere without one,
+    // and never inside an exclude zone. The default leaves out the edges,
+    // where cameras overlay the time and their name.
+    std::vector<Zone> zones{Zone{
+        .points = {{0.05, 0.08}, {0.95, 0.08}, {0.95, 0.92}, {0.05, 0.92}}}};
 
     boost::url saveSourceUrl{""};
     size_t saveImageLimit{200};
+    // retention budgets for this feed, 0 for no limit
+    uintmax_t saveMaxBytes{0};
+    std::chrono::hours saveMaxAge{0};
+    // save the frame that triggered detection instead of saveSourceUrl
+    bool saveDetectionFrame{false};
+    bool saveDrawRois{false};
+    // width of the gallery thumbnail saved with each file, 0 for none
+    int saveThumbnailWidth{320};
+    // save clips of the RTSP stream around motion events
+    bool saveClips{false};
+    std::chrono::seconds clipPreRoll{5};
+    std::chrono::seconds clipPostRoll{5};
 
     [[nodiscard]] static auto ParseJson(const std::filesystem::path &json)
         -> std::unordered_map<std::string, FeedOptions>;
@@ -39,11 +100,22 @@ struct ProgramOptions {
 
   boost::url hassUrl{""};
   std::string hassToken;
+  bool hassHttp2{false};
+  std::chrono::milliseconds hassBatchWindow{0};
+  bool hassWebSocket{false};
+
+  // 0 runs one event loop per core, up to one per feed
+  size_t eventLoopThreads{0};
+  // 0 runs one detector thread per core
+  size_t detectorThreads{0};
 
   std::string webUiHost{"0.0.0.0"};
   int webUiPort{32834};
 
   std::filesystem::path saveDestination;
+  // retention budgets across all feeds, 0 for no limit
+  uintmax_t saveMaxBytes{0};
+  std::chrono::hours saveMaxAge{0};
 
   [[nodiscard]] bool CanSetupHass(const FeedOptions &feedOpts) const;
   [[nodiscard]] bool CanSetupFileSave(const FeedOptions &feedOpts) const;
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include <nlohmann/json_fwd.hpp>
+
+namespace util {
+
+// Rate and timing of a stream of frames over a sliding window of their
+// timestamps. Presentation timestamps are preferred to arrival times, so a
+// burst of late packets shows up as jitter at the receiver rather than as a
+// change in the camera's rate. Added to from one thread and read from any.
+class RateStatistics {
+
+public:
+  using Duration = std::chrono::microseconds;
+
+  struct Summary {
+    size_t samples{0};
+    double fps{0.0};
+    // mean absolute deviation of the gaps between frames from their mean
+    Duration jitter{0};
+    Duration gapP50{0};
+    Duration gapP95{0};
+    Duration gapP99{0};
+    Duration gapMax{0};
+  };
+
+  explicit RateStatistics(Duration window = std::chrono::seconds(10),
+                          size_t maxSamples = 1024);
+  RateStatistics(const RateStatistics &) = delete;
+  RateStatistics(RateStatistics &&) = delete;
+  RateStatistics &operator=(const RateStatistics &) = delete;
+  RateStatistics &operator=(RateStatistics &&) = delete;
+  ~RateStatistics() noexcept = default;
+
+  // A timestamp further back than the window starts over, the stream has
+  // restarted with a new timeline
+  void Add(Duration timeStamp);
+  void Reset();
+
+  // Frames per second over the window, cheap enough for every frame
+  [[nodiscard]] double GetRate() const;
+  [[nodiscard]] Summary GetSummary() const;
+
+  const Duration window;
+  const size_t maxSamples;
+
+private:
+  mutable std::mutex mtx_;
+  // ascending, out of order timestamps are sorted in
+  std::deque<Duration> timeStamps_;
+  mutable std::vector<Duration> gaps_;
+
+  [[nodiscard]] double GetRate_Impl() const;
+};
+
+void to_json(nlohmann::json &j, const RateStatistics::Summary &summary);
+
+} // namespace util
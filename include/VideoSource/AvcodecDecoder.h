@@ -0,0 +1,35 @@
+#pragma once
+
+#include "Decoder.h"
+#include "Logger.h"
+
+#include <vector>
+
+struct AVCodecContext;
+struct AVFrame;
+struct AVPacket;
+
+namespace video_source {
+
+// H.264 and H.265 through libavcodec, with frame and slice threads
+class AvcodecDecoder : public Decoder {
+
+public:
+  AvcodecDecoder(Codec codec, const Options &options);
+  ~AvcodecDecoder() noexcept override;
+
+  void Decode(std::span<const uint8_t> accessUnit, int64_t timeStamp,
+              const PictureCallback &onPicture) override;
+
+private:
+  AVCodecContext *pContext_{nullptr};
+  AVPacket *pPacket_{nullptr};
+  AVFrame *pFrame_{nullptr};
+  // libavcodec reads a little past the end of its input
+  std::vector<uint8_t> padded_;
+  logger::RateLimit errorLimit_{std::chrono::seconds(5)};
+
+  void Release() noexcept;
+};
+
+} // namespace video_source
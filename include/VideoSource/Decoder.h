@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <span>
+#include <string_view>
+
+namespace video_source {
+
+enum class Codec : uint8_t { H264, H265 };
+
+// A decoded picture in planar YUV 4:2:0. The planes belong to the decoder and
+// are only valid until it is called again.
+struct YuvPicture {
+  std::array<uint8_t *, 3> planes{nullptr, nullptr, nullptr};
+  int width{0};
+  int height{0};
+  int strideY{0};
+  int strideUV{0};
+  int64_t timeStamp{0};
+};
+
+// Turns Annex-B access units from the network into pictures. Backends are
+// chosen per stream, OpenH264 for H.264 and libavcodec, when built in, for
+// H.265 or for threaded decoding.
+class Decoder {
+
+public:
+  enum class Backend : uint8_t { Auto, OpenH264, Avcodec };
+
+  struct Options {
+    // decoding threads, 0 lets the backend choose
+    int threads{0};
+    // Cheaper decoding for analysis, skipping the pictures no other picture
+    // refers to and the deblocking filter
+    bool skipNonReference{false};
+    bool skipLoopFilter{false};
+  };
+
+  using PictureCallback = std::function<void(const YuvPicture &)>;
+
+  Decoder() noexcept = default;
+  Decoder(const Decoder &) = delete;
+  Decoder(Decoder &&) = delete;
+  Decoder &operator=(const Decoder &) = delete;
+  Decoder &operator=(Decoder &&) = delete;
+  virtual ~Decoder() noexcept = default;
+
+  // Decodes one access unit, calling onPicture for each picture that comes
+  // out. Threaded backends return pictures a few calls later, each carries
+  // the timeStamp of the unit it was decoded from.
+  virtual void Decode(std::span<const uint8_t> accessUnit, int64_t timeStamp,
+                      const PictureCallback &onPicture) = 0;
+
+  [[nodiscard]] static bool IsAvailable(Backend backend);
+  // Creates a decoder for codec, throws if the backend is not built in or
+  // cannot decode it
+  [[nodiscard]] static std::unique_ptr<Decoder>
+  Create(Backend backend, Codec codec, const Options &options);
+
+  [[nodiscard]] static Backend ParseBackend(std::string_view name);
+};
+
+} // namespace video_source
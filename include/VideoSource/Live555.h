@@ -2,8 +2,13 @@
 
 #include "WindowsWrapper.h"
 
+#include "Decoder.h"
+#include "PreRollBuffer.h"
 #include "VideoSource.h"
 
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <thread>
 
 #include <UsageEnvironment.hh>
@@ -33,12 +38,43 @@ public:
 
   const boost::url &GetUrl() const { return url_; };
 
+  // Receives the compressed stream ahead of the decoder when set
+  std::shared_ptr<PreRollBuffer> pPreRollBuffer;
+  // Without decoding the stream only feeds pPreRollBuffer
+  bool decode{true};
+  Decoder::Backend decoderBackend{Decoder::Backend::Auto};
+  Decoder::Options decoderOptions;
+  // Pictures are scaled down by a whole factor to at most this width as they
+  // leave the decoder, 0 keeps the stream's resolution
+  int maxWidth{0};
+
+  enum class Transport : uint8_t { Udp, Tcp, Auto };
+  [[nodiscard]] static Transport ParseTransport(std::string_view name);
+
+  // RTP over UDP, interleaved on the RTSP connection, or UDP until a session
+  // delivers nothing and TCP from then on
+  Transport transport{Transport::Udp};
+  // OS receive buffer asked for on each RTP socket, 0 keeps the default
+  unsigned socketReceiveBufferSize{2 * 1024 * 1024};
+  // how long a missing packet is waited for before the frame is given up
+  std::chrono::microseconds reorderThreshold{100'000};
+  // The sink buffer starts at frameBufferSize and doubles past the largest
+  // truncated frame up to maxFrameBufferSize, the size is kept for restarts
+  size_t frameBufferSize{1024 * 1024};
+  size_t maxFrameBufferSize{32 * 1024 * 1024};
+
+  [[nodiscard]] bool UsesTcp() const {
+    return transport == Transport::Tcp || fellBackToTcp_;
+  }
+  [[nodiscard]] size_t GetTruncatedFrames() const { return truncatedFrames_; }
+
 private:
-  void SetYUVFrame(uint8_t **pDataYUV, int width, int height, int strideY,
-                   int strideUV, int timestamp);
+  void SetYUVFrame(const YuvPicture &picture, bool synchronized);
   void StopStream_Impl();
 
   unsigned long long maxFrames_{std::numeric_limits<unsigned long long>::max()};
+  std::atomic_size_t truncatedFrames_{0};
+  bool fellBackToTcp_{false};
 
   boost::url url_;
   std::unique_ptr<FrameRtspClient> pRtspClient_;
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+namespace video_source {
+
+// Packs an H.264 Annex-B stream into fragmented MP4 without decoding it. The
+// init segment is produced once the first IDR frame arrives, followed by a
+// moof/mdat fragment per GOP, so a file can be appended to while an event is
+// still being recorded and played back at any point.
+// Frames are assumed to arrive in presentation order, as IP cameras send
+// them without B-frames. Every distinct SPS and PPS goes in the avcC box. A
+// file has a single init segment, so when new ones arrive the output from the
+// next IDR frame on is a new file, see StartNewFile.
+class Mp4Muxer {
+
+public:
+  static constexpr uint32_t timescale{90'000};
+  using Ticks = std::chrono::duration<int64_t, std::ratio<1, timescale>>;
+
+  struct Dimensions {
+    int width{0};
+    int height{0};
+  };
+
+  // Add a NAL unit with its start code, units of one frame share a timestamp
+  void AddNalUnit(std::span<const uint8_t> nalUnit,
+                  std::chrono::microseconds timeStamp);
+  // Close the last frame and write out the open fragment
+  void Flush();
+
+  // Move the muxed data into out, the init segment comes first. With a new
+  // file pending only the rest of the current file is moved.
+  void TakeOutput(std::vector<uint8_t> &out);
+  // True once, after TakeOutput has moved the end of the current file, when
+  // the output from here on is a new file with its own init segment
+  [[nodiscard]] bool StartNewFile();
+
+  [[nodiscard]] bool HasStarted() const { return firstPts_.has_value(); }
+  [[nodiscard]] uint32_t GetFragmentCount() const { return sequence_ - 1; }
+
+  [[nodiscard]] static std::optional<Dimensions>
+  ParseSpsDimensions(std::span<const uint8_t> sps);
+
+  // Start a new fragment after this long even without an IDR frame
+  std::chrono::milliseconds maxFragmentDuration{4000};
+
+private:
+  struct Sample {
+    size_t offset{0};
+    uint32_t size{0};
+    int64_t pts{0};
+    bool keyFrame{false};
+  };
+
+  // distinct parameter sets without start codes, the latest last
+  std::vector<std::vector<uint8_t>> spsSets_;
+  std::vector<std::vector<uint8_t>> ppsSets_;
+  // sets arrived that the last init segment lacks
+  bool initStale_{false};
+  // where the next file starts in output_
+  std::optional<size_t> splitAt_;
+
+  // samples of the open fragment, length prefixed as MP4 requires
+  std::vector<Sample> samples_;
+  std::vector<uint8_t> sampleData_;
+
+  bool frameOpen_{false};
+  Sample frame_;
+
+  std::optional<int64_t> firstPts_;
+  uint64_t decodeTime_{0};
+  uint32_t lastDuration_{timescale / 30};
+  uint32_t sequence_{1};
+
+  bool initWritten_{false};
+  std::vector<uint8_t> output_;
+
+  void AddParameterSet(std::vector<std::vector<uint8_t>> &sets,
+                       std::span<const uint8_t> payload, size_t maxSets);
+  void CloseFrame();
+  void WriteInitSegment();
+  void WriteFragment(std::optional<int64_t> endPts);
+};
+
+} // namespace video_source
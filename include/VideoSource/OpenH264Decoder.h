@@ -0,0 +1,28 @@
+#pragma once
+
+#include "Decoder.h"
+#include "Logger.h"
+
+#include <wels/codec_api.h>
+
+namespace video_source {
+
+// H.264 Constrained Baseline, decoded on the calling thread
+class OpenH264Decoder : public Decoder {
+
+public:
+  explicit OpenH264Decoder(const Options &options);
+  ~OpenH264Decoder() noexcept override;
+
+  void Decode(std::span<const uint8_t> accessUnit, int64_t timeStamp,
+              const PictureCallback &onPicture) override;
+
+private:
+  ISVCDecoder *pSvcDecoder_{nullptr};
+  unsigned char *pDataYUV_[3]{nullptr, nullptr, nullptr};
+  SBufferInfo sDstBufInfo_{};
+  SDecodingParam sDecParam_{};
+  logger::RateLimit errorLimit_{std::chrono::seconds(5)};
+};
+
+} // namespace video_source
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <span>
+#include <vector>
+
+namespace video_source {
+
+// Holds the last few seconds of a feed's H.264 stream as it arrives from the
+// network, before decoding. Units are kept as Annex-B NAL units and evicted a
+// whole GOP at a time, so the buffer always starts on an IDR frame and can be
+// written out as a playable clip without re-encoding.
+class PreRollBuffer {
+
+public:
+  using Clock = std::chrono::steady_clock;
+  using Visitor = std::function<void(std::span<const uint8_t> nalUnit,
+                                     std::chrono::microseconds pts)>;
+
+  PreRollBuffer(std::chrono::milliseconds duration,
+                size_t maxBytes = 16 * 1024 * 1024);
+
+  // Append a NAL unit including its start code, timeStamp is when it arrived
+  // and pts is its presentation time in the stream
+  void Push(std::span<const uint8_t> nalUnit, Clock::time_point timeStamp,
+            std::chrono::microseconds pts = {});
+
+  // Visit the parameter sets and every buffered unit, returns the sequence
+  // number of the last unit visited
+  uint64_t VisitAll(const Visitor &visitor) const;
+  // Visit units pushed after seq, returns the sequence number of the last
+  // unit visited
+  uint64_t VisitSince(uint64_t seq, const Visitor &visitor) const;
+
+  void Clear();
+
+  [[nodiscard]] size_t GetBufferedBytes() const { return bytes_; }
+  [[nodiscard]] size_t GetBufferedUnits() const { return units_.size(); }
+  [[nodiscard]] std::chrono::milliseconds GetBufferedDuration() const;
+  [[nodiscard]] bool HasKeyFrame() const {
+    return !units_.empty() && units_.front().keyFrame;
+  }
+
+  [[nodiscard]] static uint8_t NalType(std::span<const uint8_t> nalUnit);
+  // True for a slice with first_mb_in_slice 0, the first of its picture
+  [[nodiscard]] static bool StartsPicture(std::span<const uint8_t> nalUnit);
+
+  std::chrono::milliseconds duration;
+  size_t maxBytes;
+
+private:
+  struct Unit {
+    std::vector<uint8_t> data;
+    Clock::time_point timeStamp;
+    std::chrono::microseconds pts{0};
+    uint64_t seq{0};
+    bool keyFrame{false};
+  };
+
+  std::deque<Unit> units_;
+  std::vector<std::vector<uint8_t>> spareData_;
+  size_t bytes_{0};
+  uint64_t nextSeq_{1};
+
+  // latest SPS and PPS, a clip needs them even if they were only sent in the
+  // SDP or have already been evicted
+  std::vector<uint8_t> sps_;
+  std::vector<uint8_t> pps_;
+
+  void Evict();
+  void PopFront();
+
+  // Offset of the NAL header after the start code, 0 if there is none
+  static size_t HeaderOffset(std::span<const uint8_t> nalUnit);
+};
+
+} // namespace video_source
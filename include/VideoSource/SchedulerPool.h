@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <UsageEnvironment.hh>
+
+namespace video_source {
+
+// A fixed set of event loops, each with its own scheduler and thread. A feed
+// is assigned to one loop and everything it schedules stays there, so feeds
+// on different loops never share a thread or a per-scheduler object.
+class SchedulerPool {
+
+public:
+  explicit SchedulerPool(size_t size);
+  SchedulerPool(const SchedulerPool &) = delete;
+  SchedulerPool(SchedulerPool &&) = delete;
+  SchedulerPool &operator=(const SchedulerPool &) = delete;
+  SchedulerPool &operator=(SchedulerPool &&) = delete;
+  ~SchedulerPool() noexcept = default;
+
+  // Scheduler for a new feed, the loop that has been least delayed in running
+  // its timers, then the one with the fewest feeds. Call before Run or from
+  // the returned scheduler's own loop.
+  [[nodiscard]] std::shared_ptr<TaskScheduler> Assign();
+
+  [[nodiscard]] std::shared_ptr<TaskScheduler> At(size_t index) const;
+  [[nodiscard]] size_t Size() const { return shards_.size(); }
+  [[nodiscard]] size_t GetFeedCount(size_t index) const;
+  // Smoothed delay of a periodic timer on the loop, a measure of its load
+  [[nodiscard]] std::chrono::microseconds GetLag(size_t index) const;
+
+  // Run every loop until pWatchVar is set, the first on the calling thread
+  void Run(EventLoopWatchVariable *pWatchVar);
+
+  std::chrono::milliseconds lagProbeInterval{500};
+
+private:
+  struct Shard {
+    size_t index{0};
+    SchedulerPool *pPool{nullptr};
+    std::shared_ptr<TaskScheduler> pSched;
+    std::atomic_size_t feeds{0};
+    std::atomic<int64_t> lagUs{0};
+    TaskToken probeToken{nullptr};
+    std::chrono::steady_clock::time_point probeDue;
+  };
+
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  void ScheduleProbe(Shard &shard);
+  static void LagProbeProc(void *shard_clientData);
+};
+
+} // namespace video_source
@@ -6,6 +6,7 @@
 #include <opencv2/core.hpp>
 
 #include <Util/EventHandler.h>
+#include <Util/RateStatistics.h>
 
 namespace video_source {
 
@@ -13,6 +14,27 @@ struct Frame {
   size_t id{0};
   cv::Mat img;
   std::chrono::steady_clock::time_point timeStamp;
+  // in the stream's own timeline, 0 when the source has none
+  std::chrono::microseconds presentationTime{0};
+  // presentationTime is the sender's wall clock, as synchronised by RTCP
+  bool synchronized{false};
+
+  // The presentation time, or the arrival time without one
+  [[nodiscard]] std::chrono::microseconds GetStreamTime() const {
+    return presentationTime.count() != 0
+               ? presentationTime
+               : std::chrono::duration_cast<std::chrono::microseconds>(
+                     timeStamp.time_since_epoch());
+  }
+
+  // When the camera captured the frame, or the epoch when that is not known
+  [[nodiscard]] std::chrono::system_clock::time_point GetCaptureTime() const {
+    return synchronized ? std::chrono::system_clock::time_point(
+                              std::chrono::duration_cast<
+                                  std::chrono::system_clock::duration>(
+                                  presentationTime))
+                        : std::chrono::system_clock::time_point{};
+  }
 };
 
 class VideoSource : public util::EventHandler<Frame> {
@@ -31,16 +53,18 @@ public:
   [[nodiscard]] double GetFramesPerSecond() const;
   [[nodiscard]] unsigned long long GetFrameCount() const { return frameCount_; }
 
-  double fpsAlpha{0.1};
   bool fullColor{false};
 
+  // Compressed frames received, for sources that decode
+  util::RateStatistics inputRate;
+  util::RateStatistics decodedRate;
+
 protected:
   void SetFrame(Frame frame);
 
 private:
   unsigned long long frameCount_{0};
   Frame frame_;
-  double fps_{0.0};
 };
 
 } // namespace video_source
@@ -6,18 +6,25 @@
 #include "Util/BufferOperations.h"
 #include "Util/Tools.h"
 
-#include <ranges>
+#include <atomic>
+#include <fstream>
+#include <span>
+#include <utility>
 
-#if __linux__
-#include <errno.h>
-#include <fcntl.h>
-#include <signal.h>
-#include <string.h>
-#define IO_SIGNAL SIGUSR1
-#endif
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
 
 namespace {
-static size_t contextId{1};
+// shared by the handlers on every event loop
+static std::atomic_size_t contextId{1};
+
+cv::Rect BoundingRect(std::span<const cv::Rect> rois) {
+  cv::Rect bounds;
+  for (const auto &roi : rois) {
+    bounds = bounds.empty() ? roi : (bounds | roi);
+  }
+  return bounds;
+}
 
 #if _WIN32
 std::string GetErrorMessage(DWORD dwErrorCode) {
@@ -42,13 +49,6 @@ void LogLastError() {
   LOGGER->error("Win32 Error ({}): {}", error, GetErrorMessage(error));
 }
 
-#elif __linux__
-
-void LogLastError() {
-  const auto error = errno;
-  LOGGER->error("Linux Error ({}): {}", error, strerror(error));
-}
-
 #endif
 
 } // namespace
@@ -59,8 +59,12 @@ AsyncFileSave::AsyncFileSave(std::shared_ptr<TaskScheduler> pSched,
                              const std::filesystem::path &dstPath,
                              const boost::url &url, const std::string &user,
                              const std::string &password)
-    : AsyncDebouncer(pSched), pSched_{pSched}, dstPath_{dstPath}, url_{url},
-      user_{user}, password_{password} {
+    : AsyncDebouncer(pSched), pSched_{pSched},
+      pReactor_{CurlMultiReactor::ForScheduler(pSched)},
+#if __linux__
+      pWriter_{UringFileWriter::ForScheduler(pSched)},
+#endif
+      dstPath_{dstPath}, url_{url}, user_{user}, password_{password} {
   if (!std::filesystem::exists(dstPath_)) {
     std::filesystem::create_directories(dstPath_);
   }
@@ -69,34 +73,23 @@ AsyncFileSave::AsyncFileSave(std::shared_ptr<TaskScheduler> pSched,
 }
 
 AsyncFileSave::~AsyncFileSave() noexcept {
-  for (const auto &socketCtx : socketCtxs_ | std::views::values) {
-    pSched_->disableBackgroundHandling(socketCtx->sockfd);
-    wCurlMulti_(curl_multi_assign, socketCtx->sockfd, nullptr);
+  encoderThread_ = {};
+  if (framesEncodedTrigger_ != 0) {
+    pSched_->deleteEventTrigger(framesEncodedTrigger_);
   }
 }
 
-void AsyncFileSave::Register() {
-  wCurlMulti_(curl_multi_setopt, CURLMOPT_SOCKETFUNCTION, SocketCallback);
-  wCurlMulti_(curl_multi_setopt, CURLMOPT_SOCKETDATA, this);
-  wCurlMulti_(curl_multi_setopt, CURLMOPT_TIMERFUNCTION, TimeoutCallback);
-  wCurlMulti_(curl_multi_setopt, CURLMOPT_TIMERDATA, this);
-
-  int runningHandles{0};
-  wCurlMulti_(curl_multi_socket_action, CURL_SOCKET_TIMEOUT, 0,
-              &runningHandles);
-
-#ifdef __linux__
-  InstallHandlers();
-#endif
-}
-
-void AsyncFileSave::SaveFileAtEndpoint(const std::filesystem::path &_dst) {
+void AsyncFileSave::Register() {}
 
+std::filesystem::path
+AsyncFileSave::ResolveDstPath(const std::filesystem::path &_dst,
+                              std::string_view extension) const {
   // format a filename based on the current time
   auto dst = dstPath_;
   if (std::filesystem::is_directory(dstPath_) && _dst.empty()) {
     const auto now = std::chrono::system_clock::now();
-    const auto fileName = std::format("{:%Y-%m-%d_%H-%M-%S}.jpg", now);
+    const auto fileName =
+        std::format("{:%Y-%m-%d_%H-%M-%S}{}", now, extension);
     dst /= fileName;
   } else if (!_dst.has_parent_path()) {
     // if the path is not absolute, append it to the download directory
@@ -105,6 +98,12 @@ void AsyncFileSave::SaveFileAtEndpoint(const std::filesystem::path &_dst) {
     // if the path is absolute, use it as is
     dst = _dst;
   }
+  return dst;
+}
+
+void AsyncFileSave::SaveFileAtEndpoint(const std::filesystem::path &_dst) {
+
+  auto dst = ResolveDstPath(_dst);
 
   auto pCtx = std::make_shared<_CurlEasyContext>();
 
@@ -117,27 +116,15 @@ void AsyncFileSave::SaveFileAtEndpoint(const std::filesystem::path &_dst) {
     pCtx->writeData.overlapped.Offset = 0xFFFFFFFF;
     pCtx->writeData.overlapped.OffsetHigh = 0xFFFFFFFF;
     pCtx->writeData.overlapped.hEvent = static_cast<HANDLE>(pCtx.get());
-#elif __linux__
-    pCtx->writeData._aiocb.aio_fildes = open(
-        dst.string().c_str(), O_CREAT | O_WRONLY | O_ASYNC | O_TRUNC, 0666);
-    if (pCtx->writeData._aiocb.aio_fildes == -1) {
-      throw std::runtime_error(strerror(errno));
-    }
-    pCtx->writeData._aiocb.aio_reqprio = 0;
-    pCtx->writeData._aiocb.aio_offset = 0;
-    pCtx->writeData._aiocb.aio_sigevent.sigev_notify = SIGEV_SIGNAL;
-    pCtx->writeData._aiocb.aio_sigevent.sigev_signo = IO_SIGNAL;
-    pCtx->writeData._aiocb.aio_sigevent.sigev_value.sival_ptr = pCtx.get();
 #endif
     pCtx->writeData.dstPath = std::move(dst);
     pCtx->writeData.buf = std::move(spareBuf_);
     pCtx->writeData.buf.clear();
     pCtx->pHandler = this->weak_from_this();
-    pCtx->contextId = contextId;
+    pCtx->contextId = contextId++;
 
     pCtx->wCurl(curl_easy_setopt, CURLOPT_WRITEFUNCTION,
                 util::FillBufferCallback);
-    pCtx->wCurl(curl_easy_setopt, CURLOPT_PRIVATE, contextId);
 
     pCtx->wCurl(curl_easy_setopt, CURLOPT_URL, url_.c_str());
     pCtx->wCurl(curl_easy_setopt, CURLOPT_HTTPGET, 1L);
@@ -149,11 +136,17 @@ void AsyncFileSave::SaveFileAtEndpoint(const std::filesystem::path &_dst) {
       pCtx->wCurl(curl_easy_setopt, CURLOPT_PASSWORD, password_.c_str());
     }
 
-    wCurlMulti_(curl_multi_add_handle, pCtx->wCurl.pCurl_);
-    pCtx->wCurl(curl_easy_setopt, CURLOPT_PRIVATE, contextId);
+    auto pWCurl = std::shared_ptr<util::CurlWrapper>(pCtx, &pCtx->wCurl);
+    pReactor_->Submit(std::move(pWCurl), [wpThis = weak_from_this(),
+                                          pCtx](CURLcode result) mutable {
+      if (auto pThis = wpThis.lock()) {
+        --pThis->pendingRequests_;
+        pThis->OnTransferDone(std::move(pCtx), result);
+      }
+    });
+    ++pendingRequests_;
 
-    easyCtxs_[contextId] = pCtx;
-    ++contextId;
+    easyCtxs_[pCtx->contextId] = pCtx;
   } catch (const std::exception &e) {
     LOGGER->error(e.what());
   } catch (...) {
@@ -163,12 +156,19 @@ void AsyncFileSave::SaveFileAtEndpoint(const std::filesystem::path &_dst) {
 
 void AsyncFileSave::operator()(detector::Payload data) {
 
-  static decltype(data.rois) lastRois = {};
+  const bool risingEdge = !hadMotion_ && !data.rois.empty();
+  hadMotion_ = !data.rois.empty();
 
-  const bool risingEdge = lastRois.empty() && !data.rois.empty();
+  if (pPreRoll_) {
+    UpdateClip(data);
+  }
 
   if (UpdateAllowed() && risingEdge) {
-    SaveFileAtEndpoint();
+    if (saveDetectionFrame) {
+      SaveFrame(data);
+    } else if (!url_.empty()) {
+      SaveFileAtEndpoint();
+    }
     Debounce(debounceTime);
   }
 
@@ -178,196 +178,490 @@ void AsyncFileSave::operator()(detector::Payload data) {
   }
 }
 
-const boost::circular_buffer<std::filesystem::path> &
-AsyncFileSave::GetSavedFilePaths() const {
-  return savedFilePaths_;
+void AsyncFileSave::SaveFrame(const detector::Payload &data,
+                              const std::filesystem::path &dst) {
+  if (data.frame.img.empty()) {
+    LOGGER->warn("No frame to save for {}", dstPath_);
+    return;
+  }
+
+  std::shared_ptr<FrameJob> pJob;
+  if (spareFrameJobs_.empty()) {
+    pJob = std::make_shared<FrameJob>();
+  } else {
+    pJob = std::move(spareFrameJobs_.back());
+    spareFrameJobs_.pop_back();
+  }
+  // the frame may point into decoder memory that is reused for the next frame
+  data.frame.img.copyTo(pJob->img);
+  pJob->rois.assign(data.rois.begin(), data.rois.end());
+  pJob->dstPath = ResolveDstPath(dst);
+  pJob->timeStamp = std::chrono::system_clock::now();
+  pJob->captureTime = data.frame.GetCaptureTime();
+  pJob->thumbnail.clear();
+  pJob->thumbnailOnly = false;
+  pJob->thumbnailSrc.clear();
+  pJob->ok = false;
+
+  QueueFrameJob(std::move(pJob));
 }
 
-void AsyncFileSave::SetLimitSavedFilePaths(size_t limit) {
-  while (savedFilePaths_.size() > limit) {
-    if (!std::filesystem::remove(savedFilePaths_.front())) {
-      LOGGER->warn("Failed to remove file: {}", savedFilePaths_.front());
-    } else {
-      LOGGER->info("Removed file: {}", savedFilePaths_.front());
+void AsyncFileSave::QueueThumbnail(const cv::Mat &img,
+                                   const std::filesystem::path &mediaPath) {
+  auto pJob = std::make_shared<FrameJob>();
+  if (img.empty()) {
+    pJob->thumbnailSrc = mediaPath;
+  } else {
+    img.copyTo(pJob->img);
+  }
+  pJob->thumbnailOnly = true;
+  pJob->dstPath = mediaPath;
+  QueueFrameJob(std::move(pJob));
+}
+
+void AsyncFileSave::WriteThumbnail(const std::filesystem::path &mediaPath,
+                                   std::vector<uchar> &thumbnail) {
+  if (!thumbnailDirCreated_) {
+    std::error_code ec;
+    std::filesystem::create_directories(
+        dstPath_ / util::MediaCatalog::thumbnailDirName, ec);
+    thumbnailDirCreated_ = !ec;
+  }
+  auto pJob = std::make_shared<FrameJob>();
+  pJob->encoded.swap(thumbnail);
+  pJob->dstPath = util::MediaCatalog::ThumbnailPath(mediaPath);
+  // a thumbnail is not a saved file of its own
+  pJob->onWritten = [](bool) {};
+  WriteEncoded(std::move(pJob));
+}
+
+bool AsyncFileSave::EncodeThumbnail(const cv::Mat &img,
+                                    std::vector<uchar> &thumbnail) const {
+  if (img.empty()) {
+    return false;
+  }
+  thread_local cv::Mat small;
+  const cv::Mat *pSrc = &img;
+  if (img.cols > thumbnailWidth) {
+    const double scale = double(thumbnailWidth) / img.cols;
+    cv::resize(img, small, {}, scale, scale, cv::INTER_AREA);
+    pSrc = &small;
+  }
+  return cv::imencode(".jpg", *pSrc, thumbnail,
+                      {cv::IMWRITE_JPEG_QUALITY, thumbnailQuality});
+}
+
+void AsyncFileSave::SetPreRollBuffer(
+    std::shared_ptr<video_source::PreRollBuffer> pPreRoll) {
+  pPreRoll_ = std::move(pPreRoll);
+  pClip_.reset();
+}
+
+void AsyncFileSave::UpdateClip(const detector::Payload &data) {
+  const bool motion = !data.rois.empty();
+  const auto mux = [this](std::span<const uint8_t> nalUnit,
+                          std::chrono::microseconds pts) {
+    pClip_->muxer.AddNalUnit(nalUnit, pts);
+  };
+
+  if (!pClip_) {
+    // a clip has to start on an IDR frame to be playable
+    if (motion && pPreRoll_->HasKeyFrame()) {
+      pClip_ = std::make_shared<Clip>();
+      pClip_->roiCount = uint32_t(data.rois.size());
+      pClip_->roiBounds = BoundingRect(data.rois);
+      pClip_->dstPath = ResolveDstPath({}, ".mp4");
+      pClip_->startTime = std::chrono::system_clock::now();
+      pClip_->captureTime = data.frame.GetCaptureTime();
+      clipSeq_ = pPreRoll_->VisitAll(mux);
+      clipLastMotion_ = data.frame.timeStamp;
+      LOGGER->info("Recording clip {} with {}ms of pre-roll", pClip_->dstPath,
+                   pPreRoll_->GetBufferedDuration().count());
+      if (thumbnailWidth > 0) {
+        QueueThumbnail(data.frame.img, pClip_->dstPath);
+      }
+      QueueClipFragments(data);
     }
-    savedFilePaths_.pop_front();
+    return;
+  }
+
+  clipSeq_ = pPreRoll_->VisitSince(clipSeq_, mux);
+  QueueClipFragments(data);
+  if (motion) {
+    clipLastMotion_ = data.frame.timeStamp;
+    pClip_->roiCount = std::max(pClip_->roiCount, uint32_t(data.rois.size()));
+    const auto bounds = BoundingRect(data.rois);
+    pClip_->roiBounds =
+        pClip_->roiBounds.empty() ? bounds : (pClip_->roiBounds | bounds);
+  }
+  // an empty frame means the source went down
+  if (data.frame.img.empty() ||
+      data.frame.timeStamp - clipLastMotion_ >= clipPostRoll ||
+      pClip_->bytes >= maxClipBytes) {
+    FinishClip(data);
   }
-  savedFilePaths_.set_capacity(limit);
 }
 
-#if _WIN32
+void AsyncFileSave::QueueClipFragments(const detector::Payload &data) {
+  // fragments are only cut at keyframes, most frames add nothing
+  pClip_->muxer.TakeOutput(clipOutput_);
+  if (!clipOutput_.empty()) {
+    auto pJob = std::make_shared<FrameJob>();
+    pJob->encoded.swap(clipOutput_);
+    pClip_->bytes += pJob->encoded.size();
+    pClip_->fragments.push_back(std::move(pJob));
+    WriteNextFragment(pClip_);
+  }
+  if (pClip_->muxer.StartNewFile()) {
+    SplitClip(data);
+    QueueClipFragments(data);
+  }
+}
 
-AsyncFileSave::Win32Overlapped::~Win32Overlapped() noexcept {
-  if (hFile != INVALID_HANDLE_VALUE && !CloseHandle(hFile)) {
-    const auto error = GetLastError();
-    LOGGER->error("Failed to close {} with error ({}): {}", dstPath, error,
-                  GetErrorMessage(error));
+void AsyncFileSave::SplitClip(const detector::Payload &data) {
+  // a file has one init segment, so the muxer carries on into a new clip
+  // that starts with the new parameter sets
+  auto pNext = std::make_shared<Clip>();
+  pNext->muxer = std::move(pClip_->muxer);
+  pNext->roiCount = pClip_->roiCount;
+  pNext->roiBounds = pClip_->roiBounds;
+  pNext->dstPath = ResolveDstPath({}, ".mp4");
+  pNext->startTime = std::chrono::system_clock::now();
+  pNext->captureTime = data.frame.GetCaptureTime();
+  LOGGER->info("Stream parameters changed, continuing clip {} in {}",
+               pClip_->dstPath, pNext->dstPath);
+
+  pClip_->finished = true;
+  WriteNextFragment(std::exchange(pClip_, std::move(pNext)));
+  if (thumbnailWidth > 0) {
+    QueueThumbnail(data.frame.img, pClip_->dstPath);
   }
 }
 
-#elif __linux__
+void AsyncFileSave::FinishClip(const detector::Payload &data) {
+  pClip_->muxer.Flush();
+  QueueClipFragments(data);
+  pClip_->finished = true;
+  WriteNextFragment(std::move(pClip_));
+  pClip_.reset();
+}
 
-AsyncFileSave::LinuxAioFile::~LinuxAioFile() {
-  if (close(_aiocb.aio_fildes) == -1) {
-    LOGGER->error("Failed to close {} with error ({}): {}", dstPath, errno,
-                  strerror(errno));
+void AsyncFileSave::WriteNextFragment(std::shared_ptr<Clip> pClip) {
+  if (pClip->writing) {
+    return;
   }
+  if (pClip->failed) {
+    pClip->fragments.clear();
+  }
+  if (pClip->fragments.empty()) {
+    if (pClip->finished && pClip->created) {
+      if (pClip->failed) {
+        std::error_code ec;
+        std::filesystem::remove(pClip->dstPath, ec);
+      } else {
+        LOGGER->info("Saved clip {} ({} bytes)", pClip->dstPath, pClip->bytes);
+        RecordSavedFile(pClip->dstPath, pClip->startTime, pClip->roiCount,
+                        pClip->roiBounds, pClip->captureTime);
+      }
+    }
+    return;
+  }
+
+  // fragments are appended one at a time to keep them in order
+  auto pJob = std::move(pClip->fragments.front());
+  pClip->fragments.pop_front();
+  pJob->dstPath = pClip->dstPath;
+  pJob->append = pClip->created;
+  pJob->onWritten = [this, pClip](bool ok) {
+    pClip->writing = false;
+    pClip->failed |= !ok;
+    WriteNextFragment(pClip);
+  };
+  pClip->created = true;
+  pClip->writing = true;
+  WriteEncoded(std::move(pJob));
 }
 
+void AsyncFileSave::WriteEncoded(std::shared_ptr<FrameJob> pJob) {
+  pJob->ok = true;
+#if __linux__
+  ++pendingFrames_;
+  OnFrameEncoded(std::move(pJob));
+#else
+  // only the worker writes files here
+  QueueFrameJob(std::move(pJob));
 #endif
+}
 
-void AsyncFileSave::CheckMultiInfo() {
-  CURLMsg *message{nullptr};
-
-  int pending{0};
-
-  auto &wCurlMulti = wCurlMulti_;
-  while ((message = curl_multi_info_read(wCurlMulti.pCurl_, &pending))) {
-    switch (message->msg) {
-    case CURLMSG_DONE: {
-      size_t ctxId{0};
-      CURL *easy = message->easy_handle;
-
-      curl_easy_getinfo(easy, CURLINFO_PRIVATE, &ctxId);
-      auto it = easyCtxs_.find(ctxId);
-      if (it != easyCtxs_.end()) {
-        auto &pCtx = it->second;
-        try {
-          char *effectiveMethod{nullptr};
-          curl_easy_getinfo(easy, CURLINFO_EFFECTIVE_METHOD, &effectiveMethod);
-          int responseCode{0};
-          curl_easy_getinfo(easy, CURLINFO_RESPONSE_CODE, &responseCode);
-
-          switch (responseCode) {
-          case 200:
-          case 201:
-            if (util::NoCaseCmp(effectiveMethod, "GET")) {
-#if _WIN32
-              const auto res = WriteFileEx(
-                  pCtx->writeData.hFile, pCtx->writeData.buf.data(),
-                  pCtx->writeData.buf.size(), &pCtx->writeData.overlapped,
-                  AsyncFileSave::FileIOCompletionRoutine);
-              if (res == ERROR) {
-                LogLastError();
-                std::filesystem::remove(pCtx->writeData.dstPath);
-              }
-#elif __linux__
-              pCtx->writeData._aiocb.aio_buf = pCtx->writeData.buf.data();
-              pCtx->writeData._aiocb.aio_nbytes = pCtx->writeData.buf.size();
-              const auto res = aio_write(&pCtx->writeData._aiocb);
-              if (res == -1) {
-                LogLastError();
-                std::filesystem::remove(pCtx->writeData.dstPath);
-              }
+void AsyncFileSave::QueueFrameJob(std::shared_ptr<FrameJob> pJob) {
+  if (framesEncodedTrigger_ == 0) {
+    framesEncodedTrigger_ =
+        pSched_->createEventTrigger(AsyncFileSave::FramesEncodedProc);
+  }
+  if (!encoderThread_.joinable()) {
+    encoderThread_ = std::jthread(
+        [this](std::stop_token stopToken) { EncodeFrames(stopToken); });
+  }
+
+  {
+    std::scoped_lock lk(frameMtx_);
+    framesToEncode_.push_back(std::move(pJob));
+  }
+  ++pendingFrames_;
+  frameCv_.notify_one();
+}
+
+void AsyncFileSave::EncodeFrames(std::stop_token stopToken) {
+#ifdef _WIN32
+  SetThreadDescription(GetCurrentThread(), L"Motion Frame Encoder Thread");
 #endif
-            }
-            break;
-          default:
-            LOGGER->info("CURL Request failed with response code {}",
-                         responseCode);
-            std::filesystem::remove(pCtx->writeData.dstPath);
-            wCurlMulti(curl_multi_remove_handle, pCtx->wCurl.pCurl_);
-            RemoveContext(pCtx.get());
-            return;
+  const std::vector<int> params{cv::IMWRITE_JPEG_QUALITY, jpegQuality};
+
+  std::unique_lock lk(frameMtx_);
+  while (frameCv_.wait(lk, stopToken,
+                       [this] { return !framesToEncode_.empty(); })) {
+    auto pJob = std::move(framesToEncode_.front());
+    framesToEncode_.pop_front();
+    lk.unlock();
+
+    try {
+      if (pJob->thumbnailOnly) {
+        if (pJob->img.empty()) {
+          // libjpeg scales while decoding, the full image is never decoded
+          pJob->img = cv::imread(pJob->thumbnailSrc.string(),
+                                 cv::IMREAD_REDUCED_COLOR_4);
+        }
+        pJob->ok = EncodeThumbnail(pJob->img, pJob->thumbnail);
+      } else if (!pJob->img.empty()) {
+        if (drawRois) {
+          const auto color = pJob->img.channels() == 1
+                                 ? cv::Scalar(0xFF)
+                                 : cv::Scalar(0, 0xFF, 0);
+          for (const auto &roi : pJob->rois) {
+            cv::rectangle(pJob->img, roi, color, 2);
           }
-        } catch (const std::exception &e) {
-          LOGGER->error(e.what());
         }
-
-        // cleanup
-        wCurlMulti(curl_multi_remove_handle, pCtx->wCurl.pCurl_);
+        pJob->ok = cv::imencode(".jpg", pJob->img, pJob->encoded, params);
+        if (pJob->ok && thumbnailWidth > 0 &&
+            !EncodeThumbnail(pJob->img, pJob->thumbnail)) {
+          pJob->thumbnail.clear();
+        }
       }
-      break;
-    }
-    default:
-      LOGGER->warn("CURLMSG default");
-      break;
+#if _WIN32
+      // no overlapped writer for these, the worker can afford to block
+      if (pJob->ok && !pJob->thumbnailOnly) {
+        std::ofstream ofs(pJob->dstPath, pJob->append
+                                             ? std::ios::binary | std::ios::app
+                                             : std::ios::binary);
+        ofs.write(reinterpret_cast<const char *>(pJob->encoded.data()),
+                  pJob->encoded.size());
+        pJob->ok = bool(ofs);
+      }
+#endif
+    } catch (const std::exception &e) {
+      LOGGER->error("Failed to encode {}: {}", pJob->dstPath, e.what());
+      pJob->ok = false;
     }
+
+    lk.lock();
+    framesEncoded_.push_back(std::move(pJob));
+    pSched_->triggerEvent(framesEncodedTrigger_, this);
   }
 }
 
-int AsyncFileSave::SocketCallback(CURL *easy, curl_socket_t s, int action,
-                                  AsyncFileSave *asyncFileSave,
-                                  _CurlSocketContext *curlSocketContext) {
-  if (auto pAfs = asyncFileSave->weak_from_this().lock()) {
-    std::shared_ptr<_CurlSocketContext> pCtx;
-    if (curlSocketContext) {
-      pCtx = static_cast<_CurlSocketContext *>(curlSocketContext)
-                 ->shared_from_this();
-    };
-    switch (action) {
-    case CURL_POLL_IN:
-    case CURL_POLL_OUT:
-    case CURL_POLL_INOUT: {
-      if (!pCtx) {
-        pCtx = std::make_shared<_CurlSocketContext>();
-        pCtx->sockfd = s;
-        pCtx->pHandler = pAfs;
-        pAfs->socketCtxs_[s] = pCtx; // save to the map for pointer preservation
-      }
-
-      pAfs->wCurlMulti_(curl_multi_assign, s, pCtx.get());
-
-      int flags{0};
-      flags |= (action != CURL_POLL_IN) ? SOCKET_WRITABLE : 0;
-      flags |= (action != CURL_POLL_OUT) ? SOCKET_READABLE : 0;
-      pAfs->pSched_->setBackgroundHandling(
-          s, flags, AsyncFileSave::BackgroundHandlerProc, pCtx.get());
-    } break;
-    case CURL_POLL_REMOVE:
-      pAfs->pSched_->disableBackgroundHandling(s);
-      pAfs->wCurlMulti_(curl_multi_assign, s, nullptr);
-      pAfs->socketCtxs_.erase(s);
-      break;
+void AsyncFileSave::FramesEncodedProc(void *asyncFileSave_clientData) {
+  if (asyncFileSave_clientData) {
+    auto *pThis = static_cast<AsyncFileSave *>(asyncFileSave_clientData);
+    std::deque<std::shared_ptr<FrameJob>> encoded;
+    {
+      std::scoped_lock lk(pThis->frameMtx_);
+      encoded.swap(pThis->framesEncoded_);
+    }
+    for (auto &pJob : encoded) {
+      pThis->OnFrameEncoded(std::move(pJob));
     }
   }
-  return 0;
 }
 
-int AsyncFileSave::TimeoutCallback(CURLM *multi, int timeoutMs,
-                                   AsyncFileSave *asyncFileSave) {
-  if (asyncFileSave) {
-    if (timeoutMs < 0) {
-      asyncFileSave->pSched_->unscheduleDelayedTask(asyncFileSave->token_);
-    } else {
-      if (timeoutMs == 0) {
-        timeoutMs = 1;
+void AsyncFileSave::OnFrameEncoded(std::shared_ptr<FrameJob> pJob) {
+  if (pJob->thumbnailOnly) {
+    --pendingFrames_;
+    if (pJob->ok) {
+      WriteThumbnail(pJob->dstPath, pJob->thumbnail);
+    }
+    return;
+  }
+#if __linux__
+  if (pJob->ok) {
+    const std::span<const char> data(
+        reinterpret_cast<const char *>(pJob->encoded.data()),
+        pJob->encoded.size());
+    auto onDone = [wpThis = weak_from_this(), pJob](int result) {
+      if (auto pThis = wpThis.lock()) {
+        pThis->FinishFrame(pJob, result >= 0);
       }
-      asyncFileSave->token_ = asyncFileSave->pSched_->scheduleDelayedTask(
-          timeoutMs * 1000, AsyncFileSave::TimeoutHandlerProc, asyncFileSave);
+    };
+    if (pJob->append) {
+      pWriter_->AppendFile(pJob->dstPath, data, std::move(onDone));
+    } else {
+      pWriter_->WriteFile(pJob->dstPath, data, std::move(onDone));
     }
+    return;
   }
-  return 0;
+#endif
+  const bool ok = pJob->ok;
+  FinishFrame(std::move(pJob), ok);
 }
 
-void AsyncFileSave::BackgroundHandlerProc(void *curlSocketContext_clientData,
-                                          int mask) {
-  if (curlSocketContext_clientData) {
-    int flags{0};
-    if (mask & SOCKET_READABLE) {
-      flags |= CURL_CSELECT_IN;
-    }
-    if (mask & SOCKET_WRITABLE) {
-      flags |= CURL_CSELECT_OUT;
-    }
-    auto csc = static_cast<_CurlSocketContext *>(curlSocketContext_clientData)
-                   ->shared_from_this();
-    if (auto pAfs = csc->pHandler.lock()) {
-      int runningHandles{0};
-      pAfs->wCurlMulti_(curl_multi_socket_action, csc->sockfd, flags,
-                        &runningHandles);
-      pAfs->CheckMultiInfo();
+void AsyncFileSave::FinishFrame(std::shared_ptr<FrameJob> pJob, bool ok) {
+  --pendingFrames_;
+  if (pJob->onWritten) {
+    std::exchange(pJob->onWritten, nullptr)(ok);
+    return;
+  }
+  if (ok) {
+    LOGGER->info("File IO complete {}", pJob->dstPath);
+    RecordSavedFile(pJob->dstPath, pJob->timeStamp,
+                    uint32_t(pJob->rois.size()), BoundingRect(pJob->rois),
+                    pJob->captureTime);
+    if (!pJob->thumbnail.empty()) {
+      WriteThumbnail(pJob->dstPath, pJob->thumbnail);
     }
+  } else {
+    std::error_code ec;
+    std::filesystem::remove(pJob->dstPath, ec);
+  }
+  if (spareFrameJobs_.size() < maxSpareFrameJobs) {
+    spareFrameJobs_.push_back(std::move(pJob));
   }
 }
 
-void AsyncFileSave::TimeoutHandlerProc(void *asyncFileSave_clientData) {
-  if (asyncFileSave_clientData) {
-    auto pAfs = static_cast<AsyncFileSave *>(asyncFileSave_clientData);
-    int runningHandles{-1};
-    pAfs->wCurlMulti_(curl_multi_socket_action, CURL_SOCKET_TIMEOUT, 0,
-                      &runningHandles);
-    pAfs->CheckMultiInfo();
+const boost::circular_buffer<std::filesystem::path> &
+AsyncFileSave::GetSavedFilePaths() const {
+  return savedFilePaths_;
+}
+
+void AsyncFileSave::SetLimitSavedFilePaths(size_t limit) {
+  if (pRetention_) {
+    savedFilePaths_.rset_capacity(limit);
+    return;
+  }
+  while (savedFilePaths_.size() > limit) {
+    RemoveOldestSavedFile();
+  }
+  savedFilePaths_.set_capacity(limit);
+}
+
+void AsyncFileSave::SetCatalog(std::shared_ptr<util::MediaCatalog> pCatalog) {
+  pCatalog_ = std::move(pCatalog);
+  if (!pCatalog_) {
+    return;
+  }
+  // files saved by earlier runs count against the limit, oldest go first
+  savedFilePaths_.clear();
+  for (const auto &entry : pCatalog_->GetEntries()) {
+    TrackSavedFile(pCatalog_->GetDirectory() / entry.path);
+  }
+}
+
+void AsyncFileSave::SetRetentionManager(
+    std::shared_ptr<RetentionManager> pRetention) {
+  pRetention_ = std::move(pRetention);
+}
+
+void AsyncFileSave::TrackSavedFile(const std::filesystem::path &path) {
+  // with a retention manager this only remembers the most recent files
+  if (savedFilePaths_.full() && !pRetention_) {
+    RemoveOldestSavedFile();
+  }
+  savedFilePaths_.push_back(path);
+}
+
+void AsyncFileSave::RemoveOldestSavedFile() {
+  const auto &oldFile = savedFilePaths_.front();
+  std::error_code ec;
+  if (std::filesystem::remove(oldFile, ec)) {
+    LOGGER->info("Removed {}, maximum saved files reached ({})", oldFile,
+                 savedFilePaths_.capacity());
+  } else {
+    LOGGER->warn("Failed to remove {}, maximum saved files reached ({}), "
+                 "but old data has not been deleted, the disk may begin to "
+                 "fill",
+                 oldFile, savedFilePaths_.capacity());
+  }
+  std::filesystem::remove(util::MediaCatalog::ThumbnailPath(oldFile), ec);
+  if (pCatalog_) {
+    pCatalog_->Remove(oldFile.lexically_relative(pCatalog_->GetDirectory()));
+  }
+  savedFilePaths_.pop_front();
+}
+
+#if _WIN32
+
+AsyncFileSave::Win32Overlapped::~Win32Overlapped() noexcept {
+  if (hFile != INVALID_HANDLE_VALUE && !CloseHandle(hFile)) {
+    const auto error = GetLastError();
+    LOGGER->error("Failed to close {} with error ({}): {}", dstPath, error,
+                  GetErrorMessage(error));
+  }
+}
+
+#endif
+
+void AsyncFileSave::OnTransferDone(std::shared_ptr<_CurlEasyContext> pCtx,
+                                   CURLcode result) {
+  try {
+    if (result != CURLE_OK) {
+      LOGGER->info("CURL Request failed: {}", curl_easy_strerror(result));
+      std::filesystem::remove(pCtx->writeData.dstPath);
+      RemoveContext(pCtx.get());
+      return;
+    }
+
+    char *effectiveMethod{nullptr};
+    pCtx->wCurl(curl_easy_getinfo, CURLINFO_EFFECTIVE_METHOD,
+                &effectiveMethod);
+    int responseCode{0};
+    pCtx->wCurl(curl_easy_getinfo, CURLINFO_RESPONSE_CODE, &responseCode);
+
+    switch (responseCode) {
+    case 200:
+    case 201:
+      if (util::NoCaseCmp(effectiveMethod, "GET")) {
+#if _WIN32
+        const auto res = WriteFileEx(
+            pCtx->writeData.hFile, pCtx->writeData.buf.data(),
+            pCtx->writeData.buf.size(), &pCtx->writeData.overlapped,
+            AsyncFileSave::FileIOCompletionRoutine);
+        if (res == ERROR) {
+          LogLastError();
+          std::filesystem::remove(pCtx->writeData.dstPath);
+        }
+#elif __linux__
+        // the file is created by the write chain, the context keeps the
+        // buffer alive until it completes
+        const std::span<const char> data = pCtx->writeData.buf;
+        pWriter_->WriteFile(
+            pCtx->writeData.dstPath, data, [pCtx](int result) {
+              if (result < 0) {
+                std::error_code ec;
+                std::filesystem::remove(pCtx->writeData.dstPath, ec);
+              } else {
+                LOGGER->info("File IO complete {}", pCtx->writeData.dstPath);
+              }
+              RemoveContext(pCtx.get());
+            });
+#endif
+      }
+      break;
+    default:
+      LOGGER->info("CURL Request failed with response code {}", responseCode);
+      std::filesystem::remove(pCtx->writeData.dstPath);
+      RemoveContext(pCtx.get());
+      return;
+    }
+  } catch (const std::exception &e) {
+    LOGGER->error(e.what());
   }
 }
 
@@ -390,69 +684,43 @@ VOID CALLBACK AsyncFileSave::FileIOCompletionRoutine(
   }
 }
 
-#elif __linux__
+#endif
 
-void AsyncFileSave::AioSigHandler(int sig, siginfo_t *si, void *) {
-  if (si->si_code == SI_ASYNCIO) {
-    auto *pCtx = static_cast<_CurlEasyContext *>(si->si_value.sival_ptr);
-    const ssize_t bytesWritten = aio_return(&pCtx->writeData._aiocb);
-    if (bytesWritten == -1) {
-      LOGGER->error(strerror(errno));
-    } else if (bytesWritten == pCtx->writeData.buf.size()) {
-      LOGGER->info("File IO complete {}", pCtx->writeData.dstPath);
-    } else {
-      LOGGER->info("Filo IO incomplete {}, {} bytes written",
-                   pCtx->writeData.dstPath, bytesWritten);
-      return; // do not remove context yet
-    }
-    if (auto pHandler = pCtx->pHandler.lock()) {
-      pHandler->pSched_->scheduleDelayedTask(
-          0,
-          [](void *clientData) {
-            if (!clientData) {
-              return;
-            }
-            RemoveContext(static_cast<_CurlEasyContext *>(clientData));
-          },
-          pCtx);
+void AsyncFileSave::RecordSavedFile(
+    const std::filesystem::path &path,
+    std::chrono::system_clock::time_point timeStamp, uint32_t roiCount,
+    const cv::Rect &roiBounds,
+    std::chrono::system_clock::time_point captureTime) {
+  TrackSavedFile(path);
+
+  std::error_code ec;
+  const auto size = std::filesystem::file_size(path, ec);
+  if (pCatalog_ && !ec) {
+    pCatalog_->Add({.timeStamp = timeStamp,
+                    .path = path.lexically_relative(pCatalog_->GetDirectory()),
+                    .size = size,
+                    .roiCount = roiCount,
+                    .roiBounds = {roiBounds.x, roiBounds.y, roiBounds.width,
+                                  roiBounds.height},
+                    .captureTime = captureTime});
+    if (pRetention_) {
+      pRetention_->Notify();
     }
   }
 }
 
-void AsyncFileSave::InstallHandlers() {
-  struct sigaction sa{};
-  sigaction(IO_SIGNAL, nullptr, &sa);
-  if (sa.sa_sigaction == AioSigHandler) {
-    return;
-  }
-  memset(&sa, 0, sizeof(sa));
-  sa.sa_flags = SA_RESTART | SA_SIGINFO;
-  sa.sa_sigaction = AioSigHandler;
-  if (sigaction(IO_SIGNAL, &sa, nullptr) == -1) {
-    throw std::runtime_error(strerror(errno));
-  }
-}
-
-#endif
-
 void AsyncFileSave::RemoveContext(_CurlEasyContext *pCtx) {
   if (!pCtx) {
     return; // no-op
   }
   if (auto pHandler = pCtx->pHandler.lock()) {
-    if (pHandler->savedFilePaths_.full()) {
-      const auto &oldFile = pHandler->savedFilePaths_.front();
-      if (std::filesystem::remove(oldFile)) {
-        LOGGER->info("Removed {}, maximum file buffer size reached ({})",
-                     oldFile, pHandler->savedFilePaths_.capacity());
-      } else {
-        LOGGER->warn(
-            "Failed to remove {}, maximum saved images reached ({}), but "
-            "old data has not been deleted, the disk may begin to fill",
-            oldFile, pHandler->savedFilePaths_.capacity());
-      }
+    pHandler->RecordSavedFile(pCtx->writeData.dstPath,
+                              std::chrono::system_clock::now());
+    std::error_code ec;
+    if (pHandler->thumbnailWidth > 0 &&
+        std::filesystem::exists(pCtx->writeData.dstPath, ec)) {
+      pHandler->QueueThumbnail({}, pCtx->writeData.dstPath);
     }
-    pHandler->savedFilePaths_.push_back(pCtx->writeData.dstPath);
 
     // Avoid reallocating a buffer, stash it in a node with a max key
     pHandler->spareBuf_.swap(pCtx->writeData.buf);
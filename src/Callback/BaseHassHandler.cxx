@@ -2,15 +2,79 @@
 
 #include "Callback/BaseHassHandler.h"
 
+#include <charconv>
+#include <format>
+#include <iterator>
+#include <mutex>
 #include <string>
 #include <string_view>
+#include <utility>
 
 #include "Callback/Json.h"
 #include "Util/BufferOperations.h"
+#include "Util/CurlShareWrapper.h"
 
 using namespace std::string_literals;
 using namespace std::string_view_literals;
 
+namespace {
+
+// Connection, DNS and TLS session caches shared by every Home Assistant
+// handler in the process, so state updates reuse an open connection instead
+// of opening a new one per POST
+util::CurlShareWrapper &SharedHassConnections() {
+  static util::CurlShareWrapper wShare;
+  static std::once_flag shareFlag;
+  std::call_once(shareFlag, [] {
+    wShare(curl_share_setopt, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    wShare(curl_share_setopt, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    wShare(curl_share_setopt, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  });
+  return wShare;
+}
+
+std::string StateString(const callback::HassState &state) {
+  switch (state.value) {
+  case callback::HassState::Value::Off:
+    return "off"s;
+  case callback::HassState::Value::On:
+    return "on"s;
+  case callback::HassState::Value::Count:
+    return std::to_string(state.count);
+  default:
+    return "unknown"s;
+  }
+}
+
+callback::HassState ParseState(const callback::json &entity) {
+  callback::HassState state;
+  const std::string value = entity.contains("state") &&
+                                    entity["state"].is_string()
+                                ? entity["state"].template get<std::string>()
+                                : "unknown"s;
+  if (value == "on"sv) {
+    state.value = callback::HassState::Value::On;
+  } else if (value == "off"sv) {
+    state.value = callback::HassState::Value::Off;
+  } else if (auto [ptr, ec] = std::from_chars(
+                 value.data(), value.data() + value.size(), state.count);
+             ec == std::errc{} && ptr == value.data() + value.size()) {
+    state.value = callback::HassState::Value::Count;
+  } else {
+    state.count = 0;
+  }
+
+  if (entity.contains("attributes") && entity["attributes"].contains("rois") &&
+      entity["attributes"]["rois"].is_array()) {
+    for (const auto &roiJson : entity["attributes"]["rois"]) {
+      callback::from_json(roiJson, state.rois.emplace_back());
+    }
+  }
+  return state;
+}
+
+} // namespace
+
 namespace callback {
 
 BaseHassHandler::BaseHassHandler(const boost::url &url,
@@ -27,7 +91,9 @@ BaseHassHandler::BaseHassHandler(const boost::url &url,
 }
 
 void BaseHassHandler::operator()(
-    std::optional<detector::RegionsOfInterest> rois) {
+    std::optional<detector::RegionsOfInterest> rois,
+    std::chrono::system_clock::time_point frameTime) {
+  detectedState_.frameTime = frameTime;
   if (entityId.starts_with("binary_sensor."sv)) {
     UpdateBinarySensor(rois);
   } else if (entityId.starts_with("sensor."sv)) {
@@ -38,54 +104,118 @@ void BaseHassHandler::operator()(
   }
 }
 
-void BaseHassHandler::UpdateStateInternal(std::string_view state,
-                                          const json &attributes) {
-  nextState_["state"] = state;
-  nextState_["attributes"] = attributes;
-  if (!friendlyName.empty()) {
-    nextState_["attributes"]["friendly_name"] = friendlyName;
-  }
+void BaseHassHandler::UpdateStateInternal(const HassState &state) {
+  // copy assignment keeps the ROI storage of nextState_
+  nextState_ = state;
 }
 
 void BaseHassHandler::UpdateBinarySensor(
     std::optional<detector::RegionsOfInterest> rois) {
-  const std::string nextState =
-      rois.and_then([](auto r) {
-            return r.size() > 0 ? std::optional{"on"s} : std::optional{"off"s};
-          })
-          .value_or("unknown"s);
-  json attributes;
-  attributes["device_class"] = "motion";
-  for (const auto &roi : rois.value_or(detector::RegionsOfInterest{})) {
-    json roiJson;
-    to_json(roiJson, roi);
-    attributes["rois"].push_back(std::move(roiJson));
+  detectedState_.count = 0;
+  detectedState_.rois.clear();
+  if (rois) {
+    detectedState_.value =
+        rois->empty() ? HassState::Value::Off : HassState::Value::On;
+    detectedState_.rois.assign(rois->begin(), rois->end());
+  } else {
+    detectedState_.value = HassState::Value::Unknown;
   }
-  UpdateState_Impl(nextState, attributes);
+  UpdateState_Impl(detectedState_);
 }
 
 void BaseHassHandler::UpdateSensor(
     std::optional<detector::RegionsOfInterest> rois) {
-  const std::string nextState =
-      rois.and_then([](auto r) {
-            return std::make_optional(std::to_string(r.size()));
-          })
-          .value_or("unknown"s);
-  json attributes;
-  for (const auto &roi : detector::RegionsOfInterest{}) {
-    json roiJson;
-    to_json(roiJson, roi);
-    attributes["rois"].push_back(std::move(roiJson));
-  }
-  UpdateState_Impl(nextState, attributes);
+  detectedState_.rois.clear();
+  detectedState_.value =
+      rois ? HassState::Value::Count : HassState::Value::Unknown;
+  detectedState_.count = rois ? rois->size() : 0;
+  UpdateState_Impl(detectedState_);
 }
 
 bool BaseHassHandler::IsStateBecomingUnknown() const {
-  return nextState_["state"] == "unknown"sv;
+  return nextState_.value == HassState::Value::Unknown;
+}
+
+void BaseHassHandler::SerializeState(const HassState &state,
+                                     std::string &out) const {
+  out.clear();
+  auto it = std::back_inserter(out);
+  std::format_to(it, R"({{"entity_id":{},"state":)", json(entityId).dump());
+  switch (state.value) {
+  case HassState::Value::Unknown:
+    out += R"("unknown")";
+    break;
+  case HassState::Value::Off:
+    out += R"("off")";
+    break;
+  case HassState::Value::On:
+    out += R"("on")";
+    break;
+  case HassState::Value::Count:
+    std::format_to(it, R"("{}")", state.count);
+    break;
+  }
+
+  out += R"(,"attributes":{)";
+  bool first{true};
+  const auto separate = [&out, &first] {
+    if (!std::exchange(first, false)) {
+      out += ',';
+    }
+  };
+  if (entityId.starts_with("binary_sensor."sv)) {
+    separate();
+    out += R"("device_class":"motion")";
+  }
+  if (!friendlyName.empty()) {
+    separate();
+    std::format_to(it, R"("friendly_name":{})", json(friendlyName).dump());
+  }
+  if (!state.rois.empty()) {
+    separate();
+    out += R"("rois":[)";
+    for (size_t i = 0; i < state.rois.size(); ++i) {
+      const auto &roi = state.rois[i];
+      std::format_to(it, R"({}{{"x":{},"y":{},"width":{},"height":{}}})",
+                     i > 0 ? "," : "", roi.x, roi.y, roi.width, roi.height);
+    }
+    out += ']';
+  }
+  if (state.frameTime != std::chrono::system_clock::time_point{}) {
+    separate();
+    std::format_to(
+        it, R"("frame_time":"{:%FT%TZ}")",
+        std::chrono::floor<std::chrono::milliseconds>(state.frameTime));
+  }
+  out += "}}";
+}
+
+void BaseHassHandler::PrepareConnection(util::CurlWrapper &wCurl) {
+  wCurl(curl_easy_setopt, CURLOPT_SHARE, SharedHassConnections().pCurl_);
+  wCurl(curl_easy_setopt, CURLOPT_TCP_KEEPALIVE, 1L);
+  wCurl(curl_easy_setopt, CURLOPT_TCP_KEEPIDLE, 30L);
+  wCurl(curl_easy_setopt, CURLOPT_TCP_KEEPINTVL, 15L);
+  if (useHttp2) {
+    try {
+      // plain-text connections (e.g. http://supervisor) cannot upgrade, so
+      // assume the server speaks HTTP/2 directly
+      const long httpVersion = url_.scheme() == "https"sv
+                                   ? CURL_HTTP_VERSION_2TLS
+                                   : CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE;
+      wCurl(curl_easy_setopt, CURLOPT_HTTP_VERSION, httpVersion);
+      wCurl(curl_easy_setopt, CURLOPT_PIPEWAIT, 1L);
+    } catch (const util::CurlWrapper::CurlError &e) {
+      LOGGER->warn("HTTP/2 is unavailable, falling back to HTTP/1.1: {}",
+                   e.what());
+      useHttp2 = false;
+    }
+  }
 }
 
 void BaseHassHandler::PrepareGetRequest(util::CurlWrapper &wCurl,
                                         std::vector<char> &buf) {
+  PrepareConnection(wCurl);
+
   wCurl(curl_easy_setopt, CURLOPT_URL, url_.c_str());
   wCurl(curl_easy_setopt, CURLOPT_HTTPAUTH, CURLAUTH_BEARER);
   wCurl(curl_easy_setopt, CURLOPT_XOAUTH2_BEARER, token_.c_str());
@@ -102,22 +232,19 @@ void BaseHassHandler::HandleGetResponse(util::CurlWrapper &wCurl,
 
   switch (code) {
   case 200:
-  case 201: {
-    const auto tmpState = json::parse(buf);
-    currentState_["state"] = tmpState["state"];
-    currentState_["entity_id"] = tmpState["entity_id"];
-    currentState_["attributes"] = tmpState["attributes"];
+  case 201:
+    currentState_ = ParseState(json::parse(buf));
     nextState_ = currentState_;
-  } break;
+    hasInitialState_ = true;
+    break;
   case 404:
     // Not found, entity will be created upon post
     LOGGER->warn(
         "Entity with ID {} was not found, will be created upon first POST",
         entityId);
-    currentState_["state"] = "unknown";
-    currentState_["entity_id"] = entityId;
-    currentState_["attributes"] = {};
+    currentState_ = HassState{};
     nextState_ = currentState_;
+    hasInitialState_ = true;
     break;
   default: {
     char *ct{nullptr};
@@ -139,12 +266,17 @@ void BaseHassHandler::HandleGetResponse(util::CurlWrapper &wCurl,
 void BaseHassHandler::PreparePostRequest(util::CurlWrapper &wCurl,
                                          std::vector<char> &buf,
                                          std::string &payload) {
-  payload = nextState_.dump();
+  SerializeState(nextState_, payload);
+
+  PrepareConnection(wCurl);
 
   wCurl(curl_easy_setopt, CURLOPT_URL, url_.c_str());
   wCurl(curl_easy_setopt, CURLOPT_HTTPAUTH, CURLAUTH_BEARER);
   wCurl(curl_easy_setopt, CURLOPT_XOAUTH2_BEARER, token_.c_str());
   wCurl(curl_easy_setopt, CURLOPT_POST, 1L);
+  // a known length avoids chunked uploads, which keeps the request to a
+  // single write on a reused connection
+  wCurl(curl_easy_setopt, CURLOPT_POSTFIELDSIZE, long(payload.size()));
 
   wCurl(curl_easy_setopt, CURLOPT_WRITEFUNCTION, util::FillBufferCallback);
   wCurl(curl_easy_setopt, CURLOPT_WRITEDATA, &buf);
@@ -152,6 +284,11 @@ void BaseHassHandler::PreparePostRequest(util::CurlWrapper &wCurl,
   wCurl(curl_easy_setopt, CURLOPT_READDATA, &payload);
 }
 
+void BaseHassHandler::AcceptState(const HassState &state) {
+  LOGGER->info("Updated {} with state {}", entityId, StateString(state));
+  currentState_ = state;
+}
+
 void BaseHassHandler::HandlePostResponse(util::CurlWrapper &wCurl,
                                          std::span<const char> buf) {
   int code{0};
@@ -160,11 +297,7 @@ void BaseHassHandler::HandlePostResponse(util::CurlWrapper &wCurl,
   switch (code) {
   case 200:
   case 201:
-    LOGGER->debug("{}", nextState_.dump(2));
-    LOGGER->info("Updated {} with state {}",
-                 nextState_["entity_id"].template get<std::string>(),
-                 nextState_["state"].template get<std::string>());
-    currentState_ = nextState_;
+    AcceptState(nextState_);
     break;
   default: {
     char *ct{nullptr};
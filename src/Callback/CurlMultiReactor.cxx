@@ -0,0 +1,179 @@
+#include "Logger.h"
+#include "WindowsWrapper.h"
+
+#include "Callback/CurlMultiReactor.h"
+
+#include <ranges>
+
+#include "Callback/SharedRegistry.h"
+
+namespace callback {
+
+std::shared_ptr<CurlMultiReactor>
+CurlMultiReactor::ForScheduler(std::shared_ptr<TaskScheduler> pSched) {
+  static SharedRegistry<CurlMultiReactor, TaskScheduler *> reactors;
+  return reactors.GetOrCreate(pSched.get(), pSched);
+}
+
+CurlMultiReactor::CurlMultiReactor(std::shared_ptr<TaskScheduler> pSched)
+    : pSched_{pSched} {
+  wCurlMulti_(curl_multi_setopt, CURLMOPT_SOCKETFUNCTION, SocketCallback);
+  wCurlMulti_(curl_multi_setopt, CURLMOPT_SOCKETDATA, this);
+  wCurlMulti_(curl_multi_setopt, CURLMOPT_TIMERFUNCTION, TimeoutCallback);
+  wCurlMulti_(curl_multi_setopt, CURLMOPT_TIMERDATA, this);
+  wCurlMulti_(curl_multi_setopt, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+  int runningHandles{0};
+  wCurlMulti_(curl_multi_socket_action, CURL_SOCKET_TIMEOUT, 0,
+              &runningHandles);
+}
+
+CurlMultiReactor::~CurlMultiReactor() noexcept {
+  pSched_->unscheduleDelayedTask(timeoutTaskToken_);
+  for (const auto &socketCtx : socketCtxs_ | std::views::values) {
+    pSched_->disableBackgroundHandling(socketCtx->sockfd);
+    curl_multi_assign(wCurlMulti_.pCurl_, socketCtx->sockfd, nullptr);
+  }
+  // handles must leave the multi before their owners clean them up
+  for (CURL *easy : transfers_ | std::views::keys) {
+    curl_multi_remove_handle(wCurlMulti_.pCurl_, easy);
+  }
+}
+
+void CurlMultiReactor::Submit(std::shared_ptr<util::CurlWrapper> pWCurl,
+                              Completion onDone) {
+  CURL *easy = pWCurl->pCurl_;
+  wCurlMulti_(curl_multi_add_handle, easy);
+  transfers_[easy] = {.pWCurl = std::move(pWCurl),
+                      .onDone = std::move(onDone)};
+}
+
+void CurlMultiReactor::CheckMultiInfo() {
+  CURLMsg *message{nullptr};
+
+  int pending{0};
+
+  while ((message = curl_multi_info_read(wCurlMulti_.pCurl_, &pending))) {
+    switch (message->msg) {
+    case CURLMSG_DONE: {
+      CURL *easy = message->easy_handle;
+      const CURLcode result = message->data.result;
+
+      auto it = transfers_.find(easy);
+      if (it == transfers_.end()) {
+        LOGGER->warn("Finished CURL transfer has no owner");
+        wCurlMulti_(curl_multi_remove_handle, easy);
+        break;
+      }
+      // completions may submit new transfers, so take this one out first
+      Transfer transfer = std::move(it->second);
+      transfers_.erase(it);
+      wCurlMulti_(curl_multi_remove_handle, easy);
+
+      try {
+        if (transfer.onDone) {
+          transfer.onDone(result);
+        }
+      } catch (const std::exception &e) {
+        LOGGER->error(e.what());
+      }
+    } break;
+    default:
+      LOGGER->warn("CURLMSG default");
+      break;
+    }
+  }
+}
+
+int CurlMultiReactor::SocketCallback(CURL *easy, curl_socket_t s, int action,
+                                     CurlMultiReactor *curlMultiReactor,
+                                     _CurlSocketContext *curlSocketContext) {
+  if (auto pReactor = curlMultiReactor->weak_from_this().lock()) {
+    std::shared_ptr<_CurlSocketContext> pCtx;
+    if (curlSocketContext) {
+      pCtx = static_cast<_CurlSocketContext *>(curlSocketContext)
+                 ->shared_from_this();
+    };
+    switch (action) {
+    case CURL_POLL_IN:
+    case CURL_POLL_OUT:
+    case CURL_POLL_INOUT: {
+      if (!pCtx) {
+        pCtx = std::make_shared<_CurlSocketContext>();
+        pCtx->sockfd = s;
+        pCtx->pHandler = pReactor;
+        pReactor->socketCtxs_[s] =
+            pCtx; // save to the map for pointer preservation
+      }
+
+      pReactor->wCurlMulti_(curl_multi_assign, s, pCtx.get());
+
+      int flags{0};
+      flags |= (action != CURL_POLL_IN) ? SOCKET_WRITABLE : 0;
+      flags |= (action != CURL_POLL_OUT) ? SOCKET_READABLE : 0;
+      pReactor->pSched_->setBackgroundHandling(
+          s, flags, CurlMultiReactor::BackgroundHandlerProc, pCtx.get());
+    } break;
+    case CURL_POLL_REMOVE:
+      pReactor->pSched_->disableBackgroundHandling(s);
+      pReactor->wCurlMulti_(curl_multi_assign, s, nullptr);
+      pReactor->socketCtxs_.erase(s);
+      break;
+    }
+  }
+  return 0;
+}
+
+int CurlMultiReactor::TimeoutCallback(CURLM *multi, int timeoutMs,
+                                      CurlMultiReactor *curlMultiReactor) {
+  if (curlMultiReactor) {
+    // curl keeps a single timer, replace any previously scheduled one
+    curlMultiReactor->pSched_->unscheduleDelayedTask(
+        curlMultiReactor->timeoutTaskToken_);
+    if (timeoutMs >= 0) {
+      if (timeoutMs == 0) {
+        timeoutMs = 1;
+      }
+      curlMultiReactor->timeoutTaskToken_ =
+          curlMultiReactor->pSched_->scheduleDelayedTask(
+              timeoutMs * 1000, CurlMultiReactor::TimeoutHandlerProc,
+              curlMultiReactor);
+    }
+  }
+  return 0;
+}
+
+void CurlMultiReactor::BackgroundHandlerProc(void *curlSocketContext_clientData,
+                                             int mask) {
+  if (curlSocketContext_clientData) {
+    int flags{0};
+    if (mask & SOCKET_READABLE) {
+      flags |= CURL_CSELECT_IN;
+    }
+    if (mask & SOCKET_WRITABLE) {
+      flags |= CURL_CSELECT_OUT;
+    }
+    auto csc = static_cast<_CurlSocketContext *>(curlSocketContext_clientData)
+                   ->shared_from_this();
+    if (auto pReactor = csc->pHandler.lock()) {
+      int runningHandles{0};
+      pReactor->wCurlMulti_(curl_multi_socket_action, csc->sockfd, flags,
+                            &runningHandles);
+      pReactor->CheckMultiInfo();
+    }
+  }
+}
+
+void CurlMultiReactor::TimeoutHandlerProc(void *curlMultiReactor_clientData) {
+  if (curlMultiReactor_clientData) {
+    auto pReactor =
+        static_cast<CurlMultiReactor *>(curlMultiReactor_clientData);
+    pReactor->timeoutTaskToken_ = nullptr;
+    int runningHandles{-1};
+    pReactor->wCurlMulti_(curl_multi_socket_action, CURL_SOCKET_TIMEOUT, 0,
+                          &runningHandles);
+    pReactor->CheckMultiInfo();
+  }
+}
+
+} // namespace callback
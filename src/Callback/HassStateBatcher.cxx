@@ -0,0 +1,77 @@
+#include "Logger.h"
+
+#include "Callback/HassStateBatcher.h"
+
+#include <algorithm>
+#include <iterator>
+#include <ranges>
+#include <vector>
+
+#include "Callback/SharedRegistry.h"
+
+namespace callback {
+
+std::shared_ptr<HassStateBatcher>
+HassStateBatcher::ForScheduler(std::shared_ptr<TaskScheduler> pSched) {
+  static SharedRegistry<HassStateBatcher, TaskScheduler *> batchers;
+  return batchers.GetOrCreate(pSched.get(), pSched);
+}
+
+HassStateBatcher::HassStateBatcher(std::shared_ptr<TaskScheduler> pSched)
+    : pSched_{pSched} {}
+
+HassStateBatcher::~HassStateBatcher() noexcept {
+  pSched_->unscheduleDelayedTask(flushTaskToken_);
+}
+
+void HassStateBatcher::Enqueue(const void *key, Flush flush,
+                               std::chrono::microseconds maxDelay) {
+  queued_[key] = std::move(flush);
+
+  // only move the window forward if this update needs to go sooner
+  const auto deadline = sc::now() + maxDelay;
+  if (deadline < deadline_) {
+    deadline_ = deadline;
+    pSched_->unscheduleDelayedTask(flushTaskToken_);
+    flushTaskToken_ = pSched_->scheduleDelayedTask(
+        std::max<int64_t>(maxDelay.count(), 0), FlushProc, this);
+  }
+}
+
+void HassStateBatcher::FlushNow() {
+  pSched_->unscheduleDelayedTask(flushTaskToken_);
+  flushTaskToken_ = nullptr;
+  deadline_ = sc::time_point::max();
+
+  if (queued_.empty()) {
+    return;
+  }
+
+  // flushes may queue again, so drain into a local batch first
+  std::vector<Flush> batch;
+  batch.reserve(queued_.size());
+  std::ranges::move(queued_ | std::views::values, std::back_inserter(batch));
+  queued_.clear();
+
+  LOGGER->debug("Flushing {} Home Assistant state update(s)", batch.size());
+  for (auto &flush : batch) {
+    try {
+      flush();
+    } catch (const std::exception &e) {
+      LOGGER->error(e.what());
+    }
+  }
+  ++flushedBatches_;
+  flushedUpdates_ += batch.size();
+}
+
+void HassStateBatcher::FlushProc(void *hassStateBatcher_clientData) {
+  if (hassStateBatcher_clientData) {
+    auto *pBatcher =
+        static_cast<HassStateBatcher *>(hassStateBatcher_clientData);
+    pBatcher->flushTaskToken_ = nullptr;
+    pBatcher->FlushNow();
+  }
+}
+
+} // namespace callback
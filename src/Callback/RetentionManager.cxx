@@ -0,0 +1,225 @@
+#include "Logger.h"
+#include "WindowsWrapper.h"
+
+#include "Callback/RetentionManager.h"
+
+#include <algorithm>
+#include <span>
+
+#define JSON_USE_IMPLICIT_CONVERSIONS 0
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace {
+
+using Budget = callback::RetentionManager::Budget;
+using Entry = util::MediaCatalog::Entry;
+
+struct Candidate {
+  size_t feed;
+  const Entry *pEntry;
+};
+
+// moves candidates, oldest first, from keep to victims until the rest fit
+void SelectVictims(const Budget &budget, std::vector<Candidate> &keep,
+                   std::vector<Candidate> &victims) {
+  uintmax_t bytes{0};
+  for (const auto &candidate : keep) {
+    bytes += candidate.pEntry->size;
+  }
+  size_t files = keep.size();
+  const auto now = std::chrono::system_clock::now();
+
+  size_t kept{0};
+  for (auto &candidate : keep) {
+    const bool expired = budget.maxAge.count() > 0 &&
+                         now - candidate.pEntry->timeStamp > budget.maxAge;
+    const bool overBytes = budget.maxBytes > 0 && bytes > budget.maxBytes;
+    const bool overFiles = budget.maxFiles > 0 && files > budget.maxFiles;
+    if (expired || overBytes || overFiles) {
+      bytes -= candidate.pEntry->size;
+      --files;
+      victims.push_back(candidate);
+    } else {
+      keep[kept++] = candidate;
+    }
+  }
+  keep.resize(kept);
+}
+
+json ToJson(const callback::RetentionManager::Usage &usage) {
+  return {{"bytes", usage.bytes},
+          {"files", usage.files},
+          {"removedBytes", usage.removedBytes},
+          {"removedFiles", usage.removedFiles}};
+}
+
+} // namespace
+
+namespace callback {
+
+RetentionManager::RetentionManager(const std::filesystem::path &root,
+                                   Budget globalBudget)
+    : root_{root}, globalBudget_{globalBudget} {}
+
+void RetentionManager::AddFeed(std::string feedId,
+                               std::shared_ptr<util::MediaCatalog> pCatalog,
+                               Budget budget) {
+  {
+    std::scoped_lock lk(mtx_);
+    feeds_.push_back({.id = std::move(feedId),
+                      .pCatalog = std::move(pCatalog),
+                      .budget = budget});
+  }
+  if (!worker_.joinable()) {
+    worker_ = std::jthread(
+        [this](std::stop_token stopToken) { Run(stopToken); });
+  }
+  Notify();
+}
+
+void RetentionManager::Notify() {
+  {
+    std::scoped_lock lk(mtx_);
+    pending_ = true;
+  }
+  cv_.notify_one();
+}
+
+void RetentionManager::Run(std::stop_token stopToken) {
+#ifdef _WIN32
+  SetThreadDescription(GetCurrentThread(), L"Retention Thread");
+#endif
+  while (!stopToken.stop_requested()) {
+    {
+      std::unique_lock lk(mtx_);
+      cv_.wait_for(lk, stopToken, checkInterval, [this] { return pending_; });
+      pending_ = false;
+    }
+    if (stopToken.stop_requested()) {
+      break;
+    }
+    try {
+      Enforce(stopToken);
+    } catch (const std::exception &e) {
+      LOGGER->error("Failed to apply retention to saved media: {}", e.what());
+    }
+  }
+}
+
+void RetentionManager::Enforce(std::stop_token stopToken) {
+  std::vector<std::shared_ptr<util::MediaCatalog>> catalogs;
+  std::vector<Budget> budgets;
+  {
+    std::scoped_lock lk(mtx_);
+    for (const auto &feed : feeds_) {
+      catalogs.push_back(feed.pCatalog);
+      budgets.push_back(feed.budget);
+    }
+  }
+
+  // the catalogs are read once, nothing below lists a directory
+  std::vector<std::vector<Entry>> entries(catalogs.size());
+  std::vector<Candidate> keep;
+  std::vector<Candidate> victims;
+  std::vector<Usage> usage(catalogs.size());
+  for (size_t i = 0; i < catalogs.size(); ++i) {
+    entries[i] = catalogs[i]->GetEntries();
+    std::vector<Candidate> feedKeep;
+    feedKeep.reserve(entries[i].size());
+    for (const auto &entry : entries[i]) {
+      feedKeep.push_back({i, &entry});
+      usage[i].bytes += entry.size;
+      ++usage[i].files;
+    }
+    SelectVictims(budgets[i], feedKeep, victims);
+    keep.insert(keep.end(), feedKeep.begin(), feedKeep.end());
+  }
+  std::ranges::sort(keep, {}, [](const Candidate &candidate) {
+    return candidate.pEntry->timeStamp;
+  });
+  SelectVictims(globalBudget_, keep, victims);
+
+  uintmax_t removedBytes{0};
+  size_t removedFiles{0};
+  for (size_t start = 0; start < victims.size() && !stopToken.stop_requested();
+       start += batchSize) {
+    const auto batch = std::span(victims).subspan(
+        start, std::min(batchSize, victims.size() - start));
+    // unlink the whole batch before touching the indexes
+    std::vector<Candidate> removed;
+    for (const auto &victim : batch) {
+      const auto path =
+          catalogs[victim.feed]->GetDirectory() / victim.pEntry->path;
+      std::error_code ec;
+      std::filesystem::remove(path, ec);
+      if (ec) {
+        LOGGER->warn("Failed to remove {}: {}", path, ec.message());
+        continue;
+      }
+      std::filesystem::remove(util::MediaCatalog::ThumbnailPath(path), ec);
+      removed.push_back(victim);
+    }
+    for (const auto &victim : removed) {
+      catalogs[victim.feed]->Remove(victim.pEntry->path);
+      usage[victim.feed].bytes -= victim.pEntry->size;
+      --usage[victim.feed].files;
+      usage[victim.feed].removedBytes += victim.pEntry->size;
+      ++usage[victim.feed].removedFiles;
+      removedBytes += victim.pEntry->size;
+      ++removedFiles;
+    }
+  }
+
+  {
+    std::scoped_lock lk(mtx_);
+    for (size_t i = 0; i < usage.size(); ++i) {
+      feeds_[i].usage.bytes = usage[i].bytes;
+      feeds_[i].usage.files = usage[i].files;
+      feeds_[i].usage.removedBytes += usage[i].removedBytes;
+      feeds_[i].usage.removedFiles += usage[i].removedFiles;
+    }
+  }
+  if (removedFiles > 0) {
+    LOGGER->info("Removed {} saved files ({} bytes) to stay within retention "
+                 "limits",
+                 removedFiles, removedBytes);
+  }
+}
+
+std::vector<std::pair<std::string, RetentionManager::Usage>>
+RetentionManager::GetUsage() const {
+  std::scoped_lock lk(mtx_);
+  std::vector<std::pair<std::string, Usage>> usage;
+  for (const auto &feed : feeds_) {
+    usage.emplace_back(feed.id, feed.usage);
+  }
+  return usage;
+}
+
+std::string RetentionManager::DumpUsage() const {
+  Usage total;
+  json feeds = json::object();
+  for (const auto &[id, usage] : GetUsage()) {
+    feeds[id] = ToJson(usage);
+    total.bytes += usage.bytes;
+    total.files += usage.files;
+    total.removedBytes += usage.removedBytes;
+    total.removedFiles += usage.removedFiles;
+  }
+
+  json disk = json::object();
+  std::error_code ec;
+  if (const auto space = std::filesystem::space(root_, ec); !ec) {
+    disk = {{"capacity", space.capacity}, {"available", space.available}};
+  }
+  return json{{"feeds", std::move(feeds)},
+              {"total", ToJson(total)},
+              {"disk", std::move(disk)},
+              {"maxBytes", globalBudget_.maxBytes},
+              {"maxAge", globalBudget_.maxAge.count()}}
+      .dump();
+}
+
+} // namespace callback
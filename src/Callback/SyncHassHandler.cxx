@@ -22,17 +22,22 @@ SyncHassHandler::SyncHassHandler(const boost::url &url,
                                  const std::string &entityId)
     : BaseHassHandler(url, token, entityId) {}
 
-void SyncHassHandler::UpdateState_Impl(std::string_view state,
-                                       const json &attributes) {
+void SyncHassHandler::UpdateState_Impl(const HassState &state) {
   thread_local std::string payload;
   thread_local util::CurlWrapper wCurl;
 
-  PrepareGetRequest(wCurl, buf_);
-  wCurl(curl_easy_perform);
-  HandleGetResponse(wCurl, buf_);
+  // the state is only read back once, later updates reuse the connection for
+  // the POST alone
+  if (!HasInitialState()) {
+    buf_.clear();
+    PrepareGetRequest(wCurl, buf_);
+    wCurl(curl_easy_perform);
+    HandleGetResponse(wCurl, buf_);
+  }
 
-  UpdateStateInternal(state, attributes);
+  UpdateStateInternal(state);
 
+  buf_.clear();
   PreparePostRequest(wCurl, buf_, payload);
   wCurl(curl_easy_perform);
   HandlePostResponse(wCurl, buf_);
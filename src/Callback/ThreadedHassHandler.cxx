@@ -68,10 +68,9 @@ void ThreadedHassHandler::Start() {
 
 void ThreadedHassHandler::Stop() { updaterThread_ = {}; }
 
-void ThreadedHassHandler::UpdateState_Impl(std::string_view state,
-                                           const json &attributes) {
+void ThreadedHassHandler::UpdateState_Impl(const HassState &state) {
   std::unique_lock lk(mtx_);
-  UpdateStateInternal(state, attributes);
+  UpdateStateInternal(state);
   cv_.notify_all();
 }
 
@@ -0,0 +1,329 @@
+#ifdef __linux__
+
+#include "Logger.h"
+
+#include "Callback/UringFileWriter.h"
+
+#include <array>
+#include <utility>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <liburing.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "Callback/SharedRegistry.h"
+
+namespace {
+// every write is open, write, fsync and close
+constexpr unsigned sqesPerWrite{4};
+constexpr unsigned ringEntries{callback::UringFileWriter::maxOpenFiles *
+                               sqesPerWrite};
+
+constexpr uint64_t UserData(uint64_t id, uint64_t op) { return id << 2 | op; }
+// request ids start at 1, entries of chains that failed to submit have none
+constexpr uint64_t discardedId{0};
+} // namespace
+
+namespace callback {
+
+std::shared_ptr<UringFileWriter>
+UringFileWriter::ForScheduler(std::shared_ptr<TaskScheduler> pSched) {
+  static SharedRegistry<UringFileWriter, TaskScheduler *> writers;
+  return writers.GetOrCreate(pSched.get(), pSched);
+}
+
+UringFileWriter::UringFileWriter(std::shared_ptr<TaskScheduler> pSched)
+    : pSched_{pSched} {
+  auto pRing = std::make_unique<io_uring>();
+  if (const int res = io_uring_queue_init(ringEntries, pRing.get(), 0);
+      res < 0) {
+    LOGGER->warn("io_uring is unavailable, files will be written "
+                 "synchronously: {}",
+                 strerror(-res));
+    return;
+  }
+  // direct descriptors let the write, fsync and close of a chain refer to the
+  // file its open creates
+  if (const int res =
+          io_uring_register_files_sparse(pRing.get(), maxOpenFiles);
+      res < 0) {
+    LOGGER->warn("io_uring direct descriptors are unavailable, files will be "
+                 "written synchronously: {}",
+                 strerror(-res));
+    io_uring_queue_exit(pRing.get());
+    return;
+  }
+  eventFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (eventFd_ == -1 || io_uring_register_eventfd(pRing.get(), eventFd_) < 0) {
+    LOGGER->warn("Failed to watch io_uring completions, files will be "
+                 "written synchronously: {}",
+                 strerror(errno));
+    if (eventFd_ != -1) {
+      close(eventFd_);
+      eventFd_ = -1;
+    }
+    io_uring_queue_exit(pRing.get());
+    return;
+  }
+
+  freeSlots_.reserve(maxOpenFiles);
+  for (unsigned slot = maxOpenFiles; slot > 0; --slot) {
+    freeSlots_.push_back(slot - 1);
+  }
+  pRing_ = std::move(pRing);
+  pSched_->setBackgroundHandling(eventFd_, SOCKET_READABLE,
+                                 UringFileWriter::EventHandlerProc, this);
+}
+
+UringFileWriter::~UringFileWriter() noexcept {
+  if (!pRing_) {
+    return;
+  }
+  pSched_->disableBackgroundHandling(eventFd_);
+
+  // the kernel may still be reading from caller buffers, wait for every chain
+  // to finish before they are released, owners are gone so nobody is told
+  for (io_uring_cqe *cqe{nullptr};
+       inFlightSqes_ > 0 && io_uring_wait_cqe(pRing_.get(), &cqe) == 0;) {
+    if (io_uring_cqe_get_data64(cqe) >> 2 != discardedId) {
+      --inFlightSqes_;
+    }
+    io_uring_cqe_seen(pRing_.get(), cqe);
+  }
+
+  io_uring_queue_exit(pRing_.get());
+  close(eventFd_);
+}
+
+void UringFileWriter::WriteFile(std::filesystem::path path,
+                                std::span<const char> data, Completion onDone,
+                                bool durable) {
+  Enqueue({.path = std::move(path),
+           .data = data,
+           .onDone = std::move(onDone),
+           .durable = durable});
+}
+
+void UringFileWriter::AppendFile(std::filesystem::path path,
+                                 std::span<const char> data, Completion onDone,
+                                 bool durable) {
+  Enqueue({.path = std::move(path),
+           .data = data,
+           .onDone = std::move(onDone),
+           .durable = durable,
+           .append = true});
+}
+
+void UringFileWriter::Enqueue(Request req) {
+  if (!pRing_) {
+    const int result =
+        WriteFileBlocking(req.path, req.data, req.durable, req.append);
+    if (req.onDone) {
+      req.onDone(result);
+    }
+    return;
+  }
+
+  const uint64_t id = nextId_++;
+  auto &queued = requests_[id] = std::move(req);
+  std::vector<std::pair<Completion, int>> done;
+  if (!Submit(id, queued, done)) {
+    waiting_.push_back(id);
+  }
+  RunCompletions(done);
+}
+
+bool UringFileWriter::Submit(uint64_t id, Request &req,
+                             std::vector<std::pair<Completion, int>> &done) {
+  if (freeSlots_.empty()) {
+    return false;
+  }
+  if (io_uring_sq_space_left(pRing_.get()) < sqesPerWrite) {
+    io_uring_submit(pRing_.get());
+  }
+  req.slot = freeSlots_.back();
+  freeSlots_.pop_back();
+
+  // hard links keep the chain going after a failure, so the close always runs
+  // and the slot is always released, errors are picked out of each completion
+  std::array<io_uring_sqe *, sqesPerWrite> chain{};
+  unsigned chainSqes{0};
+  io_uring_sqe *sqe = chain[chainSqes++] = io_uring_get_sqe(pRing_.get());
+  // direct descriptors are never inherited, O_CLOEXEC is rejected for them
+  io_uring_prep_openat_direct(sqe, AT_FDCWD, req.path.c_str(),
+                              O_CREAT | O_WRONLY |
+                                  (req.append ? O_APPEND : O_TRUNC),
+                              0666, req.slot);
+  io_uring_sqe_set_data64(sqe, UserData(id, uint64_t(Op::Open)));
+  sqe->flags |= IOSQE_IO_HARDLINK;
+
+  sqe = chain[chainSqes++] = io_uring_get_sqe(pRing_.get());
+  // an offset of -1 writes at the file position, the end when appending
+  io_uring_prep_write(sqe, req.slot, req.data.data(),
+                      unsigned(req.data.size()),
+                      req.append ? uint64_t(-1) : 0);
+  io_uring_sqe_set_data64(sqe, UserData(id, uint64_t(Op::Write)));
+  sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+
+  if (req.durable) {
+    sqe = chain[chainSqes++] = io_uring_get_sqe(pRing_.get());
+    io_uring_prep_fsync(sqe, req.slot, IORING_FSYNC_DATASYNC);
+    io_uring_sqe_set_data64(sqe, UserData(id, uint64_t(Op::Fsync)));
+    sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+  }
+
+  sqe = chain[chainSqes++] = io_uring_get_sqe(pRing_.get());
+  io_uring_prep_close_direct(sqe, req.slot);
+  io_uring_sqe_set_data64(sqe, UserData(id, uint64_t(Op::Close)));
+
+  if (const int res = io_uring_submit(pRing_.get()); res < 0) {
+    // a failed submit consumes nothing, but the entries stay queued for the
+    // next one, so they become no-ops without an owner and the file is written
+    // synchronously instead
+    LOGGER->warn("Failed to submit io_uring write for {}, writing it "
+                 "synchronously: {}",
+                 req.path, strerror(-res));
+    for (unsigned i = 0; i < chainSqes; ++i) {
+      io_uring_prep_nop(chain[i]);
+      io_uring_sqe_set_data64(chain[i], UserData(discardedId, 0));
+    }
+    freeSlots_.push_back(req.slot);
+    done.emplace_back(
+        std::move(req.onDone),
+        WriteFileBlocking(req.path, req.data, req.durable, req.append));
+    requests_.erase(id);
+    return true;
+  }
+  inFlightSqes_ += chainSqes;
+  return true;
+}
+
+void UringFileWriter::SubmitWaiting(
+    std::vector<std::pair<Completion, int>> &done) {
+  while (!waiting_.empty()) {
+    const auto it = requests_.find(waiting_.front());
+    if (it != requests_.end() && !Submit(it->first, it->second, done)) {
+      return;
+    }
+    waiting_.pop_front();
+  }
+}
+
+void UringFileWriter::Reap() {
+  std::vector<std::pair<Completion, int>> done;
+
+  unsigned head{0};
+  unsigned seen{0};
+  io_uring_cqe *cqe{nullptr};
+  io_uring_for_each_cqe(pRing_.get(), head, cqe) {
+    const uint64_t userData = io_uring_cqe_get_data64(cqe);
+    ++seen;
+    if (userData >> 2 == discardedId) {
+      continue;
+    }
+    Complete(userData >> 2, Op(userData & 0b11), cqe->res, done);
+    --inFlightSqes_;
+  }
+  io_uring_cq_advance(pRing_.get(), seen);
+
+  SubmitWaiting(done);
+  RunCompletions(done);
+}
+
+void UringFileWriter::RunCompletions(
+    std::vector<std::pair<Completion, int>> &done) {
+  for (auto &[onDone, result] : done) {
+    try {
+      if (onDone) {
+        onDone(result);
+      }
+    } catch (const std::exception &e) {
+      LOGGER->error(e.what());
+    }
+  }
+}
+
+void UringFileWriter::Complete(uint64_t id, Op op, int res,
+                               std::vector<std::pair<Completion, int>> &done) {
+  const auto it = requests_.find(id);
+  if (it == requests_.end()) {
+    LOGGER->warn("io_uring completion has no owner");
+    return;
+  }
+  auto &req = it->second;
+
+  // keep the first failure, later steps of the chain fail because of it
+  switch (op) {
+  case Op::Open:
+    if (res < 0) {
+      req.result = res;
+    }
+    break;
+  case Op::Write:
+    if (req.result == 0) {
+      req.result = (res >= 0 && size_t(res) != req.data.size()) ? -EIO : res;
+    }
+    break;
+  case Op::Fsync:
+    if (res < 0 && req.result >= 0) {
+      req.result = res;
+    }
+    break;
+  case Op::Close:
+    freeSlots_.push_back(req.slot);
+    if (req.result < 0) {
+      LOGGER->error("Failed to write {}: {}", req.path, strerror(-req.result));
+    }
+    done.emplace_back(std::move(req.onDone), req.result);
+    requests_.erase(it);
+    break;
+  }
+}
+
+int UringFileWriter::WriteFileBlocking(const std::filesystem::path &path,
+                                       std::span<const char> data,
+                                       bool durable, bool append) {
+  const int fd =
+      open(path.c_str(),
+           O_CREAT | O_WRONLY | (append ? O_APPEND : O_TRUNC) | O_CLOEXEC,
+           0666);
+  if (fd == -1) {
+    return -errno;
+  }
+  int result{0};
+  for (size_t offset{0}; offset < data.size();) {
+    const ssize_t written =
+        write(fd, data.data() + offset, data.size() - offset);
+    if (written == -1 && errno == EINTR) {
+      continue;
+    }
+    if (written == -1) {
+      result = -errno;
+      break;
+    }
+    offset += size_t(written);
+    result = int(offset);
+  }
+  if (durable && result >= 0 && fdatasync(fd) == -1) {
+    result = -errno;
+  }
+  close(fd);
+  return result;
+}
+
+void UringFileWriter::EventHandlerProc(void *uringFileWriter_clientData,
+                                       int mask) {
+  if (uringFileWriter_clientData) {
+    auto *pWriter = static_cast<UringFileWriter *>(uringFileWriter_clientData);
+    eventfd_t count{0};
+    eventfd_read(pWriter->eventFd_, &count);
+    pWriter->Reap();
+  }
+}
+
+} // namespace callback
+
+#endif // __linux__
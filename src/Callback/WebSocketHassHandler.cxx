@@ -0,0 +1,359 @@
+#include "Logger.h"
+#include "WindowsWrapper.h"
+
+#include "Callback/WebSocketHassHandler.h"
+
+#include <algorithm>
+#include <array>
+#include <format>
+#include <iterator>
+#include <string_view>
+#include <vector>
+
+#include "Callback/Json.h"
+#include "Callback/SharedRegistry.h"
+
+using namespace std::chrono_literals;
+using namespace std::string_literals;
+using namespace std::string_view_literals;
+
+namespace {
+
+constexpr auto authTimeout{10s};
+constexpr auto pollInterval{50ms};
+constexpr auto keepAliveInterval{30s};
+
+std::string MessageType(const callback::json &msg) {
+  return msg.contains("type") && msg["type"].is_string()
+             ? msg["type"].template get<std::string>()
+             : ""s;
+}
+
+} // namespace
+
+namespace callback {
+
+std::shared_ptr<HassWebSocket>
+HassWebSocket::ForInstance(const boost::url &url, const std::string &token) {
+  static SharedRegistry<HassWebSocket, std::string> sockets;
+  return sockets.GetOrCreate(std::format("{} {}", url.c_str(), token), url,
+                             token);
+}
+
+HassWebSocket::HassWebSocket(const boost::url &url, const std::string &token)
+    : wsUrl_{url}, token_{token} {
+  wsUrl_.set_scheme(url.scheme() == "https"sv ? "wss"sv : "ws"sv);
+  if (std::string_view(wsUrl_.host().c_str()) == "supervisor"sv) {
+    wsUrl_.set_path("/core/websocket");
+  } else {
+    wsUrl_.set_path("/api/websocket");
+  }
+}
+
+HassWebSocket::~HassWebSocket() noexcept { updaterThread_ = {}; }
+
+void HassWebSocket::Start() {
+  // a failed first connection leaves the flag unset for the next caller
+  std::call_once(startFlag_, [this] {
+    Connect();
+    updaterThread_ = std::jthread(
+        [this](std::stop_token stopToken) { Run(std::move(stopToken)); });
+  });
+}
+
+void HassWebSocket::Add(WebSocketHassHandler *pHandler) {
+  std::scoped_lock lk(mtx_);
+  if (std::ranges::find(handlers_, pHandler) == handlers_.end()) {
+    handlers_.push_back(pHandler);
+  }
+}
+
+void HassWebSocket::Remove(WebSocketHassHandler *pHandler) {
+  std::scoped_lock lk(mtx_);
+  std::erase(handlers_, pHandler);
+  std::erase_if(pendingStates_, [pHandler](const auto &entry) {
+    return entry.second.first == pHandler;
+  });
+}
+
+void HassWebSocket::Notify() {
+  updatePending_ = true;
+  cv_.notify_all();
+}
+
+void HassWebSocket::Run(std::stop_token stopToken) {
+#ifdef _WIN32
+  SetThreadDescription(GetCurrentThread(),
+                       L"Home Assistant WebSocket Sensor Update Thread");
+#endif
+  sc::time_point lastActivity = sc::now();
+  std::chrono::seconds reconnectDelay{1};
+
+  while (!stopToken.stop_requested()) {
+    if (!connected_) {
+      {
+        std::unique_lock lk(mtx_);
+        cv_.wait_for(lk, stopToken, reconnectDelay, [] { return false; });
+      }
+      if (stopToken.stop_requested()) {
+        break;
+      }
+      try {
+        Connect();
+        ++reconnects_;
+        reconnectDelay = 1s;
+        lastActivity = sc::now();
+      } catch (const std::exception &e) {
+        reconnectDelay = std::min(reconnectDelay * 2, maxReconnectDelay);
+        LOGGER->warn("Home Assistant websocket at {} unavailable, retrying "
+                     "in {}s: {}",
+                     wsUrl_, reconnectDelay.count(), e.what());
+        continue;
+      }
+    }
+
+    // the messages are built under the lock and sent outside it
+    outgoing_.clear();
+    {
+      std::unique_lock lk(mtx_);
+      cv_.wait_for(lk, stopToken, pollInterval,
+                   [this] { return updatePending_; });
+      updatePending_ = false;
+
+      for (auto *pHandler : handlers_) {
+        if (auto state = pHandler->TakeUpdate()) {
+          const int64_t id = nextId_++;
+          std::format_to(
+              std::back_inserter(outgoing_.emplace_back()),
+              R"({{"id":{},"type":"fire_event","event_type":{},"event_data":{}}})",
+              id, json(pHandler->eventType).dump(), pHandler->stateBuf_);
+          pendingStates_[id] = {pHandler, *std::move(state)};
+        }
+      }
+    }
+
+    try {
+      while (auto msg = ReceiveMessage()) {
+        std::scoped_lock lk(mtx_);
+        HandleMessage(*msg);
+        lastActivity = sc::now();
+      }
+
+      for (const auto &message : outgoing_) {
+        SendText(message);
+      }
+      if (outgoing_.empty() && sc::now() - lastActivity > keepAliveInterval) {
+        // a ping answered with a pong keeps idle proxies from dropping us,
+        // one left unanswered means the connection is gone
+        if (pingOutstanding_) {
+          throw std::runtime_error("keep-alive ping was not answered");
+        }
+        int64_t id{0};
+        {
+          std::scoped_lock lk(mtx_);
+          id = nextId_++;
+        }
+        SendMessage({{"id", id}, {"type", "ping"}});
+        pingOutstanding_ = true;
+        lastActivity = sc::now();
+      }
+    } catch (const std::exception &e) {
+      LOGGER->warn("Home Assistant websocket at {} dropped: {}", wsUrl_,
+                   e.what());
+      Disconnect();
+    }
+  }
+  Disconnect();
+}
+
+void HassWebSocket::Connect() {
+  Disconnect();
+
+  wCurl_(curl_easy_setopt, CURLOPT_URL, wsUrl_.c_str());
+  wCurl_(curl_easy_setopt, CURLOPT_CONNECT_ONLY, 2L);
+  wCurl_(curl_easy_setopt, CURLOPT_CONNECTTIMEOUT_MS, 5000L);
+  wCurl_(curl_easy_setopt, CURLOPT_TCP_KEEPALIVE, 1L);
+  wCurl_(curl_easy_setopt, CURLOPT_TCP_KEEPIDLE, 30L);
+  wCurl_(curl_easy_setopt, CURLOPT_TCP_KEEPINTVL, 15L);
+  wCurl_(curl_easy_perform);
+
+  // Home Assistant opens with auth_required and answers the token with
+  // auth_ok, anything else means the token was rejected
+  const auto hello = WaitForMessage(authTimeout);
+  if (MessageType(hello) != "auth_required"sv) {
+    throw std::runtime_error(
+        std::format("Unexpected Home Assistant websocket greeting at {}: {}",
+                    wsUrl_.c_str(), hello.dump()));
+  }
+  SendMessage({{"type", "auth"}, {"access_token", token_}});
+  const auto reply = WaitForMessage(authTimeout);
+  if (MessageType(reply) != "auth_ok"sv) {
+    throw std::runtime_error(
+        std::format("Home Assistant websocket authentication at {} failed: {}",
+                    wsUrl_.c_str(), reply.dump()));
+  }
+
+  connected_ = true;
+  LOGGER->info("Connected to Home Assistant websocket at {}", wsUrl_);
+}
+
+void HassWebSocket::Disconnect() {
+  if (connected_) {
+    size_t sent{0};
+    curl_ws_send(wCurl_.pCurl_, "", 0, &sent, 0, CURLWS_CLOSE);
+  }
+  connected_ = false;
+  wCurl_ = util::CurlWrapper();
+  pingOutstanding_ = false;
+  recvBuf_.clear();
+
+  std::scoped_lock lk(mtx_);
+  nextId_ = 1;
+  pendingStates_.clear();
+  // anything unacknowledged is sent again on the next connection
+  for (auto *pHandler : handlers_) {
+    pHandler->lastSentState_.reset();
+  }
+}
+
+void HassWebSocket::SendMessage(const json &msg) {
+  sendBuf_ = msg.dump();
+  SendText(sendBuf_);
+}
+
+void HassWebSocket::SendText(std::string_view text) {
+  size_t offset{0};
+  const auto deadline = std::chrono::steady_clock::now() + authTimeout;
+  while (offset < text.size()) {
+    size_t sent{0};
+    const CURLcode res =
+        curl_ws_send(wCurl_.pCurl_, text.data() + offset,
+                     text.size() - offset, &sent, 0, CURLWS_TEXT);
+    offset += sent;
+    if (res == CURLE_AGAIN && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(1ms);
+    } else if (res != CURLE_OK) {
+      throw util::CurlWrapper::CurlError(
+          std::format("Home Assistant websocket send failed: {}",
+                      curl_easy_strerror(res)));
+    }
+  }
+}
+
+std::optional<json> HassWebSocket::ReceiveMessage() {
+  std::array<char, 4096> chunk;
+  for (;;) {
+    size_t received{0};
+    const curl_ws_frame *meta{nullptr};
+    const CURLcode res = curl_ws_recv(wCurl_.pCurl_, chunk.data(),
+                                      chunk.size(), &received, &meta);
+    if (res == CURLE_AGAIN) {
+      return std::nullopt;
+    }
+    if (res != CURLE_OK) {
+      throw util::CurlWrapper::CurlError(
+          std::format("Home Assistant websocket receive failed: {}",
+                      curl_easy_strerror(res)));
+    }
+    if (meta->flags & CURLWS_CLOSE) {
+      throw std::runtime_error("Home Assistant closed the websocket");
+    }
+    if (!(meta->flags & CURLWS_TEXT)) {
+      continue; // pings are answered by curl
+    }
+    recvBuf_.insert(recvBuf_.end(), chunk.data(), chunk.data() + received);
+    if (meta->bytesleft == 0 && !(meta->flags & CURLWS_CONT)) {
+      json msg = json::parse(recvBuf_);
+      recvBuf_.clear();
+      return msg;
+    }
+  }
+}
+
+json HassWebSocket::WaitForMessage(std::chrono::milliseconds timeout) {
+  const auto deadline = std::chrono::steady_clock::now() + timeout;
+  do {
+    if (auto msg = ReceiveMessage()) {
+      return *std::move(msg);
+    }
+    std::this_thread::sleep_for(5ms);
+  } while (std::chrono::steady_clock::now() < deadline);
+  throw std::runtime_error(std::format(
+      "Timed out waiting for Home Assistant websocket at {}", wsUrl_.c_str()));
+}
+
+void HassWebSocket::HandleMessage(const json &msg) {
+  const std::string type = MessageType(msg);
+  if (type == "pong"sv) {
+    pingOutstanding_ = false;
+    return;
+  }
+  if (type != "result"sv || !msg.contains("id")) {
+    return;
+  }
+  const auto it = pendingStates_.find(msg["id"].template get<int64_t>());
+  if (it == pendingStates_.end()) {
+    return;
+  }
+  const auto &[pHandler, state] = it->second;
+  pHandler->OnResult(msg, state);
+  pendingStates_.erase(it);
+}
+
+WebSocketHassHandler::WebSocketHassHandler(const boost::url &url,
+                                           const std::string &token,
+                                           const std::string &entityId)
+    : BaseHassHandler(url, token, entityId),
+      pSocket_{HassWebSocket::ForInstance(url, token)} {}
+
+WebSocketHassHandler::~WebSocketHassHandler() noexcept { Stop(); }
+
+void WebSocketHassHandler::Start() {
+  pSocket_->Start();
+  {
+    std::scoped_lock lk(pSocket_->GetMutex());
+    // Delay updating the state initially as the feed is still stabilizing
+    lastStateUpdate_ =
+        sc::now() +
+        std::chrono::duration_cast<std::chrono::seconds>(debounceTime);
+    started_ = true;
+  }
+  pSocket_->Add(this);
+}
+
+void WebSocketHassHandler::Stop() {
+  pSocket_->Remove(this);
+  std::scoped_lock lk(pSocket_->GetMutex());
+  started_ = false;
+}
+
+void WebSocketHassHandler::UpdateState_Impl(const HassState &state) {
+  std::scoped_lock lk(pSocket_->GetMutex());
+  UpdateStateInternal(state);
+  pSocket_->Notify();
+}
+
+std::optional<HassState> WebSocketHassHandler::TakeUpdate() {
+  const bool unsent = lastSentState_ != GetNextState();
+  const bool stateChanging = IsStateChanging() && unsent;
+  const bool debounce = (sc::now() - lastStateUpdate_ > debounceTime);
+  if (!started_ ||
+      !((stateChanging && debounce) || (IsStateBecomingUnknown() && unsent))) {
+    return std::nullopt;
+  }
+  SerializeState(GetNextState(), stateBuf_);
+  lastSentState_ = GetNextState();
+  lastStateUpdate_ = sc::now();
+  return lastSentState_;
+}
+
+void WebSocketHassHandler::OnResult(const json &msg, const HassState &state) {
+  if (msg.contains("success") && msg["success"].template get<bool>()) {
+    AcceptState(state);
+  } else {
+    LOGGER->error("Home Assistant rejected state for {}: {}", entityId,
+                  msg.contains("error") ? msg["error"].dump() : msg.dump());
+  }
+}
+
+} // namespace callback
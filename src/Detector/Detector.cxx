@@ -3,18 +3,21 @@
 namespace detector {
 
 RegionsOfInterest Detector::FeedFrame(video_source::Frame frame) {
+  Detect(frame);
+  Publish();
+  return rois_;
+}
+
+RegionsOfInterest Detector::Detect(video_source::Frame frame) {
   frame_ = frame;
-  if (!mask.empty()) {
-    cv::bitwise_and(frame.img, mask, maskedFrame_);
-    return FeedFrame_Impl(maskedFrame_);
-  }
   rois_ = FeedFrame_Impl(frame.img);
   return rois_;
 }
 
-void Detector::SetRois(RegionsOfInterest rois) {
-  rois_ = rois;
-  OnEvent({.frame = frame_, .mask = mask, .rois = rois});
+void Detector::Publish() {
+  OnEvent({.frame = frame_, .mask = mask, .rois = rois_});
 }
 
+void Detector::SetRois(RegionsOfInterest rois) { rois_ = rois; }
+
 } // namespace detector
\ No newline at end of file
@@ -0,0 +1,252 @@
+#include "Logger.h"
+#include "WindowsWrapper.h"
+
+#include "Detector/DetectorPool.h"
+
+#include <format>
+#include <stdexcept>
+
+#define JSON_USE_IMPLICIT_CONVERSIONS 0
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace detector {
+
+DetectorPool::Strand::Strand(DetectorPool &pool, size_t home,
+                             std::string name,
+                             std::shared_ptr<Detector> pDetector,
+                             std::shared_ptr<TaskScheduler> pSched)
+    : pool_{pool}, home_{home}, name_{std::move(name)},
+      pDetector_{std::move(pDetector)}, pSched_{std::move(pSched)} {
+  detectedTrigger_ = pSched_->createEventTrigger(Strand::DetectedProc);
+}
+
+DetectorPool::Strand::~Strand() noexcept {
+  pSched_->deleteEventTrigger(detectedTrigger_);
+}
+
+void DetectorPool::Strand::Post(video_source::Frame frame) {
+  if (pGate && !pGate->ShouldAnalyse(frame)) {
+    return;
+  }
+  // sources decode into buffers they reuse, the worker needs its own copy
+  frame.img = frame.img.clone();
+  bool submit{false};
+  {
+    std::scoped_lock lk(mtx_);
+    if (maxQueuedFrames > 0 && frames_.size() >= maxQueuedFrames) {
+      frames_.pop_front();
+      ++dropped_;
+      ++pool_.droppedFrames_;
+      --pool_.queuedFrames_;
+    }
+    frames_.push_back(std::move(frame));
+    ++pool_.queuedFrames_;
+    submit = !std::exchange(busy_, true);
+  }
+  if (submit) {
+    pool_.Submit(shared_from_this());
+  }
+}
+
+size_t DetectorPool::Strand::GetQueueDepth() const {
+  std::scoped_lock lk(mtx_);
+  return frames_.size();
+}
+
+size_t DetectorPool::Strand::GetDropped() const {
+  std::scoped_lock lk(mtx_);
+  return dropped_;
+}
+
+std::optional<std::chrono::microseconds>
+DetectorPool::Strand::GetLatency() const {
+  const auto latency = latency_.load();
+  return latency != std::chrono::microseconds::min() ? std::optional(latency)
+                                                     : std::nullopt;
+}
+
+void DetectorPool::Strand::RunOne() {
+  video_source::Frame frame;
+  {
+    std::scoped_lock lk(mtx_);
+    frame = std::move(frames_.front());
+    frames_.pop_front();
+  }
+  --pool_.queuedFrames_;
+
+  bool detected{false};
+  try {
+    if (prepare) {
+      prepare(*pDetector_, frame);
+    }
+    pDetector_->Detect(frame);
+    detected = true;
+    ++pool_.detectedFrames_;
+    analysedRate.Add(frame.GetStreamTime());
+    if (frame.synchronized) {
+      // negative when the camera's clock is ahead of ours
+      latency_ = std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now() - frame.GetCaptureTime());
+    }
+  } catch (const std::exception &e) {
+    LOGGER_RATE_LIMITED(std::chrono::seconds(5), spdlog::level::err,
+                        "Failed to detect motion on {}: {}", name_, e.what());
+  }
+  {
+    std::scoped_lock lk(mtx_);
+    detected_ = detected;
+    detectedAt_ = frame.timeStamp;
+  }
+  // the strand stays busy until the loop has published the result, the
+  // subscribers read the detector's buffers
+  pSched_->triggerEvent(detectedTrigger_, this);
+}
+
+void DetectorPool::Strand::DetectedProc(void *strand_clientData) {
+  if (strand_clientData) {
+    auto &strand = *static_cast<Strand *>(strand_clientData);
+    bool detected{false};
+    std::chrono::steady_clock::time_point detectedAt;
+    {
+      std::scoped_lock lk(strand.mtx_);
+      detected = std::exchange(strand.detected_, false);
+      detectedAt = strand.detectedAt_;
+    }
+    if (detected) {
+      strand.pDetector_->Publish();
+      if (strand.pGate) {
+        strand.pGate->OnResult(!strand.pDetector_->GetRois().empty(),
+                               detectedAt);
+      }
+    }
+    bool submit{false};
+    {
+      std::scoped_lock lk(strand.mtx_);
+      submit = !strand.frames_.empty();
+      strand.busy_ = submit;
+    }
+    if (submit) {
+      strand.pool_.Submit(strand.shared_from_this());
+    }
+  }
+}
+
+DetectorPool::DetectorPool(size_t threads) {
+  if (threads == 0) {
+    throw std::invalid_argument("A detector pool needs at least one thread");
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    workers_.push_back(std::make_unique<Worker>());
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    threads_.emplace_back([this, i](std::stop_token stopToken) {
+#ifdef _WIN32
+      const auto desc = std::format(L"Detector Thread {}", i);
+      SetThreadDescription(GetCurrentThread(), desc.c_str());
+#endif
+      Run(i, stopToken);
+    });
+  }
+}
+
+std::shared_ptr<DetectorPool::Strand>
+DetectorPool::MakeStrand(std::string name, std::shared_ptr<Detector> pDetector,
+                         std::shared_ptr<TaskScheduler> pSched) {
+  // spread the feeds' home workers, the model stays in that core's cache
+  // unless the strand is stolen
+  auto pStrand = std::make_shared<Strand>(*this, nextHome_++ % workers_.size(),
+                                          std::move(name), std::move(pDetector),
+                                          std::move(pSched));
+  std::scoped_lock lk(strandsMtx_);
+  strands_.push_back(pStrand);
+  return pStrand;
+}
+
+void DetectorPool::Submit(std::shared_ptr<Strand> pStrand) {
+  auto &worker = *workers_[pStrand->home_];
+  {
+    std::scoped_lock lk(worker.mtx);
+    worker.strands.push_back(std::move(pStrand));
+  }
+  {
+    std::scoped_lock lk(sleepMtx_);
+    ++ready_;
+  }
+  cv_.notify_one();
+}
+
+std::shared_ptr<DetectorPool::Strand> DetectorPool::Take(size_t index) {
+  std::shared_ptr<Strand> pStrand;
+  {
+    auto &own = *workers_[index];
+    std::scoped_lock lk(own.mtx);
+    if (!own.strands.empty()) {
+      pStrand = std::move(own.strands.front());
+      own.strands.pop_front();
+    }
+  }
+  // steal from the back, the strands its owner would reach last
+  for (size_t i = 1; !pStrand && i < workers_.size(); ++i) {
+    auto &victim = *workers_[(index + i) % workers_.size()];
+    std::scoped_lock lk(victim.mtx);
+    if (!victim.strands.empty()) {
+      pStrand = std::move(victim.strands.back());
+      victim.strands.pop_back();
+      ++stolen_;
+    }
+  }
+  if (pStrand) {
+    --ready_;
+  }
+  return pStrand;
+}
+
+void DetectorPool::Run(size_t index, std::stop_token stopToken) {
+  while (!stopToken.stop_requested()) {
+    if (auto pStrand = Take(index)) {
+      pStrand->RunOne();
+      continue;
+    }
+    std::unique_lock lk(sleepMtx_);
+    cv_.wait(lk, stopToken, [this] { return ready_ > 0; });
+  }
+}
+
+std::string DetectorPool::DumpStats() const {
+  json feeds = json::object();
+  {
+    std::scoped_lock lk(strandsMtx_);
+    for (const auto &wpStrand : strands_) {
+      if (const auto pStrand = wpStrand.lock()) {
+        json feed = {{"queued", pStrand->GetQueueDepth()},
+                     {"dropped", pStrand->GetDropped()},
+                     {"analysedRate", pStrand->analysedRate.GetSummary()}};
+        if (const auto latency = pStrand->GetLatency()) {
+          feed["latencyMs"] = latency->count() / 1000.0;
+        }
+        if (const auto &pGate = pStrand->pGate) {
+          feed["gate"] = {
+              {"state", pGate->GetState() == MotionGate::State::Idle
+                            ? "idle"
+                            : "active"},
+              {"analysed", pGate->GetAnalysed()},
+              {"skipped", pGate->GetSkipped()},
+              {"idleTransitions", pGate->GetIdleTransitions()},
+              {"activeTransitions", pGate->GetActiveTransitions()}};
+        }
+        feeds[pStrand->GetName()] = std::move(feed);
+      }
+    }
+  }
+  return json{{"threads", Size()},
+              {"queued", GetQueueDepth()},
+              {"detected", GetDetected()},
+              {"dropped", GetDropped()},
+              {"stolen", GetStolen()},
+              {"feeds", std::move(feeds)}}
+      .dump();
+}
+
+} // namespace detector
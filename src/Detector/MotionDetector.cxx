@@ -47,11 +47,19 @@ private:
 static void RoisFromModel(detector::Detector &detector,
                           std::vector<cv::Rect> &rois) {
 
+  thread_local cv::Mat masked;
   thread_local cv::Mat morph;
   thread_local std::vector<std::vector<cv::Point2i>> contours;
   thread_local std::vector<cv::Rect> contourBounds;
 
-  cv::morphologyEx(detector.GetModel(), morph, cv::MORPH_DILATE,
+  // one 8-bit plane at the analysed size, and the model itself is untouched
+  cv::Mat model = detector.GetModel();
+  if (!detector.mask.empty() && detector.mask.size() == model.size()) {
+    cv::bitwise_and(model, detector.mask, masked);
+    model = masked;
+  }
+
+  cv::morphologyEx(model, morph, cv::MORPH_DILATE,
                    cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5)));
 
   cv::findContours(morph, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
@@ -105,6 +113,7 @@ void BasicMotionDetector::ResetModel() {
   bgModel_ = cv::Mat();
   frameCount_ = 0;
   SetRois({});
+  Publish();
 }
 
 cv::Mat BasicMotionDetector::GetModel() { return bgModel_; }
@@ -115,7 +124,7 @@ MOGMotionDetector::MOGMotionDetector(Options options) : options{options} {
 
 std::span<const cv::Rect> MOGMotionDetector::FeedFrame_Impl(cv::Mat frame) {
   if (!pBgsegm_) {
-    ResetModel();
+    ResetModel_Impl();
   }
 
   fillOrSwapMonochrome(frame, monoFrame_);
@@ -129,7 +138,10 @@ std::span<const cv::Rect> MOGMotionDetector::FeedFrame_Impl(cv::Mat frame) {
   return GetRois();
 }
 
-void MOGMotionDetector::ResetModel() { ResetModel_Impl(); }
+void MOGMotionDetector::ResetModel() {
+  ResetModel_Impl();
+  Publish();
+}
 
 void MOGMotionDetector::ResetModel_Impl() {
   pBgsegm_ = cv::bgsegm::createBackgroundSubtractorMOG(
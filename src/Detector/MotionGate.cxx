@@ -0,0 +1,80 @@
+#include "Logger.h"
+
+#include "Detector/MotionGate.h"
+
+#include <algorithm>
+
+#include <opencv2/imgproc.hpp>
+
+namespace detector {
+
+MotionGate::MotionGate(Options options) : options{options} {}
+
+bool MotionGate::ShouldAnalyse(const video_source::Frame &frame) {
+  if (state_ == State::Active || frame.img.empty()) {
+    ++analysed_;
+    return true;
+  }
+
+  Downsample(frame.img);
+  if (reference_.empty() || ++sinceAnalysed_ >= options.idleStride ||
+      HasChanged()) {
+    std::swap(small_, reference_);
+    sinceAnalysed_ = 0;
+    ++analysed_;
+    return true;
+  }
+  ++skipped_;
+  return false;
+}
+
+void MotionGate::OnResult(bool motion,
+                          std::chrono::steady_clock::time_point timeStamp) {
+  if (motion || lastMotion_ == std::chrono::steady_clock::time_point{}) {
+    lastMotion_ = timeStamp;
+  }
+  if (motion && state_ == State::Idle) {
+    state_ = State::Active;
+    ++toActive_;
+    LOGGER->debug("Motion detected, analysing every frame");
+  } else if (!motion && state_ == State::Active &&
+             options.idleAfter.count() > 0 &&
+             timeStamp - lastMotion_ >= options.idleAfter) {
+    state_ = State::Idle;
+    ++toIdle_;
+    // the next frame becomes the reference
+    reference_ = cv::Mat();
+    sinceAnalysed_ = 0;
+    LOGGER->debug("No motion for {} ms, analysing every {} frames",
+                  options.idleAfter.count(), options.idleStride);
+  }
+}
+
+void MotionGate::Downsample(const cv::Mat &img) {
+  // an integer factor takes OpenCV's fast path for area resampling
+  const int factor = std::max(1, img.cols / std::max(1, options.precheckWidth));
+  thread_local cv::Mat resized;
+  cv::resize(img, resized, cv::Size(img.cols / factor, img.rows / factor), 0,
+             0, cv::INTER_AREA);
+  switch (resized.channels()) {
+  case 3:
+    cv::cvtColor(resized, small_, cv::COLOR_BGR2GRAY);
+    break;
+  case 4:
+    cv::cvtColor(resized, small_, cv::COLOR_BGRA2GRAY);
+    break;
+  default:
+    resized.copyTo(small_);
+  }
+}
+
+bool MotionGate::HasChanged() {
+  if (small_.size() != reference_.size()) {
+    return true;
+  }
+  cv::absdiff(small_, reference_, diff_);
+  cv::threshold(diff_, diff_, options.wakeLevel, 255, cv::THRESH_BINARY);
+  return cv::countNonZero(diff_) > diff_.total() * options.wakeFraction;
+}
+
+} // namespace detector
@@ -0,0 +1,34 @@
+#include "Detector/RoiMapper.h"
+
+#include <cmath>
+
+namespace detector {
+
+Payload RoiMapper::Map(const Payload &payload,
+                       const video_source::Frame &frame) {
+  if (frame.img.empty() || payload.frame.img.empty()) {
+    return payload;
+  }
+  const cv::Size from = payload.frame.img.size();
+  const cv::Size to = frame.img.size();
+  rois_.clear();
+  for (const auto &roi : payload.rois) {
+    rois_.push_back(Scale(roi, from, to));
+  }
+  return {.frame = frame, .mask = payload.mask, .rois = rois_};
+}
+
+cv::Rect RoiMapper::Scale(const cv::Rect &rect, cv::Size from, cv::Size to) {
+  if (from == to || from.empty()) {
+    return rect;
+  }
+  const double sx = double(to.width) / from.width;
+  const double sy = double(to.height) / from.height;
+  const int x0 = int(std::floor(rect.x * sx));
+  const int y0 = int(std::floor(rect.y * sy));
+  const int x1 = int(std::ceil((rect.x + rect.width) * sx));
+  const int y1 = int(std::ceil((rect.y + rect.height) * sy));
+  return cv::Rect(x0, y0, x1 - x0, y1 - y0) & cv::Rect(cv::Point(0, 0), to);
+}
+
+} // namespace detector
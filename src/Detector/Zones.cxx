@@ -0,0 +1,57 @@
+#include "Detector/Zones.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <opencv2/imgproc.hpp>
+
+namespace detector {
+
+Zones::Zones(std::vector<util::Zone> zones) : zones_{std::move(zones)} {}
+
+void Zones::Set(std::vector<util::Zone> zones) {
+  std::scoped_lock lk(mtx_);
+  zones_ = std::move(zones);
+  ++version_;
+}
+
+std::vector<util::Zone> Zones::Get() const {
+  std::scoped_lock lk(mtx_);
+  return zones_;
+}
+
+cv::Mat Zones::Rasterise(cv::Size size) const {
+  std::scoped_lock lk(mtx_);
+  if (zones_.empty() || size.empty()) {
+    return {};
+  }
+
+  const auto polygon = [size](const util::Zone &zone) {
+    std::vector<cv::Point> points;
+    points.reserve(zone.points.size());
+    for (const auto &[x, y] : zone.points) {
+      points.emplace_back(int(std::lround(x * size.width)),
+                          int(std::lround(y * size.height)));
+    }
+    return points;
+  };
+  const auto fill = [&polygon](cv::Mat &mask, util::Zone::Kind kind,
+                               uchar value) {
+    for (const auto &zone : zones_) {
+      if (zone.kind == kind) {
+        cv::fillPoly(mask, std::vector{polygon(zone)}, cv::Scalar(value));
+      }
+    }
+  };
+
+  // without an include zone the whole frame is included
+  const bool hasInclude = std::ranges::any_of(zones_, [](const auto &zone) {
+    return zone.kind == util::Zone::Kind::Include;
+  });
+  cv::Mat mask(size, CV_8UC1, cv::Scalar(hasInclude ? 0 : 0xFF));
+  fill(mask, util::Zone::Kind::Include, 0xFF);
+  fill(mask, util::Zone::Kind::Exclude, 0);
+  return mask;
+}
+
+} // namespace detector
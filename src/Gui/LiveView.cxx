@@ -0,0 +1,25 @@
+#include "Gui/LiveView.h"
+
+#include <utility>
+
+namespace gui {
+
+LiveView::LiveView(std::shared_ptr<WebHandler> pWebHandler,
+                   std::string_view feedId)
+    : pWebHandler_{std::move(pWebHandler)}, feedId_{feedId} {}
+
+void LiveView::OnDetection(detector::RegionsOfInterest rois,
+                           const cv::Mat &model) {
+  rois_.assign(rois.begin(), rois.end());
+  model.copyTo(model_);
+}
+
+void LiveView::OnFrame(video_source::Frame frame, double fps) {
+  (*pWebHandler_)({.rois = rois_,
+                   .frame = std::move(frame),
+                   .detail = model_,
+                   .fps = fps,
+                   .feedId = feedId_});
+}
+
+} // namespace gui
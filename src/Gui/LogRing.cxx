@@ -0,0 +1,71 @@
+#include "Gui/LogRing.h"
+
+#include <algorithm>
+#include <bit>
+
+namespace gui {
+
+LogRing::LogRing(size_t capacity)
+    : slots_(std::bit_ceil(std::max<size_t>(capacity, 2))),
+      mask_{slots_.size() - 1} {
+  for (size_t i = 0; i < slots_.size(); ++i) {
+    slots_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+bool LogRing::Push(const spdlog::details::log_msg &msg) {
+  // a slot is free for position pos when its sequence is pos, and holds a
+  // record for the reader when it is pos + 1
+  size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+  Slot *pSlot{nullptr};
+  while (true) {
+    pSlot = &slots_[pos & mask_];
+    const size_t sequence = pSlot->sequence.load(std::memory_order_acquire);
+    const auto diff = static_cast<std::ptrdiff_t>(sequence) -
+                      static_cast<std::ptrdiff_t>(pos);
+    if (diff == 0) {
+      if (enqueuePos_.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      ++dropped_;
+      return false;
+    } else {
+      pos = enqueuePos_.load(std::memory_order_relaxed);
+    }
+  }
+  pSlot->record.level = msg.level;
+  pSlot->record.time = msg.time;
+  // reuses the capacity left by earlier records in this slot
+  pSlot->record.payload.assign(msg.payload.data(), msg.payload.size());
+  pSlot->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+size_t LogRing::Drain(const std::function<void(const Record &)> &fn,
+                      size_t maxRecords) {
+  size_t drained{0};
+  while (drained < maxRecords) {
+    Slot &slot = slots_[dequeuePos_ & mask_];
+    if (slot.sequence.load(std::memory_order_acquire) != dequeuePos_ + 1) {
+      break;
+    }
+    fn(slot.record);
+    slot.sequence.store(dequeuePos_ + slots_.size(), std::memory_order_release);
+    ++dequeuePos_;
+    ++drained;
+  }
+  return drained;
+}
+
+LogRingSink::LogRingSink(std::shared_ptr<LogRing> pRing)
+    : pRing_{std::move(pRing)} {}
+
+void LogRingSink::log(const spdlog::details::log_msg &msg) {
+  if (should_log(msg.level)) {
+    pRing_->Push(msg);
+  }
+}
+
+} // namespace gui
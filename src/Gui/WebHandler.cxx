@@ -4,8 +4,15 @@
 
 #include "Gui/WebHandler.h"
 
+#include <algorithm>
+#include <array>
 #include <barrier>
+#include <charconv>
+#include <cstring>
+#include <format>
 #include <iostream>
+#include <mutex>
+#include <optional>
 
 #define JSON_USE_IMPLICIT_CONVERSIONS 0
 #include <nlohmann/json.hpp>
@@ -19,22 +26,44 @@ using json = nlohmann::json;
 
 namespace {
 
-static std::atomic_bool broadcastLogs{false};
-static struct mg_mgr *pMgr{nullptr};
-static unsigned long parentConnId{0};
-
 static std::shared_mutex feedMappingMtx;
 static std::unordered_map<std::string_view, std::filesystem::path>
     savedFilesPath;
+static std::unordered_map<std::string_view,
+                          std::shared_ptr<const util::MediaCatalog>>
+    savedFilesCatalog;
+static std::function<std::string()> storageUsageProvider;
+static std::function<std::string()> detectorStatsProvider;
+static std::unordered_map<std::string_view, std::shared_ptr<detector::Zones>>
+    feedZones;
 static std::unordered_map<std::string_view, char> feedIds;
 static std::atomic_char feedMarker{1};
 
+// logs are queued by the logging threads and sent in batches by the listener
+static constexpr size_t logRingCapacity{4096};
+static constexpr unsigned logBatchIntervalMs{100};
+static constexpr size_t maxLogBatch{512};
+// a client further behind than this misses batches until it catches up
+static constexpr size_t maxLogBacklog{1 << 20};
+
 static constexpr const char *mjpegHeaders =
     "HTTP/1.0 200 OK\r\n"
     "Cache-Control: no-cache\r\n"
     "Pragma: no-cache\r\n"
     "Content-Type: multipart/x-mixed-replace; boundary=--boundary\r\n\r\n";
 
+// a WebSocket connection keeps its log level in data[1] and the count of log
+// lines it has missed since its last batch in data[4..7]
+uint32_t GetLogLinesMissed(const mg_connection *c) {
+  uint32_t missed{0};
+  std::memcpy(&missed, c->data + 4, sizeof(missed));
+  return missed;
+}
+
+void SetLogLinesMissed(mg_connection *c, uint32_t missed) {
+  std::memcpy(c->data + 4, &missed, sizeof(missed));
+}
+
 char SafeGetFeedId(mg_str &cap) {
   std::shared_lock lk(feedMappingMtx);
   const auto it = feedIds.find({cap.buf, cap.len});
@@ -44,6 +73,103 @@ char SafeGetFeedId(mg_str &cap) {
   return 0;
 }
 
+template <typename T>
+std::optional<T> GetQueryVar(const mg_http_message *hm, const char *name) {
+  std::array<char, 32> buf{};
+  if (mg_http_get_var(&hm->query, name, buf.data(), buf.size()) <= 0) {
+    return std::nullopt;
+  }
+  T value{};
+  const auto *end = buf.data() + std::strlen(buf.data());
+  const auto [ptr, ec] = std::from_chars(buf.data(), end, value);
+  if (ec != std::errc{} || ptr != end) {
+    return std::nullopt;
+  }
+  return value;
+}
+
+void ReplyZones(mg_connection *c, const mg_http_message *hm,
+                std::string_view feedId, detector::Zones &zones) {
+  if (mg_strcmp(hm->method, mg_str("PUT")) == 0) {
+    try {
+      zones.Set(json::parse(hm->body.buf, hm->body.buf + hm->body.len)
+                    .template get<std::vector<util::Zone>>());
+    } catch (const std::exception &e) {
+      mg_http_reply(c, 400, "", "Invalid Zones: %s", e.what());
+      return;
+    }
+    LOGGER->info("Updated the zones of {}", feedId);
+  } else if (mg_strcmp(hm->method, mg_str("GET")) != 0) {
+    mg_http_reply(c, 405, "Allow: GET, PUT\r\n", "Method Not Allowed");
+    return;
+  }
+  mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s",
+                json(zones.Get()).dump().c_str());
+}
+
+void ReplyCatalogPage(mg_connection *c, const mg_http_message *hm,
+                      std::string_view slug,
+                      const util::MediaCatalog &catalog) {
+  using namespace std::chrono;
+  constexpr size_t defaultLimit{50};
+  constexpr size_t maxLimit{500};
+
+  const auto toTimePoint = [](std::optional<int64_t> ms) {
+    return ms ? std::optional(system_clock::time_point(milliseconds(*ms)))
+              : std::nullopt;
+  };
+  const auto page = catalog.Query(
+      toTimePoint(GetQueryVar<int64_t>(hm, "from")),
+      toTimePoint(GetQueryVar<int64_t>(hm, "to")),
+      GetQueryVar<uint64_t>(hm, "before"),
+      std::min(GetQueryVar<size_t>(hm, "limit").value_or(defaultLimit),
+               maxLimit));
+
+  json entries = json::array();
+  for (const auto &entry : page.entries) {
+    entries.push_back(
+        {{"id", entry.id},
+         {"timestamp",
+          duration_cast<milliseconds>(entry.timeStamp.time_since_epoch())
+              .count()},
+         {"path",
+          std::format("/media/saved/{}/{}", slug, entry.path.generic_string())},
+         {"thumbnail",
+          std::format("/media/thumbs/{}/{}", slug,
+                      entry.path.filename().generic_string())},
+         {"size", entry.size},
+         {"rois", entry.roiCount},
+         {"bounds", entry.roiBounds},
+         {"captureTime",
+          entry.captureTime != system_clock::time_point{}
+              ? json(duration_cast<milliseconds>(
+                         entry.captureTime.time_since_epoch())
+                         .count())
+              : json(nullptr)}});
+  }
+  const json reply{{"entries", std::move(entries)},
+                   {"next", page.next ? json(*page.next) : json(nullptr)},
+                   {"total", page.total}};
+  mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s",
+                reply.dump().c_str());
+}
+
+void ToBgr(const cv::Mat &src, cv::Mat &dst) {
+  switch (src.channels()) {
+  case 1:
+    cv::cvtColor(src, dst, cv::COLOR_GRAY2BGR);
+    break;
+  case 3:
+    src.copyTo(dst);
+    break;
+  case 4:
+    cv::cvtColor(src, dst, cv::COLOR_BGRA2BGR);
+    break;
+  default:
+    throw std::invalid_argument("Frame must be BGR, BGRA, or Monochrome");
+  }
+}
+
 } // namespace
 
 namespace gui {
@@ -51,6 +177,7 @@ namespace gui {
 void WebHandler::BroadcastMjpegFrame(
     gui::WebHandler::BroadcastMap *broadcastMap) {
 
+  std::shared_lock mapLk(feedMappingMtx);
   for (const auto &imageData : *broadcastMap | std::views::values) {
     std::array<BroadcastImageData *, 2> ds{&imageData->imageBroadcastData_,
                                            &imageData->modelBroadcastData_};
@@ -86,20 +213,17 @@ void WebHandler::BroadcastImage_TimerCallback(void *arg) {
 // HTTP server event handler function
 void WebHandler::EventHandler(mg_connection *c, int ev, void *ev_data) {
   switch (ev) {
-  case MG_EV_OPEN:
-    if (c->is_listening) {
-      pMgr = c->mgr;
-      parentConnId = c->id;
-      broadcastLogs = true;
-    }
-    break;
   case MG_EV_HTTP_MSG: {
     struct mg_http_message *hm = static_cast<mg_http_message *>(ev_data);
     struct mg_str cap[2] = {mg_str(""), mg_str("")};
 
     if (mg_match(hm->uri, mg_str("/media/feeds"), nullptr)) {
       json feeds = json::array();
-      std::ranges::copy(feedIds | std::views::keys, std::back_inserter(feeds));
+      {
+        std::shared_lock lk(feedMappingMtx);
+        std::ranges::copy(feedIds | std::views::keys,
+                          std::back_inserter(feeds));
+      }
       mg_http_reply(c, 200, "Content-Type: application/json\r\n",
                     feeds.dump().c_str());
     } else if (mg_match(hm->uri, mg_str("/media/live/*"), cap)) {
@@ -113,6 +237,70 @@ void WebHandler::EventHandler(mg_connection *c, int ev, void *ev_data) {
     } else if (mg_match(hm->uri, mg_str("/websocket"), nullptr)) {
       mg_ws_upgrade(c, hm, nullptr);
       c->data[0] = 'W';
+      c->data[1] = static_cast<char>(spdlog::level::trace);
+      SetLogLinesMissed(c, 0);
+    } else if (mg_match(hm->uri, mg_str("/media/storage"), nullptr)) {
+      std::function<std::string()> provider;
+      if (std::shared_lock lk(feedMappingMtx); storageUsageProvider) {
+        provider = storageUsageProvider;
+      }
+      if (!provider) {
+        mg_http_reply(c, 404, "", "Storage Usage Not Available");
+        return;
+      }
+      mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s",
+                    provider().c_str());
+    } else if (mg_match(hm->uri, mg_str("/media/detector"), nullptr)) {
+      // called under the lock, so clearing the provider waits for the call
+      std::string stats;
+      if (std::shared_lock lk(feedMappingMtx); detectorStatsProvider) {
+        stats = detectorStatsProvider();
+      }
+      if (stats.empty()) {
+        mg_http_reply(c, 404, "", "Detector Statistics Not Available");
+        return;
+      }
+      mg_http_reply(c, 200, "Content-Type: application/json\r\n", "%s",
+                    stats.c_str());
+    } else if (mg_match(hm->uri, mg_str("/media/zones/*"), cap)) {
+      const std::string_view feedId(cap[0].buf, cap[0].len);
+      std::shared_ptr<detector::Zones> pZones;
+      if (std::shared_lock lk(feedMappingMtx); feedZones.contains(feedId)) {
+        pZones = feedZones.at(feedId);
+      }
+      if (!pZones) {
+        mg_http_reply(c, 404, "", "Feed Zones Not Found");
+        return;
+      }
+      ReplyZones(c, hm, feedId, *pZones);
+    } else if (mg_match(hm->uri, mg_str("/media/catalog/*"), cap)) {
+      const std::string_view slug(cap[0].buf, cap[0].len);
+      std::shared_ptr<const util::MediaCatalog> pCatalog;
+      if (std::shared_lock lk(feedMappingMtx);
+          savedFilesCatalog.contains(slug)) {
+        pCatalog = savedFilesCatalog.at(slug);
+      }
+      if (!pCatalog) {
+        mg_http_reply(c, 404, "", "Saved Media Catalog Not Found");
+        return;
+      }
+      ReplyCatalogPage(c, hm, slug, *pCatalog);
+    } else if (mg_match(hm->uri, mg_str("/media/thumbs/*/*"), cap)) {
+      const std::string_view slug(cap[0].buf, cap[0].len);
+      std::filesystem::path thumbnailPath;
+      if (std::shared_lock lk(feedMappingMtx); savedFilesPath.contains(slug)) {
+        thumbnailPath = util::MediaCatalog::ThumbnailPath(
+            savedFilesPath.at(slug) / std::string_view(cap[1].buf, cap[1].len));
+      }
+      if (thumbnailPath.empty()) {
+        mg_http_reply(c, 404, "", "Saved Media Slug Not Found");
+        return;
+      }
+      struct mg_http_serve_opts opts;
+      memset(&opts, 0, sizeof(opts));
+      // thumbnails never change once written
+      opts.extra_headers = "Cache-Control: max-age=86400\r\n";
+      mg_http_serve_file(c, hm, thumbnailPath.string().c_str(), &opts);
     } else if (mg_match(hm->uri, mg_str("/media/saved/*/*"), cap)) {
       const auto &cSavedFilesPath = savedFilesPath;
       const std::string_view savedFilesSlug(cap[0].buf, cap[0].len);
@@ -132,7 +320,8 @@ void WebHandler::EventHandler(mg_connection *c, int ev, void *ev_data) {
       } else {
         pathStr =
             (cSavedFilesPath.at(savedFilesSlug) / savedFilesPath).string();
-        opts.mime_types = "jpg=image/jpg";
+        // clips are fetched in ranges as they are played
+        opts.mime_types = "jpg=image/jpg,mp4=video/mp4";
         mg_http_serve_file(c, hm, pathStr.c_str(), &opts);
       }
     } else {
@@ -152,12 +341,15 @@ void WebHandler::EventHandler(mg_connection *c, int ev, void *ev_data) {
       mg_http_serve_dir(c, hm, &opts);
     }
   } break;
-  case MG_EV_WAKEUP: {
-    const std::string_view msg = *((std::string_view *)ev_data);
-    for (mg_connection *wc = c->mgr->conns; wc != nullptr; wc = wc->next) {
-      if (wc->data[0] == 'W') {
-        mg_ws_send(wc, msg.data(), msg.size(), WEBSOCKET_OP_TEXT);
-      }
+  case MG_EV_WS_MSG: {
+    // clients choose the lowest level of the log lines sent to them
+    const auto *wm = static_cast<mg_ws_message *>(ev_data);
+    const auto request =
+        json::parse(wm->data.buf, wm->data.buf + wm->data.len, nullptr, false);
+    if (request.is_object() && request.contains("level") &&
+        request["level"].is_string()) {
+      c->data[1] = static_cast<char>(spdlog::level::from_str(
+          request["level"].template get<std::string>()));
     }
   } break;
   }
@@ -168,7 +360,100 @@ void WebHandler::SetSavedFilesServePath(
   savedFilesPath[slug] = _savedFilesPath;
 }
 
-WebHandler::WebHandler(int port, std::string_view host) {
+void WebHandler::SetSavedFilesCatalog(
+    std::string_view slug, std::shared_ptr<const util::MediaCatalog> pCatalog) {
+  std::scoped_lock lk(feedMappingMtx);
+  savedFilesCatalog[slug] = std::move(pCatalog);
+}
+
+void WebHandler::SetStorageUsageProvider(
+    std::function<std::string()> provider) {
+  std::scoped_lock lk(feedMappingMtx);
+  storageUsageProvider = std::move(provider);
+}
+
+void WebHandler::SetDetectorStatsProvider(
+    std::function<std::string()> provider) {
+  std::scoped_lock lk(feedMappingMtx);
+  detectorStatsProvider = std::move(provider);
+}
+
+void WebHandler::SetZones(std::string_view feedId,
+                          std::shared_ptr<detector::Zones> pZones) {
+  std::scoped_lock lk(feedMappingMtx);
+  feedZones[feedId] = std::move(pZones);
+}
+
+void WebHandler::BroadcastLogs_TimerCallback(void *arg) {
+  if (arg) {
+    static_cast<WebHandler *>(arg)->BroadcastLogs();
+  }
+}
+
+void WebHandler::BroadcastLogs() {
+  // each line is serialized once, whatever the levels of the clients
+  logLines_.clear();
+  pLogRing_->Drain(
+      [this](const LogRing::Record &record) {
+        const std::string_view level(
+            spdlog::level::to_string_view(record.level));
+        logLines_.emplace_back(
+            record.level, json{{"level", level},
+                               {"payload", record.payload},
+                               {"timestamp", std::format("{}", record.time)}}
+                              .dump());
+      },
+      maxLogBatch);
+  const size_t dropped = pLogRing_->GetDropped();
+  const auto newlyDropped = static_cast<uint32_t>(dropped - logLinesDropped_);
+  logLinesDropped_ = dropped;
+  if (logLines_.empty() && newlyDropped == 0) {
+    return;
+  }
+
+  const auto countFrom = [this](spdlog::level::level_enum level) {
+    return static_cast<uint32_t>(
+        std::ranges::count_if(logLines_, [level](const auto &line) {
+          return line.first >= level;
+        }));
+  };
+  std::array<std::optional<std::string>, spdlog::level::n_levels> batches;
+  for (mg_connection *c = mgr_.conns; c != nullptr; c = c->next) {
+    if (c->data[0] != 'W') {
+      continue;
+    }
+    const auto level = static_cast<spdlog::level::level_enum>(
+        std::clamp<int>(c->data[1], 0, spdlog::level::n_levels - 1));
+    uint32_t missed = GetLogLinesMissed(c) + newlyDropped;
+    if (c->send.len > maxLogBacklog) {
+      SetLogLinesMissed(c, missed + countFrom(level));
+      continue;
+    }
+    auto &batch = batches[level];
+    if (!batch) {
+      batch = "[";
+      for (const auto &[lineLevel, line] : logLines_) {
+        if (lineLevel >= level) {
+          if (batch->size() > 1) {
+            batch->push_back(',');
+          }
+          batch->append(line);
+        }
+      }
+      batch->push_back(']');
+    }
+    if (batch->size() == 2 && missed == 0) {
+      continue;
+    }
+    const auto msg =
+        std::format(R"({{"logs":{},"dropped":{}}})", *batch, missed);
+    mg_ws_send(c, msg.data(), msg.size(), WEBSOCKET_OP_TEXT);
+    SetLogLinesMissed(c, 0);
+  }
+}
+
+WebHandler::WebHandler(int port, std::string_view host)
+    : pLogRing_{std::make_shared<LogRing>(logRingCapacity)} {
   url_.set_scheme("http");
   url_.set_host(host);
   url_.set_port_number(port);
@@ -186,7 +471,8 @@ void WebHandler::Start() {
     mg_mgr_init(&mgr_);
     mg_timer_add(&mgr_, 33, MG_TIMER_REPEAT, BroadcastImage_TimerCallback,
                  &feedImageDataMap_);
-    mg_wakeup_init(&mgr_);
+    mg_timer_add(&mgr_, logBatchIntervalMs, MG_TIMER_REPEAT,
+                 BroadcastLogs_TimerCallback, this);
     mg_http_listen(&mgr_, url_.c_str(), EventHandler, nullptr);
     bool dropBar{true};
     while (!stopToken.stop_requested()) {
@@ -200,82 +486,69 @@ void WebHandler::Start() {
   });
 
   sync.arrive_and_wait();
-  auto pWebsocketSink = std::make_shared<spdlog::sinks::callback_sink_mt>(
-      [this](const spdlog::details::log_msg &msg) {
-        thread_local json wsMsg = {};
-        thread_local std::string dumped;
-
-        wsMsg["log"] = {};
-
-        wsMsg["log"]["level"] =
-            std::string_view(spdlog::level::to_string_view(msg.level));
-        wsMsg["log"]["payload"] = std::string_view(msg.payload);
-        wsMsg["log"]["timestamp"] = std::format("{}", msg.time);
-        dumped = wsMsg.dump();
-
-        if (broadcastLogs) {
-          mg_wakeup(pMgr, parentConnId, dumped.data(), dumped.size());
-        }
-      });
+  // logging threads only append to the ring, they never touch mongoose
+  auto pWebsocketSink = std::make_shared<LogRingSink>(pLogRing_);
 
   LOGGER->debug("Initializing WebSocket sink");
-  LOGGER->sinks().push_back(pWebsocketSink);
+  logger::AddConsoleSink(pWebsocketSink);
 }
 
 void WebHandler::Stop() { listenerThread_ = {}; }
 
 const boost::url &WebHandler::GetUrl() const noexcept { return url_; }
 
-void WebHandler::operator()(Payload data) {
-
-  if (!feedIds.contains(data.feedId) ||
-      !feedImageDataMap_.contains(data.feedId)) {
-    std::scoped_lock lk(feedMappingMtx);
-    if (feedMarker < 0) {
-      // maximum feeds of 128, log an error and early exit
-      static bool warnOnce{false};
-      if (!warnOnce) {
-        LOGGER->warn("Maximum feed count reached, cannot add {}", data.feedId);
-      }
-      return;
-    }
-    const char thisFeedMarker = feedMarker;
+WebHandler::FeedImageData *WebHandler::GetOrAddFeed(std::string_view feedId) {
+  if (std::shared_lock lk(feedMappingMtx);
+      feedIds.contains(feedId) && feedImageDataMap_.contains(feedId)) {
+    return feedImageDataMap_.at(feedId).get();
+  }
 
-    const auto [feedIdIt, didInsert_feedId] =
-        feedIds.insert({data.feedId, thisFeedMarker});
-    if (didInsert_feedId) {
-      ++feedMarker;
-    }
-    auto [feedDataIt, didInsert_feedData] = feedImageDataMap_.insert(
-        {data.feedId, std::make_unique<FeedImageData>(&mgr_)});
-    if (!didInsert_feedData) {
-      throw std::runtime_error(
-          std::format("Failed to add feed data with ID {}", thisFeedMarker));
-    } else {
-      feedDataIt->second->imageBroadcastData_.marker[1] = thisFeedMarker;
-      feedDataIt->second->modelBroadcastData_.marker[1] = thisFeedMarker;
-    }
+  std::scoped_lock lk(feedMappingMtx);
+  if (const auto it = feedImageDataMap_.find(feedId);
+      it != feedImageDataMap_.end()) {
+    // added by another loop between the locks
+    return it->second.get();
+  }
+  if (feedMarker < 0) {
+    // maximum feeds of 128, log an error once and early exit
+    static std::once_flag warnOnce;
+    std::call_once(warnOnce, [feedId] {
+      LOGGER->warn("Maximum feed count reached, cannot add {}", feedId);
+    });
+    return nullptr;
+  }
+  const char thisFeedMarker = feedMarker;
 
-    LOGGER->info("Feed {} available at Web GUI", data.feedId);
+  const auto [feedIdIt, didInsert_feedId] =
+      feedIds.insert({feedId, thisFeedMarker});
+  if (didInsert_feedId) {
+    ++feedMarker;
+  }
+  auto [feedDataIt, didInsert_feedData] = feedImageDataMap_.insert(
+      {feedId, std::make_unique<FeedImageData>(&mgr_)});
+  if (!didInsert_feedData) {
+    throw std::runtime_error(
+        std::format("Failed to add feed data with ID {}", thisFeedMarker));
   }
+  feedDataIt->second->imageBroadcastData_.marker[1] = feedIdIt->second;
+  feedDataIt->second->modelBroadcastData_.marker[1] = feedIdIt->second;
+
+  LOGGER->info("Feed {} available at Web GUI", feedId);
+  return feedDataIt->second.get();
+}
+
+void WebHandler::operator()(Payload data) {
 
-  auto &fi = feedImageDataMap_.at(data.feedId);
+  FeedImageData *fi = GetOrAddFeed(data.feedId);
+  if (!fi) {
+    return;
+  }
   if (!data.frame.img.empty()) {
-    switch (data.frame.img.channels()) {
-    case 1:
-      cv::cvtColor(data.frame.img, fi->imageBgr_, cv::COLOR_GRAY2BGR);
-      cv::cvtColor(data.detail, fi->modelBgr_, cv::COLOR_GRAY2BGR);
-      break;
-    case 3:
-      data.frame.img.copyTo(fi->imageBgr_);
-      data.detail.copyTo(fi->modelBgr_);
-      break;
-    case 4:
-      cv::cvtColor(data.frame.img, fi->imageBgr_, cv::COLOR_BGRA2BGR);
-      cv::cvtColor(data.detail, fi->modelBgr_, cv::COLOR_BGRA2BGR);
-      break;
-    default:
-      throw std::invalid_argument("Frame must be BGR, BGRA, or Monochrome");
+    ToBgr(data.frame.img, fi->imageBgr_);
+    // there is no model until the first detection has finished
+    const bool hasModel = !data.detail.empty();
+    if (hasModel) {
+      ToBgr(data.detail, fi->modelBgr_);
     }
 
     for (const auto &bbox : data.rois) {
@@ -288,17 +561,19 @@ void WebHandler::operator()(Payload data) {
         std::isnormal(data.fps) ? std::format(" | FPS: {:.1f}", data.fps) : "");
     cv::Point2i anchor{int(fi->imageBgr_.cols * 0.05),
                        int(fi->imageBgr_.rows * 0.05)};
+    if (auto lk = std::unique_lock(fi->imageMtx_)) {
+      cv::imencode(".jpg", fi->imageBgr_, fi->imageJpeg_);
+      std::swap(fi->imageJpeg_, fi->imageBroadcastData_.jpgBuf);
+    }
+    if (!hasModel) {
+      return;
+    }
     cv::putText(fi->modelBgr_, txt, anchor,
                 cv::HersheyFonts::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0x00),
                 3);
     cv::putText(fi->modelBgr_, txt, anchor,
                 cv::HersheyFonts::FONT_HERSHEY_SIMPLEX, 0.5,
                 cv::Scalar(0x00, 0xFF, 0xFF), 1);
-
-    if (auto lk = std::unique_lock(fi->imageMtx_)) {
-      cv::imencode(".jpg", fi->imageBgr_, fi->imageJpeg_);
-      std::swap(fi->imageJpeg_, fi->imageBroadcastData_.jpgBuf);
-    }
     if (auto lk = std::unique_lock(fi->modelMtx_)) {
       cv::imencode(".jpg", fi->modelBgr_, fi->modelJpeg_);
       std::swap(fi->modelJpeg_, fi->modelBroadcastData_.jpgBuf);
@@ -1,19 +1,82 @@
+// Keeps the most recent log lines and only puts the visible ones in the page,
+// so a burst of logs costs the same as a quiet period
+class LogView {
+  constructor(element, maxLines = 5000) {
+    this.element = element;
+    this.spacer = element.querySelector(".log-spacer");
+    this.rows = element.querySelector(".log-rows");
+    this.maxLines = maxLines;
+    this.lines = [];
+    this.pending = false;
+    this.follow = false;
+    this.lineHeight = 0;
+    element.addEventListener("scroll", () => this.schedule());
+  }
+
+  append(lines) {
+    const atBottom = this.element.scrollTop + this.element.clientHeight >=
+                     this.element.scrollHeight - 2;
+    this.lines.push(...lines);
+    if (this.lines.length > this.maxLines) {
+      this.lines.splice(0, this.lines.length - this.maxLines);
+    }
+    this.follow = atBottom;
+    this.schedule();
+  }
+
+  schedule() {
+    if (!this.pending) {
+      this.pending = true;
+      window.requestAnimationFrame(() => this.render());
+    }
+  }
+
+  render() {
+    this.pending = false;
+    if (this.lineHeight == 0) {
+      this.rows.textContent = "X";
+      this.lineHeight = this.rows.getBoundingClientRect().height || 16;
+    }
+    this.spacer.style.height = `${this.lines.length * this.lineHeight}px`;
+    if (this.follow) {
+      this.element.scrollTop = this.element.scrollHeight;
+      this.follow = false;
+    }
+    const first = Math.floor(this.element.scrollTop / this.lineHeight);
+    const count = Math.ceil(this.element.clientHeight / this.lineHeight) + 1;
+    this.rows.style.top = `${first * this.lineHeight}px`;
+    // textContent, the payloads are not markup
+    this.rows.textContent = this.lines.slice(first, first + count).join("\n");
+  }
+}
+
 window.addEventListener("load", (event) => {
   const queryString = window.location.search;
   const urlParams = new URLSearchParams(queryString);
   const feed = urlParams.get("feedId");
 
+  const logView = new LogView(document.getElementById("logs"));
+  const levelSelector = document.getElementById("log-level");
+  const droppedElement = document.getElementById("log-dropped");
+  let dropped = 0;
+
   var ws = new WebSocket("/websocket");
 
+  const sendLevel = () => {
+    ws.send(JSON.stringify({level : levelSelector.value}));
+  };
+  ws.onopen = sendLevel;
+  levelSelector.onchange = sendLevel;
+
   ws.onmessage = (event) => {
-    const logElement = document.getElementById("logs");
     let data = JSON.parse(event.data);
-    if ("log" in data) {
-      logElement.innerHTML += "\n";
-      logElement.innerHTML += data.log.timestamp;
-      logElement.innerHTML += "[" + data.log.level + "]";
-      logElement.innerHTML += data.log.payload;
-      logElement.scrollTop = logElement.scrollHeight;
+    if ("logs" in data) {
+      logView.append(data.logs.map(
+          (log) => `${log.timestamp}[${log.level}]${log.payload}`));
+    }
+    if (data.dropped > 0) {
+      dropped += data.dropped;
+      droppedElement.textContent = `${dropped} lines dropped`;
     }
   };
 
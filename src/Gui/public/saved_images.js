@@ -2,113 +2,98 @@ window.addEventListener("load", (event) => {
   const queryString = window.location.search;
   const urlParams = new URLSearchParams(queryString);
 
-  const page = urlParams.get("page") || 0;
+  const before = urlParams.get("before");
   const imgsPerPage = urlParams.get("imgsPerPage") || 20;
   const feed = urlParams.get("feedId") || "";
 
-  const directoryPath = `/media/saved/${feed}/`;
   const gallery = document.getElementById("gallery");
 
-  fetch(directoryPath)
+  // the catalog pages newest first, each page names the cursor for the next
+  let catalogPath = `/media/catalog/${feed}?limit=${imgsPerPage}`;
+  if (before) {
+    catalogPath += `&before=${before}`;
+  }
+
+  fetch(catalogPath)
       .then((response) => {
         if (!response.ok) {
           throw new Error("Failed to get saved images list");
         }
-        return response.text();
+        return response.json();
       })
       .then((data) => {
-        const parser = new DOMParser();
-        const doc = parser.parseFromString(data, "text/html");
-
-        const linkElements = doc.querySelectorAll("a");
-
-        const links = [];
-        linkElements.forEach((element) => {
-          if (element.href.endsWith(".jpg")) {
-            links.push({
-              src : directoryPath + element.href.split("/").pop(),
-              alt : element.href,
-            });
-          }
-        });
-
-        insertPageLinks(links);
+        insertPageLinks(data.next);
         const totalImageCount = document.getElementById("total-image-count");
-        if (links.length > 0) {
-          totalImageCount.innerHTML = `(${links.length})`;
+        if (data.total > 0) {
+          totalImageCount.innerHTML = `(${data.total})`;
         }
 
-        links.sort().reverse();
-
-        let inGallery =
-            page > 0 ? links.slice((page - 1) * imgsPerPage, page * imgsPerPage)
-                     : links;
-        inGallery.forEach((link, idx) => {
+        data.entries.forEach((entry, idx) => {
+          if (entry.path.endsWith(".mp4")) {
+            const videoElement = document.createElement("video");
+            videoElement.src = entry.path;
+            videoElement.poster = entry.thumbnail;
+            videoElement.controls = true;
+            videoElement.muted = true;
+            videoElement.preload = "none";
+            videoElement.id = `saved-image-${idx + 1}`;
+            gallery.appendChild(videoElement);
+            return;
+          }
+          // show the thumbnail and link to the full size image
+          const linkElement = document.createElement("a");
+          linkElement.href = entry.path;
           const imgElement = document.createElement("img");
-          imgElement.src = link.src;
-          imgElement.alt = link.alt;
+          imgElement.src = entry.thumbnail;
+          imgElement.loading = "lazy";
+          imgElement.onerror = () => {
+            imgElement.onerror = null;
+            imgElement.src = entry.path;
+          };
+          imgElement.alt = new Date(entry.timestamp).toLocaleString();
           imgElement.id = `saved-image-${idx + 1}`;
-          gallery.appendChild(imgElement);
+          linkElement.appendChild(imgElement);
+          gallery.appendChild(linkElement);
         });
       });
 
   document.getElementById("go-home").href = `/?feedId=${feed}`;
 
-  const insertPageLinks = (links) => {
-    const pageCount = Math.ceil(links.length / imgsPerPage);
+  const insertPageLinks = (next) => {
     const pageList = document.getElementById("page-list");
 
-    if (pageCount > 1 && page != 1) {
-      const prevElement = document.createElement("li");
+    if (before) {
+      const firstElement = document.createElement("li");
       const linkElement = document.createElement("a");
-      linkElement.href = `?page=${page - 1}&imgsPerPage=${imgsPerPage}`;
+      linkElement.href = `?imgsPerPage=${imgsPerPage}&feedId=${feed}`;
       const span1Element = document.createElement("span");
       span1Element.setAttribute("aria-hidden", "true");
-      span1Element.innerHTML =
-          "&laquo;"; // Use a left arrow for the previous link
+      span1Element.innerHTML = "&laquo;"; // Use a left arrow for the newest
       const span2Element = document.createElement("span");
       span2Element.classList.add("visuallyhidden");
-      span2Element.innerHTML = "previous page";
+      span2Element.innerHTML = "newest";
       linkElement.appendChild(span1Element);
       linkElement.appendChild(span2Element);
-      prevElement.appendChild(linkElement);
-      pageList.appendChild(prevElement);
-    }
-
-    for (let i = 1; i <= pageCount; i++) {
-      const pageElement = document.createElement("li");
-      const linkElement = document.createElement("a");
-      linkElement.href = `?page=${i}&imgsPerPage=${imgsPerPage}&feedId=${feed}`;
-      if (i == page) {
-        linkElement.ariaCurrent =
-            "page"; // Set aria-current for the current page
-      }
-      linkElement.innerHTML = i;
-      const span1Element = document.createElement("span");
-      span1Element.classList.add("visuallyhidden");
-      span1Element.innerHTML =
-          "page"; // Use a right arrow for the previous link
-      linkElement.appendChild(span1Element);
-      pageElement.appendChild(linkElement);
-      pageList.appendChild(pageElement);
+      firstElement.appendChild(linkElement);
+      pageList.appendChild(firstElement);
     }
 
-    if (pageCount > 1 && page != pageCount) {
+    if (next !== null) {
       const nextElement = document.createElement("li");
       const linkElement = document.createElement("a");
       linkElement.href =
-          `?page=${page + 1}&imgsPerPage=${imgsPerPage}&feedId=${feed}`;
+          `?before=${next}&imgsPerPage=${imgsPerPage}&feedId=${feed}`;
       const span1Element = document.createElement("span");
       span1Element.setAttribute("aria-hidden", "true");
       span1Element.innerHTML =
-          "&raquo;"; // Use a right arrow for the previous link
+          "&raquo;"; // Use a right arrow for the next link
       const span2Element = document.createElement("span");
       span2Element.classList.add("visuallyhidden");
-      span2Element.innerHTML = "next page";
+      span2Element.innerHTML = "older";
       linkElement.appendChild(span1Element);
       linkElement.appendChild(span2Element);
       nextElement.appendChild(linkElement);
       pageList.appendChild(nextElement);
     }
   };
-});
\ No newline at end of file
+});
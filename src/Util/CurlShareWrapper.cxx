@@ -0,0 +1,46 @@
+#include "Util/CurlShareWrapper.h"
+
+#include <mutex>
+
+namespace {
+static std::once_flag curlGlobalFlag;
+}
+
+namespace util {
+
+CurlShareWrapper::CurlShareWrapper() noexcept {
+  std::call_once(curlGlobalFlag, curl_global_init, CURL_GLOBAL_ALL);
+  pCurl_ = curl_share_init();
+  if (pCurl_) {
+    curl_share_setopt(pCurl_, CURLSHOPT_LOCKFUNC, LockCallback);
+    curl_share_setopt(pCurl_, CURLSHOPT_UNLOCKFUNC, UnlockCallback);
+    curl_share_setopt(pCurl_, CURLSHOPT_USERDATA, this);
+  }
+}
+
+CurlShareWrapper::~CurlShareWrapper() noexcept {
+  if (pCurl_) {
+    // fails with CURLSHE_IN_USE if an easy handle still references the share,
+    // which only happens at process exit, so the handle is leaked in that case
+    curl_share_cleanup(pCurl_);
+  }
+}
+
+void CurlShareWrapper::LockCallback(CURL *, curl_lock_data data,
+                                    curl_lock_access,
+                                    void *curlShareWrapper_userPtr) {
+  if (curlShareWrapper_userPtr && data < CURL_LOCK_DATA_LAST) {
+    auto *pShare = static_cast<CurlShareWrapper *>(curlShareWrapper_userPtr);
+    pShare->mtxs_[data].lock();
+  }
+}
+
+void CurlShareWrapper::UnlockCallback(CURL *, curl_lock_data data,
+                                      void *curlShareWrapper_userPtr) {
+  if (curlShareWrapper_userPtr && data < CURL_LOCK_DATA_LAST) {
+    auto *pShare = static_cast<CurlShareWrapper *>(curlShareWrapper_userPtr);
+    pShare->mtxs_[data].unlock();
+  }
+}
+
+} // namespace util
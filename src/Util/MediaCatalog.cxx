@@ -0,0 +1,256 @@
+#include "Logger.h"
+
+#include "Util/MediaCatalog.h"
+
+#include <mutex>
+#include <ranges>
+#include <unordered_set>
+
+#define JSON_USE_IMPLICIT_CONVERSIONS 0
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace {
+using namespace std::chrono;
+
+[[nodiscard]] bool IsMedia(const std::filesystem::path &path) {
+  const auto ext = path.extension();
+  return ext == ".jpg" || ext == ".mp4" || ext == ".h264";
+}
+
+[[nodiscard]] int64_t ToMillis(system_clock::time_point tp) {
+  return duration_cast<milliseconds>(tp.time_since_epoch()).count();
+}
+} // namespace
+
+namespace util {
+
+MediaCatalog::MediaCatalog(const std::filesystem::path &directory)
+    : directory_{directory} {}
+
+void MediaCatalog::Load() {
+  std::unique_lock lk(mtx_);
+  entries_.clear();
+  idsByPath_.clear();
+  tombstones_ = 0;
+  index_.close();
+
+  const auto indexPath = directory_ / indexFileName;
+  if (std::ifstream ifs(indexPath); ifs) {
+    size_t lineNo{0};
+    for (std::string line; std::getline(ifs, line);) {
+      ++lineNo;
+      if (line.empty()) {
+        continue;
+      }
+      try {
+        const auto j = json::parse(line);
+        if (j.contains("del")) {
+          const auto id = j["del"].template get<uint64_t>();
+          if (const auto it = entries_.find(id); it != entries_.end()) {
+            idsByPath_.erase(it->second.path.generic_string());
+            entries_.erase(it);
+          }
+          ++tombstones_;
+          continue;
+        }
+        Entry entry{
+            .id = j["id"].template get<uint64_t>(),
+            .timeStamp = system_clock::time_point(
+                milliseconds(j["t"].template get<int64_t>())),
+            .path = j["path"].template get<std::string>(),
+            .size = j["size"].template get<uintmax_t>(),
+            .roiCount = j["rois"].template get<uint32_t>(),
+            .roiBounds = j["bounds"].template get<std::array<int, 4>>(),
+            .captureTime = system_clock::time_point(
+                milliseconds(j.value("ct", int64_t{0})))};
+        nextId_ = std::max(nextId_, entry.id + 1);
+        Insert(std::move(entry));
+      } catch (const std::exception &e) {
+        // most likely the last line of an interrupted write
+        LOGGER->warn("Skipping line {} of {}: {}", lineNo, indexPath, e.what());
+      }
+    }
+  }
+
+  // one pass over the directory finds what changed while not running
+  std::unordered_set<std::string> onDisk;
+  std::vector<Entry> added;
+  std::error_code ec;
+  for (const auto &dirEntry :
+       std::filesystem::directory_iterator(directory_, ec)) {
+    if (!dirEntry.is_regular_file(ec) || !IsMedia(dirEntry.path())) {
+      continue;
+    }
+    auto relPath = dirEntry.path().filename();
+    onDisk.insert(relPath.generic_string());
+    if (idsByPath_.contains(relPath.generic_string())) {
+      continue;
+    }
+    added.push_back(
+        {.timeStamp = time_point_cast<system_clock::duration>(
+             clock_cast<system_clock>(dirEntry.last_write_time(ec))),
+         .path = std::move(relPath),
+         .size = dirEntry.file_size(ec)});
+  }
+  std::vector<uint64_t> missing;
+  for (const auto &[id, entry] : entries_) {
+    if (!onDisk.contains(entry.path.generic_string())) {
+      missing.push_back(id);
+    }
+  }
+
+  index_.open(indexPath, std::ios::app | std::ios::binary);
+  if (!index_) {
+    LOGGER->error("Failed to open media index {}", indexPath);
+  }
+
+  for (const auto id : missing) {
+    idsByPath_.erase(entries_.at(id).path.generic_string());
+    entries_.erase(id);
+    AppendLine(json{{"del", id}}.dump());
+    ++tombstones_;
+  }
+  std::ranges::sort(added, {}, &Entry::timeStamp);
+  for (auto &entry : added) {
+    entry.id = nextId_++;
+    AppendLine(Serialize(entry));
+    Insert(std::move(entry));
+  }
+  if (tombstones_ > entries_.size()) {
+    Compact();
+  }
+
+  LOGGER->info("Media index {} has {} entries ({} added, {} removed)",
+               indexPath, entries_.size(), added.size(), missing.size());
+}
+
+uint64_t MediaCatalog::Add(Entry entry) {
+  std::unique_lock lk(mtx_);
+  // replacing a file keeps a single entry for it
+  if (const auto it = idsByPath_.find(entry.path.generic_string());
+      it != idsByPath_.end()) {
+    AppendLine(json{{"del", it->second}}.dump());
+    ++tombstones_;
+    entries_.erase(it->second);
+    idsByPath_.erase(it);
+  }
+  entry.id = nextId_++;
+  AppendLine(Serialize(entry));
+  const auto id = entry.id;
+  Insert(std::move(entry));
+  return id;
+}
+
+bool MediaCatalog::Remove(const std::filesystem::path &path) {
+  std::unique_lock lk(mtx_);
+  const auto it = idsByPath_.find(path.generic_string());
+  if (it == idsByPath_.end()) {
+    return false;
+  }
+  AppendLine(json{{"del", it->second}}.dump());
+  ++tombstones_;
+  entries_.erase(it->second);
+  idsByPath_.erase(it);
+  if (tombstones_ > entries_.size() && tombstones_ > 1000) {
+    Compact();
+  }
+  return true;
+}
+
+MediaCatalog::Page
+MediaCatalog::Query(std::optional<system_clock::time_point> from,
+                    std::optional<system_clock::time_point> to,
+                    std::optional<uint64_t> before, size_t limit) const {
+  std::shared_lock lk(mtx_);
+  Page page{.total = entries_.size()};
+  if (limit == 0) {
+    return page;
+  }
+  auto it = before ? entries_.lower_bound(*before) : entries_.end();
+  while (it != entries_.begin()) {
+    const auto &entry = (--it)->second;
+    if ((from && entry.timeStamp < *from) || (to && entry.timeStamp > *to)) {
+      continue;
+    }
+    if (page.entries.size() == limit) {
+      page.next = page.entries.back().id;
+      break;
+    }
+    page.entries.push_back(entry);
+  }
+  return page;
+}
+
+std::vector<MediaCatalog::Entry> MediaCatalog::GetEntries() const {
+  std::shared_lock lk(mtx_);
+  auto values = entries_ | std::views::values;
+  return {values.begin(), values.end()};
+}
+
+size_t MediaCatalog::Size() const {
+  std::shared_lock lk(mtx_);
+  return entries_.size();
+}
+
+void MediaCatalog::Insert(Entry entry) {
+  idsByPath_[entry.path.generic_string()] = entry.id;
+  entries_[entry.id] = std::move(entry);
+}
+
+void MediaCatalog::AppendLine(const std::string &line) {
+  if (index_) {
+    index_ << line << '\n';
+    index_.flush();
+  }
+}
+
+void MediaCatalog::Compact() {
+  const auto indexPath = directory_ / indexFileName;
+  auto tmpPath = indexPath;
+  tmpPath += ".tmp";
+  {
+    std::ofstream ofs(tmpPath, std::ios::trunc | std::ios::binary);
+    for (const auto &entry : entries_ | std::views::values) {
+      ofs << Serialize(entry) << '\n';
+    }
+    if (!ofs) {
+      LOGGER->warn("Failed to compact media index {}", indexPath);
+      return;
+    }
+  }
+  index_.close();
+  std::error_code ec;
+  std::filesystem::rename(tmpPath, indexPath, ec);
+  if (ec) {
+    LOGGER->warn("Failed to replace media index {}: {}", indexPath,
+                 ec.message());
+  } else {
+    tombstones_ = 0;
+  }
+  index_.open(indexPath, std::ios::app | std::ios::binary);
+}
+
+std::filesystem::path
+MediaCatalog::ThumbnailPath(const std::filesystem::path &path) {
+  // keep the extension in the name, a clip and a snapshot can share a stem
+  auto thumbnailName = path.filename();
+  thumbnailName += ".jpg";
+  return path.parent_path() / thumbnailDirName / thumbnailName;
+}
+
+std::string MediaCatalog::Serialize(const Entry &entry) {
+  json j{{"id", entry.id},
+         {"t", ToMillis(entry.timeStamp)},
+         {"path", entry.path.generic_string()},
+         {"size", entry.size},
+         {"rois", entry.roiCount},
+         {"bounds", entry.roiBounds}};
+  if (entry.captureTime != system_clock::time_point{}) {
+    j["ct"] = ToMillis(entry.captureTime);
+  }
+  return j.dump();
+}
+
+} // namespace util
@@ -3,12 +3,15 @@
 
 #include "Util/ProgramOptions.h"
 
+#include <algorithm>
 #include <cstdlib>
+#include <format>
 #include <fstream>
 #include <iostream>
 #include <sstream>
 #include <string_view>
 
+#include <boost/algorithm/string/case_conv.hpp>
 #include <boost/program_options.hpp>
 #define JSON_USE_IMPLICIT_CONVERSIONS 0
 #include <nlohmann/json.hpp>
@@ -19,6 +22,34 @@ namespace po = boost::program_options;
 
 namespace util {
 
+void to_json(nlohmann::json &j, const Zone &zone) {
+  j = {{"type", zone.kind == Zone::Kind::Exclude ? "exclude" : "include"},
+       {"points", zone.points}};
+}
+
+void from_json(const nlohmann::json &j, Zone &zone) {
+  const auto type = j.value("type", "include"s);
+  if (type == "include"sv) {
+    zone.kind = Zone::Kind::Include;
+  } else if (type == "exclude"sv) {
+    zone.kind = Zone::Kind::Exclude;
+  } else {
+    throw std::invalid_argument(std::format("Unknown zone type '{}'", type));
+  }
+  zone.points = j.at("points").template get<decltype(zone.points)>();
+  if (zone.points.size() < 3) {
+    throw std::invalid_argument("A zone needs at least 3 points");
+  }
+  for (const auto &[x, y] : zone.points) {
+    if (x < 0.0 || x > 1.0 || y < 0.0 || y > 1.0) {
+      throw std::invalid_argument(std::format(
+          "Zone point ({}, {}) is off the frame, coordinates are fractions "
+          "of its width and height",
+          x, y));
+    }
+  }
+}
+
 std::variant<ProgramOptions, std::string>
 ProgramOptions::ParseOptions(int argc, const char **argv) {
   /*
@@ -58,9 +89,38 @@ ProgramOptions::ParseOptions(int argc, const char **argv) {
        "Home Assistant URL to send detector updates")
       /**/
       ("hass-token,t", po::value<std::string>()->default_value(""),
-       "Home Assistant long-lived access token for API auth");
+       "Home Assistant long-lived access token for API auth")
+      /**/
+      ("hass-http2",
+       po::value<bool>()->default_value(false)->implicit_value(true),
+       "multiplex Home Assistant updates over a single HTTP/2 connection, the "
+       "server must support HTTP/2")
+      /**/
+      ("hass-batch-window", po::value<int>()->default_value(0),
+       "maximum milliseconds to hold a state change so updates from all feeds "
+       "are sent together, 0 sends each update immediately")
+      /**/
+      ("hass-websocket",
+       po::value<bool>()->default_value(false)->implicit_value(true),
+       "publish state changes as motion_detection_state events over a "
+       "persistent websocket instead of REST updates");
   allOptions.add(homeAssistantOptions);
 
+  /*
+   * Runtime Options
+   */
+  po::options_description runtimeOptions("Runtime Options");
+  runtimeOptions.add_options()
+      /**/
+      ("event-loop-threads", po::value<int>()->default_value(0),
+       "number of event loops to spread feeds over, each on its own thread, "
+       "0 uses one per core up to one per feed")
+      /**/
+      ("detector-threads", po::value<int>()->default_value(0),
+       "number of threads shared by all feeds for motion detection, 0 uses "
+       "one per core");
+  allOptions.add(runtimeOptions);
+
   /*
    * Web User-Interface Options
    */
@@ -84,7 +144,15 @@ ProgramOptions::ParseOptions(int argc, const char **argv) {
       /**/
       ("save-destination", po::value<std::string>()->default_value(""),
        "destination to save the motion detection video files to, if empty, "
-       "video saving is disabled");
+       "video saving is disabled")
+      /**/
+      ("save-max-megabytes", po::value<int>()->default_value(0),
+       "maximum megabytes of saved media across all feeds, the oldest files "
+       "are deleted first, 0 for no limit")
+      /**/
+      ("save-max-age-hours", po::value<int>()->default_value(0),
+       "delete saved media older than this many hours, 0 to keep it until "
+       "another limit is reached");
   allOptions.add(detectionOptions);
 
   po::variables_map vm;
@@ -96,9 +164,19 @@ ProgramOptions::ParseOptions(int argc, const char **argv) {
         static const std::map<std::string, std::string, std::less<>>
             envVarToProgOpts{{"MODET_HASS_URL"s, "hass-url"s},
                              {"MODET_HASS_TOKEN"s, "hass-token"},
+                             {"MODET_HASS_HTTP2"s, "hass-http2"s},
+                             {"MODET_HASS_BATCH_WINDOW"s, "hass-batch-window"s},
+                             {"MODET_HASS_WEBSOCKET"s, "hass-websocket"s},
+                             {"MODET_EVENT_LOOP_THREADS"s,
+                              "event-loop-threads"s},
+                             {"MODET_DETECTOR_THREADS"s, "detector-threads"s},
                              {"MODET_WEB_UI_HOST"s, "web-ui-host"s},
                              {"MODET_WEB_UI_PORT"s, "web-ui-port"s},
-                             {"MODET_SAVE_DESTINATION"s, "save-destination"s}};
+                             {"MODET_SAVE_DESTINATION"s, "save-destination"s},
+                             {"MODET_SAVE_MAX_MEGABYTES"s,
+                              "save-max-megabytes"s},
+                             {"MODET_SAVE_MAX_AGE_HOURS"s,
+                              "save-max-age-hours"s}};
         const auto it = envVarToProgOpts.find(envVar);
         return it != envVarToProgOpts.end() ? it->second : ""s;
       });
@@ -131,11 +209,25 @@ ProgramOptions::ParseOptions(int argc, const char **argv) {
 
     options.hassUrl = boost::url(vm["hass-url"].as<std::string>());
     options.hassToken = vm["hass-token"].as<std::string>();
+    options.hassHttp2 = vm["hass-http2"].as<bool>();
+    options.hassBatchWindow =
+        std::chrono::milliseconds(vm["hass-batch-window"].as<int>());
+    options.hassWebSocket = vm["hass-websocket"].as<bool>();
+
+    options.eventLoopThreads =
+        size_t(std::max(vm["event-loop-threads"].as<int>(), 0));
+    options.detectorThreads =
+        size_t(std::max(vm["detector-threads"].as<int>(), 0));
 
     options.webUiHost = vm["web-ui-host"].as<std::string>();
     options.webUiPort = vm["web-ui-port"].as<int>();
 
     options.saveDestination = vm["save-destination"].as<std::string>();
+    options.saveMaxBytes =
+        uintmax_t(std::max(vm["save-max-megabytes"].as<int>(), 0)) * 1024 *
+        1024;
+    options.saveMaxAge =
+        std::chrono::hours(std::max(vm["save-max-age-hours"].as<int>(), 0));
 
   } catch (const std::exception &e) {
     std::ostringstream oss;
@@ -173,6 +265,47 @@ auto _ParseJson(const nlohmann::json &json)
       feedOpts.sourcePassword =
           value["sourcePassword"].template get<std::string>();
     }
+    if (value.contains("rtspTransport")) {
+      auto transport = value["rtspTransport"].template get<std::string>();
+      boost::algorithm::to_lower(transport);
+      if (transport == "udp"sv || transport == "tcp"sv ||
+          transport == "auto"sv) {
+        feedOpts.rtspTransport = std::move(transport);
+      } else {
+        LOGGER->error("Invalid rtspTransport '{}' for key '{}', using {}",
+                      transport, key, feedOpts.rtspTransport);
+      }
+    }
+    if (value.contains("rtspSocketBufferKb")) {
+      feedOpts.rtspSocketBufferSize =
+          value["rtspSocketBufferKb"].template get<unsigned>() * 1024;
+    }
+    if (value.contains("rtspReorderThresholdMs")) {
+      feedOpts.rtspReorderThreshold = std::chrono::milliseconds{
+          value["rtspReorderThresholdMs"].template get<int>()};
+    }
+    if (value.contains("decoder")) {
+      auto decoder = value["decoder"].template get<std::string>();
+      boost::algorithm::to_lower(decoder);
+      if (decoder == "auto"sv || decoder == "openh264"sv ||
+          decoder == "ffmpeg"sv || decoder == "libavcodec"sv) {
+        feedOpts.decoder = std::move(decoder);
+      } else {
+        LOGGER->error("Invalid decoder '{}' for key '{}', using {}", decoder,
+                      key, feedOpts.decoder);
+      }
+    }
+    if (value.contains("decoderThreads")) {
+      feedOpts.decoderThreads = value["decoderThreads"].template get<int>();
+    }
+    if (value.contains("decoderSkipNonReference")) {
+      feedOpts.decoderSkipNonReference =
+          value["decoderSkipNonReference"].template get<bool>();
+    }
+    if (value.contains("decoderSkipLoopFilter")) {
+      feedOpts.decoderSkipLoopFilter =
+          value["decoderSkipLoopFilter"].template get<bool>();
+    }
     if (value.contains("hassEntityId")) {
       feedOpts.hassEntityId = value["hassEntityId"].template get<std::string>();
     }
@@ -193,10 +326,33 @@ auto _ParseJson(const nlohmann::json &json)
         feedOpts.detectionSize = value["detectionSize"].template get<int>();
       }
     }
+    if (value.contains("detectionSourceUrl")) {
+      feedOpts.detectionSourceUrl =
+          boost::url(value["detectionSourceUrl"].template get<std::string>());
+    }
+    if (value.contains("detectionWidth")) {
+      feedOpts.detectionWidth = value["detectionWidth"].template get<int>();
+    }
     if (value.contains("detectionDebounce")) {
       feedOpts.detectionDebounce =
           std::chrono::seconds{value["detectionDebounce"].template get<int>()};
     }
+    if (value.contains("detectionIdleAfter")) {
+      feedOpts.detectionIdleAfter =
+          std::chrono::seconds{value["detectionIdleAfter"].template get<int>()};
+    }
+    if (value.contains("detectionIdleStride")) {
+      feedOpts.detectionIdleStride =
+          value["detectionIdleStride"].template get<size_t>();
+    }
+    if (value.contains("zones")) {
+      try {
+        feedOpts.zones = value["zones"].template get<std::vector<Zone>>();
+      } catch (const std::exception &e) {
+        LOGGER->error("Invalid zones for key '{}', using the default: {}", key,
+                      e.what());
+      }
+    }
     if (value.contains("saveSourceUrl")) {
       feedOpts.saveSourceUrl =
           boost::url(value["saveSourceUrl"].template get<std::string>());
@@ -204,6 +360,36 @@ auto _ParseJson(const nlohmann::json &json)
     if (value.contains("saveImageLimit")) {
       feedOpts.saveImageLimit = value["saveImageLimit"].template get<size_t>();
     }
+    if (value.contains("saveMaxMegabytes")) {
+      feedOpts.saveMaxBytes =
+          value["saveMaxMegabytes"].template get<uintmax_t>() * 1024 * 1024;
+    }
+    if (value.contains("saveMaxAgeHours")) {
+      feedOpts.saveMaxAge =
+          std::chrono::hours{value["saveMaxAgeHours"].template get<int>()};
+    }
+    if (value.contains("saveDetectionFrame")) {
+      feedOpts.saveDetectionFrame =
+          value["saveDetectionFrame"].template get<bool>();
+    }
+    if (value.contains("saveDrawRois")) {
+      feedOpts.saveDrawRois = value["saveDrawRois"].template get<bool>();
+    }
+    if (value.contains("saveThumbnailWidth")) {
+      feedOpts.saveThumbnailWidth =
+          value["saveThumbnailWidth"].template get<int>();
+    }
+    if (value.contains("saveClips")) {
+      feedOpts.saveClips = value["saveClips"].template get<bool>();
+    }
+    if (value.contains("clipPreRoll")) {
+      feedOpts.clipPreRoll =
+          std::chrono::seconds{value["clipPreRoll"].template get<int>()};
+    }
+    if (value.contains("clipPostRoll")) {
+      feedOpts.clipPostRoll =
+          std::chrono::seconds{value["clipPostRoll"].template get<int>()};
+    }
     res[key] = std::move(feedOpts);
   }
 
@@ -229,7 +415,9 @@ bool ProgramOptions::CanSetupHass(const FeedOptions &feedOpts) const {
 }
 
 bool ProgramOptions::CanSetupFileSave(const FeedOptions &feedOpts) const {
-  return !saveDestination.empty() && !feedOpts.saveSourceUrl.empty();
+  return !saveDestination.empty() &&
+         (!feedOpts.saveSourceUrl.empty() || feedOpts.saveDetectionFrame ||
+          feedOpts.saveClips);
 }
 
 } // namespace util
\ No newline at end of file
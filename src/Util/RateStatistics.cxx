@@ -0,0 +1,97 @@
+#include "Util/RateStatistics.h"
+
+#include <algorithm>
+#include <cmath>
+
+#define JSON_USE_IMPLICIT_CONVERSIONS 0
+#include <nlohmann/json.hpp>
+
+namespace util {
+
+RateStatistics::RateStatistics(Duration window, size_t maxSamples)
+    : window{window}, maxSamples{std::max<size_t>(maxSamples, 2)} {}
+
+void RateStatistics::Add(Duration timeStamp) {
+  std::scoped_lock lk(mtx_);
+  if (!timeStamps_.empty() && timeStamp < timeStamps_.back()) {
+    if (timeStamps_.back() - timeStamp > window) {
+      timeStamps_.clear();
+      timeStamps_.push_back(timeStamp);
+    } else {
+      timeStamps_.insert(std::ranges::upper_bound(timeStamps_, timeStamp),
+                         timeStamp);
+    }
+  } else {
+    timeStamps_.push_back(timeStamp);
+  }
+  while (timeStamps_.size() > maxSamples ||
+         timeStamps_.back() - timeStamps_.front() > window) {
+    timeStamps_.pop_front();
+  }
+}
+
+void RateStatistics::Reset() {
+  std::scoped_lock lk(mtx_);
+  timeStamps_.clear();
+}
+
+double RateStatistics::GetRate() const {
+  std::scoped_lock lk(mtx_);
+  return GetRate_Impl();
+}
+
+double RateStatistics::GetRate_Impl() const {
+  if (timeStamps_.size() < 2) {
+    return 0.0;
+  }
+  const auto span = std::chrono::duration_cast<std::chrono::duration<double>>(
+      timeStamps_.back() - timeStamps_.front());
+  return span.count() > 0.0 ? (timeStamps_.size() - 1) / span.count() : 0.0;
+}
+
+auto RateStatistics::GetSummary() const -> Summary {
+  std::scoped_lock lk(mtx_);
+  Summary summary{.samples = timeStamps_.size(), .fps = GetRate_Impl()};
+  if (timeStamps_.size() < 2) {
+    return summary;
+  }
+
+  gaps_.clear();
+  for (size_t i = 1; i < timeStamps_.size(); ++i) {
+    gaps_.push_back(timeStamps_[i] - timeStamps_[i - 1]);
+  }
+  const double mean =
+      double((timeStamps_.back() - timeStamps_.front()).count()) /
+      gaps_.size();
+  double deviation{0.0};
+  for (const auto gap : gaps_) {
+    deviation += std::abs(gap.count() - mean);
+  }
+  summary.jitter = Duration(std::llround(deviation / gaps_.size()));
+
+  // nearest rank
+  const auto percentile = [this](double p) {
+    const size_t rank = size_t(std::ceil(p * gaps_.size()));
+    const auto nth =
+        gaps_.begin() + (std::clamp<size_t>(rank, 1, gaps_.size()) - 1);
+    std::nth_element(gaps_.begin(), nth, gaps_.end());
+    return *nth;
+  };
+  summary.gapP50 = percentile(0.50);
+  summary.gapP95 = percentile(0.95);
+  summary.gapP99 = percentile(0.99);
+  summary.gapMax = *std::ranges::max_element(gaps_);
+  return summary;
+}
+
+void to_json(nlohmann::json &j, const RateStatistics::Summary &summary) {
+  j = {{"samples", summary.samples},
+       {"fps", summary.fps},
+       {"jitterMs", summary.jitter.count() / 1000.0},
+       {"gapP50Ms", summary.gapP50.count() / 1000.0},
+       {"gapP95Ms", summary.gapP95.count() / 1000.0},
+       {"gapP99Ms", summary.gapP99.count() / 1000.0},
+       {"gapMaxMs", summary.gapMax.count() / 1000.0}};
+}
+
+} // namespace util
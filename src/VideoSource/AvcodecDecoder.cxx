@@ -0,0 +1,105 @@
+#include "VideoSource/AvcodecDecoder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavutil/error.h>
+}
+
+namespace {
+[[nodiscard]] std::string AvError(int err) {
+  char buf[AV_ERROR_MAX_STRING_SIZE]{};
+  av_strerror(err, buf, sizeof(buf));
+  return buf;
+}
+} // namespace
+
+namespace video_source {
+
+AvcodecDecoder::AvcodecDecoder(Codec codec, const Options &options) {
+  const AVCodec *pCodec = avcodec_find_decoder(
+      codec == Codec::H265 ? AV_CODEC_ID_HEVC : AV_CODEC_ID_H264);
+  if (!pCodec) {
+    throw std::runtime_error("libavcodec was built without this decoder");
+  }
+  pContext_ = avcodec_alloc_context3(pCodec);
+  pPacket_ = av_packet_alloc();
+  pFrame_ = av_frame_alloc();
+  if (!pContext_ || !pPacket_ || !pFrame_) {
+    Release();
+    throw std::bad_alloc();
+  }
+
+  // frame threads add a frame of delay each, slice threads add none but only
+  // help streams encoded with several slices
+  pContext_->thread_count = options.threads;
+  pContext_->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+  if (options.skipNonReference) {
+    pContext_->skip_frame = AVDISCARD_NONREF;
+  }
+  if (options.skipLoopFilter) {
+    pContext_->skip_loop_filter = AVDISCARD_ALL;
+  }
+  if (const int res = avcodec_open2(pContext_, pCodec, nullptr); res < 0) {
+    Release();
+    throw std::runtime_error(std::format("Failed to open the {} decoder: {}",
+                                         pCodec->name, AvError(res)));
+  }
+}
+
+AvcodecDecoder::~AvcodecDecoder() noexcept { Release(); }
+
+void AvcodecDecoder::Release() noexcept {
+  av_frame_free(&pFrame_);
+  av_packet_free(&pPacket_);
+  avcodec_free_context(&pContext_);
+}
+
+void AvcodecDecoder::Decode(std::span<const uint8_t> accessUnit,
+                            int64_t timeStamp,
+                            const PictureCallback &onPicture) {
+  padded_.resize(accessUnit.size() + AV_INPUT_BUFFER_PADDING_SIZE);
+  std::copy(accessUnit.begin(), accessUnit.end(), padded_.begin());
+  std::fill(padded_.begin() + accessUnit.size(), padded_.end(), uint8_t{0});
+  pPacket_->data = padded_.data();
+  pPacket_->size = int(accessUnit.size());
+  pPacket_->pts = timeStamp;
+
+  if (const int res = avcodec_send_packet(pContext_, pPacket_);
+      res < 0 && res != AVERROR(EAGAIN)) {
+    if (const auto suppressed = errorLimit_.Allow()) {
+      if (*suppressed > 0) {
+        LOGGER->warn(
+            "Errors decoding stream: {} ({} more since the last report)",
+            AvError(res), *suppressed);
+      } else {
+        LOGGER->warn("Errors decoding stream: {}", AvError(res));
+      }
+    }
+  }
+
+  while (avcodec_receive_frame(pContext_, pFrame_) == 0) {
+    if (pFrame_->format == AV_PIX_FMT_YUV420P ||
+        pFrame_->format == AV_PIX_FMT_YUVJ420P) {
+      onPicture({.planes = {pFrame_->data[0], pFrame_->data[1],
+                            pFrame_->data[2]},
+                 .width = pFrame_->width,
+                 .height = pFrame_->height,
+                 .strideY = pFrame_->linesize[0],
+                 .strideUV = pFrame_->linesize[1],
+                 .timeStamp = pFrame_->best_effort_timestamp});
+    } else {
+      LOGGER_RATE_LIMITED(std::chrono::seconds(60), spdlog::level::err,
+                          "Cannot analyse pictures in pixel format {}, only "
+                          "8 bit 4:2:0",
+                          pFrame_->format);
+    }
+    av_frame_unref(pFrame_);
+  }
+}
+
+} // namespace video_source
@@ -0,0 +1,64 @@
+#include "VideoSource/Decoder.h"
+
+#include "VideoSource/OpenH264Decoder.h"
+#ifdef WITH_FFMPEG
+#include "VideoSource/AvcodecDecoder.h"
+#endif
+
+#include <format>
+#include <stdexcept>
+
+#include <boost/algorithm/string/predicate.hpp>
+
+using namespace std::string_view_literals;
+
+namespace video_source {
+
+bool Decoder::IsAvailable(Backend backend) {
+  switch (backend) {
+  case Backend::Avcodec:
+#ifdef WITH_FFMPEG
+    return true;
+#else
+    return false;
+#endif
+  default:
+    return true;
+  }
+}
+
+std::unique_ptr<Decoder> Decoder::Create(Backend backend, Codec codec,
+                                         const Options &options) {
+  if (backend == Backend::Auto) {
+    backend = codec == Codec::H264 || !IsAvailable(Backend::Avcodec)
+                  ? Backend::OpenH264
+                  : Backend::Avcodec;
+  }
+  if (backend == Backend::Avcodec) {
+#ifdef WITH_FFMPEG
+    return std::make_unique<AvcodecDecoder>(codec, options);
+#else
+    throw std::invalid_argument(
+        "Decoding with libavcodec needs a build with WITH_FFMPEG");
+#endif
+  }
+  if (codec != Codec::H264) {
+    throw std::invalid_argument(
+        "OpenH264 only decodes H.264, H.265 needs libavcodec");
+  }
+  return std::make_unique<OpenH264Decoder>(options);
+}
+
+auto Decoder::ParseBackend(std::string_view name) -> Backend {
+  if (boost::iequals(name, "auto"sv)) {
+    return Backend::Auto;
+  } else if (boost::iequals(name, "openh264"sv)) {
+    return Backend::OpenH264;
+  } else if (boost::iequals(name, "ffmpeg"sv) ||
+             boost::iequals(name, "libavcodec"sv)) {
+    return Backend::Avcodec;
+  }
+  throw std::invalid_argument(std::format("Unknown decoder '{}'", name));
+}
+
+} // namespace video_source
@@ -5,63 +5,21 @@
 
 #include "VideoSource/Live555.h"
 
+#include <algorithm>
+#include <bit>
+#include <cstring>
 #include <format>
 #include <iostream>
 #include <string_view>
+#include <utility>
 
+#include <GroupsockHelper.hh>
+#include <boost/algorithm/string/predicate.hpp>
 #include <liveMedia.hh>
 #include <opencv2/imgproc.hpp>
-#include <wels/codec_api.h>
 
 using namespace std::string_view_literals;
 
-namespace {
-[[nodiscard]] std::string MakeDecoderError(DECODING_STATE state, unsigned int) {
-  thread_local std::vector<std::string_view> errors;
-  errors.clear();
-  if (state & dsFramePending) {
-    errors.push_back("FramePending"sv);
-  }
-  if (state & dsRefLost) {
-    errors.push_back("RefLost"sv);
-  }
-  if (state & dsBitstreamError) {
-    errors.push_back("BitstreamError"sv);
-  }
-  if (state & dsDepLayerLost) {
-    errors.push_back("DepLayerLost"sv);
-  }
-  if (state & dsNoParamSets) {
-    errors.push_back("NoParamSets"sv);
-  }
-  if (state & dsDataErrorConcealed) {
-    errors.push_back("DataErrorConcealed"sv);
-  }
-  if (state & dsRefListNullPtrs) {
-    errors.push_back("RefListNullPtrs"sv);
-  }
-  if (state & dsInvalidArgument) {
-    errors.push_back("InvalidArgument"sv);
-  }
-  if (state & dsInitialOptExpected) {
-    errors.push_back("InitialOptExpected"sv);
-  }
-  if (state & dsOutOfMemory) {
-    errors.push_back("OutOfMemory"sv);
-  }
-  if (state & dsDstBufNeedExpan) {
-    errors.push_back("DstBufNeedExpan"sv);
-  }
-  std::stringstream ss;
-  for (size_t i = 0; auto error : errors) {
-    ss << error << (++i < errors.size() ? ", "sv : ""sv);
-  }
-
-  return std::format("Errors decoding stream ({:X}): {}"sv, int(state),
-                     ss.str());
-}
-} // namespace
-
 template <>
 struct fmt::formatter<RTSPClient> : fmt::formatter<std::string_view> {
   auto format(const RTSPClient &rtspClient, format_context &ctx) const
@@ -144,8 +102,19 @@ public:
 
   ~FrameRtspClient() override {}
 
+  // Switches an auto transport to TCP for the next session, for networks that
+  // drop or never route the UDP packets
+  void FallBackToTcp(std::string_view reason) {
+    if (rVideoSource_.transport == Live555VideoSource::Transport::Auto &&
+        !rVideoSource_.fellBackToTcp_) {
+      rVideoSource_.fellBackToTcp_ = true;
+      LOGGER->warn("{}, streaming over TCP from the next session", reason);
+    }
+  }
+
   Live555VideoSource &rVideoSource_;
   StreamClientState scs;
+  bool receivedFrame{false};
 
   // Set up a watchdog timer to make sure the stream is receiving timely
   // updates, otherwise stop waiting and close
@@ -171,20 +140,17 @@ public:
   static FrameSetterSink *CreateNew(UsageEnvironment &env,
                                     MediaSubsession &subsession,
                                     Live555VideoSource &videoSource,
-                                    size_t bufferSize = 2'000'000) {
-    return new FrameSetterSink(env, subsession, videoSource, bufferSize);
+                                    Codec codec) {
+    return new FrameSetterSink(env, subsession, videoSource, codec,
+                               videoSource.frameBufferSize);
   }
 
-  ~FrameSetterSink() override {
-    if (pSvcDecoder_) {
-      pSvcDecoder_->Uninitialize();
-      WelsDestroyDecoder(pSvcDecoder_);
-    }
-  }
+  ~FrameSetterSink() override = default;
 
 private:
   FrameSetterSink(UsageEnvironment &env, MediaSubsession &subsession,
-                  Live555VideoSource &videoSource, size_t bufferSize)
+                  Live555VideoSource &videoSource, Codec codec,
+                  size_t bufferSize)
       : MediaSink(env), receiveBuffer_(bufferSize, 0), rSubsession_(subsession),
         rVideoSource_(videoSource) {
 
@@ -192,73 +158,111 @@ private:
       throw std::runtime_error(
           "Receive buffer is not large enough for prefix bytes");
     }
-    receiveBuffer_[0] = 0x00;
-    receiveBuffer_[1] = 0x00;
-    receiveBuffer_[2] = 0x01;
 
-    // Setup the codec
-    if (const int res = WelsCreateDecoder(&pSvcDecoder_); res != 0) {
-      throw std::runtime_error(
-          std::format("Failed to create code with error code {}", res));
-    }
-    memset(&sDstBufInfo_, 0, sizeof(SBufferInfo));
-#ifdef __GNUC__
-#pragma GCC diagnostic ignored "-Wmissing-field-initializers"
-#endif
-    sDecParam_ = {0};
+    pDecoder_ = Decoder::Create(rVideoSource_.decoderBackend, codec,
+                                rVideoSource_.decoderOptions);
 
-    sDecParam_.uiTargetDqLayer = (uint8_t)-1;
-    sDecParam_.eEcActiveIdc = ERROR_CON_SLICE_COPY;
-    sDecParam_.sVideoProperty.eVideoBsType = VIDEO_BITSTREAM_AVC;
+    // clips are written as H.264
+    if (codec != Codec::H264 && rVideoSource_.pPreRollBuffer) {
+      LOGGER->warn("{} Clips are only recorded from H.264 streams",
+                   rSubsession_);
+      preRoll_ = false;
+    }
 
-    pSvcDecoder_->Initialize(&sDecParam_);
+    // cameras often only send the parameter sets in the SDP, the decoder
+    // gets them ahead of the first picture and clips keep them too
+    const std::vector<char const *> sprops =
+        codec == Codec::H265
+            ? std::vector{rSubsession_.fmtp_spropvps(),
+                          rSubsession_.fmtp_spropsps(),
+                          rSubsession_.fmtp_sproppps()}
+            : std::vector{rSubsession_.fmtp_spropparametersets()};
+    for (char const *sprop : sprops) {
+      unsigned int numRecords{0};
+      std::unique_ptr<SPropRecord[]> records(
+          parseSPropParameterSets(sprop, numRecords));
+      for (unsigned int i = 0; i < numRecords; ++i) {
+        const size_t start = sdpParameterSets_.size();
+        sdpParameterSets_.insert(sdpParameterSets_.end(), {0x00, 0x00, 0x01});
+        sdpParameterSets_.insert(sdpParameterSets_.end(),
+                                 records[i].sPropBytes,
+                                 records[i].sPropBytes +
+                                     records[i].sPropLength);
+        if (preRoll_ && rVideoSource_.pPreRollBuffer) {
+          rVideoSource_.pPreRollBuffer->Push(
+              std::span(sdpParameterSets_).subspan(start),
+              std::chrono::steady_clock::now());
+        }
+      }
+    }
   }
 
   void AfterGettingFrame(unsigned int frameSize, unsigned int numTruncatedBytes,
                          timeval presentationTime, unsigned int) {
 #ifdef _DEBUG
-    const std::string truncatedMsg =
-        (numTruncatedBytes > 0)
-            ? std::format(" (with {} bytes truncated)", numTruncatedBytes)
-            : "";
-    const std::string_view syncMarker =
-        (rSubsession_.rtpSource() &&
-         !rSubsession_.rtpSource()->hasBeenSynchronizedUsingRTCP())
-            ? "!"sv
-            : ""sv;
-
-    const auto rtspClientRepr =
-        rVideoSource_.pRtspClient_
-            ? fmt::format("{}", *rVideoSource_.pRtspClient_)
-            : "<none>";
-
-    LOGGER->debug("{} {} ({}):\tReceived {} bytes{} \tPresentation time: "
-                  "{}.{:06d}{}\tNPT: {}",
-                  rtspClientRepr, rSubsession_,
-                  rVideoSource_.GetCurrentFrame().id + 1, frameSize,
-                  truncatedMsg, presentationTime.tv_sec,
-                  presentationTime.tv_usec, syncMarker,
-                  rSubsession_.getNormalPlayTime(presentationTime));
+    if (LOGGER->should_log(spdlog::level::debug)) {
+      const std::string truncatedMsg =
+          (numTruncatedBytes > 0)
+              ? std::format(" (with {} bytes truncated)", numTruncatedBytes)
+              : "";
+      const std::string_view syncMarker =
+          (rSubsession_.rtpSource() &&
+           !rSubsession_.rtpSource()->hasBeenSynchronizedUsingRTCP())
+              ? "!"sv
+              : ""sv;
+
+      const auto rtspClientRepr =
+          rVideoSource_.pRtspClient_
+              ? fmt::format("{}", *rVideoSource_.pRtspClient_)
+              : "<none>";
+
+      LOGGER->debug("{} {} ({}):\tReceived {} bytes{} \tPresentation time: "
+                    "{}.{:06d}{}\tNPT: {}",
+                    rtspClientRepr, rSubsession_,
+                    rVideoSource_.GetCurrentFrame().id + 1, frameSize,
+                    truncatedMsg, presentationTime.tv_sec,
+                    presentationTime.tv_usec, syncMarker,
+                    rSubsession_.getNormalPlayTime(presentationTime));
+    }
 #endif
-    memset(&sDstBufInfo_, 0, sizeof(SBufferInfo));
-    pDataYUV_[0] = pDataYUV_[1] = pDataYUV_[2] = nullptr;
-    const auto res = pSvcDecoder_->DecodeFrameNoDelay(
-        receiveBuffer_.data(), frameSize + 3, pDataYUV_, &sDstBufInfo_);
-
-    constexpr unsigned int errMask =
-        dsBitstreamError | dsNoParamSets | dsDepLayerLost;
-    if (res != 0 && (res & errMask)) {
-      LOGGER->warn(MakeDecoderError(res, errMask));
+    rVideoSource_.pRtspClient_->receivedFrame = true;
+
+    // live555 hands over one NAL unit at a time, they are gathered into the
+    // access unit and the decoder is called once per picture
+    size_t nalOffset = auSize_;
+    if ((nalOffset > 0 || auDamaged_) &&
+        (presentationTime.tv_sec != auTime_.tv_sec ||
+         presentationTime.tv_usec != auTime_.tv_usec)) {
+      // the packet with the marker bit of the last picture was lost
+      DecodeAccessUnit(nalOffset);
+      std::memmove(receiveBuffer_.data(), receiveBuffer_.data() + nalOffset,
+                   frameSize + 3);
+      nalOffset = 0;
+    }
+    auSize_ = nalOffset + frameSize + 3;
+    auTime_ = presentationTime;
+
+    if (numTruncatedBytes > 0) {
+      // the rest of the picture is lost, decoding it only costs concealment
+      auDamaged_ = true;
+      GrowReceiveBuffer(auSize_ + numTruncatedBytes);
+    } else if (preRoll_ && rVideoSource_.pPreRollBuffer) {
+      // keep the compressed unit as it arrived
+      rVideoSource_.pPreRollBuffer->Push(
+          std::span(receiveBuffer_.data() + nalOffset, frameSize + 3),
+          std::chrono::steady_clock::now(),
+          std::chrono::seconds{presentationTime.tv_sec} +
+              std::chrono::microseconds{presentationTime.tv_usec});
     }
 
-    if (sDstBufInfo_.iBufferStatus == 1) {
-      const int width = sDstBufInfo_.UsrData.sSystemBuffer.iWidth;
-      const int height = sDstBufInfo_.UsrData.sSystemBuffer.iHeight;
-      const int timeStamp = sDstBufInfo_.uiOutYuvTimeStamp;
-      rVideoSource_.SetYUVFrame(pDataYUV_, width, height,
-                                sDstBufInfo_.UsrData.sSystemBuffer.iStride[0],
-                                sDstBufInfo_.UsrData.sSystemBuffer.iStride[1],
-                                timeStamp);
+    if (RTPSource *pRtpSource = rSubsession_.rtpSource();
+        pRtpSource && pRtpSource->curPacketMarkerBit()) {
+      DecodeAccessUnit(auSize_);
+      auSize_ = 0;
+    } else if (auSize_ + 3 >= receiveBuffer_.size()) {
+      // no room for another start code, the picture is given up
+      auDamaged_ = true;
+      auSize_ = 0;
     }
 
     if (rVideoSource_.GetFrameCount() < rVideoSource_.maxFrames_) {
@@ -268,6 +272,52 @@ private:
     }
   }
 
+  void DecodeAccessUnit(size_t size) {
+    const auto presentationTime = std::chrono::seconds{auTime_.tv_sec} +
+                                  std::chrono::microseconds{auTime_.tv_usec};
+    rVideoSource_.inputRate.Add(presentationTime);
+    if (std::exchange(auDamaged_, false) || !rVideoSource_.decode) {
+      return;
+    }
+    // until the first RTCP sender report, presentation times come from the
+    // receiver's clock
+    RTPSource *pRtpSource = rSubsession_.rtpSource();
+    const bool synchronized =
+        pRtpSource && pRtpSource->hasBeenSynchronizedUsingRTCP();
+    const auto onPicture = [this, synchronized](const YuvPicture &picture) {
+      rVideoSource_.SetYUVFrame(picture, synchronized);
+    };
+    if (!sdpParameterSets_.empty()) {
+      // an access unit of only parameter sets, it yields no picture
+      pDecoder_->Decode(sdpParameterSets_, presentationTime.count(),
+                        onPicture);
+      sdpParameterSets_ = {};
+    }
+    pDecoder_->Decode(std::span(receiveBuffer_.data(), size),
+                      presentationTime.count(), onPicture);
+  }
+
+  void GrowReceiveBuffer(size_t unitSize) {
+    const size_t truncated = ++rVideoSource_.truncatedFrames_;
+    // twice the unit leaves room for the next key frame to be a bit larger
+    const size_t wanted = std::min(std::bit_ceil((unitSize + 3) * 2),
+                                   rVideoSource_.maxFrameBufferSize);
+    if (wanted > receiveBuffer_.size()) {
+      receiveBuffer_.resize(wanted);
+      rVideoSource_.frameBufferSize =
+          std::max(rVideoSource_.frameBufferSize, wanted);
+      LOGGER->info("{} Truncated a {} byte frame, receive buffer is now {} "
+                   "bytes",
+                   rSubsession_, unitSize, wanted);
+    } else {
+      LOGGER_RATE_LIMITED(std::chrono::seconds(5), spdlog::level::warn,
+                          "{} Truncated a {} byte frame at the {} byte limit "
+                          "({} truncated in total)",
+                          rSubsession_, unitSize, receiveBuffer_.size(),
+                          truncated);
+    }
+  }
+
   static void AfterGettingFrame(void *clientData, unsigned int frameSize,
                                 unsigned int numTruncatedBytes,
                                 timeval presentationTime,
@@ -282,18 +332,26 @@ private:
       return False;
     }
     rVideoSource_.pRtspClient_->lastUpdate = std::chrono::steady_clock::now();
-    fSource->getNextFrame(receiveBuffer_.data() + 3, receiveBuffer_.size() - 3,
+    // the next NAL unit goes behind the ones already in the access unit
+    uint8_t *pStartCode = receiveBuffer_.data() + auSize_;
+    pStartCode[0] = 0x00;
+    pStartCode[1] = 0x00;
+    pStartCode[2] = 0x01;
+    fSource->getNextFrame(pStartCode + 3, receiveBuffer_.size() - auSize_ - 3,
                           AfterGettingFrame, this, onSourceClosure, this);
     return True;
   }
 
-  DECODING_STATE res{dsBitstreamError};
-  ISVCDecoder *pSvcDecoder_{nullptr};
-  unsigned char *pDataYUV_[3]{nullptr, nullptr, nullptr};
-  SBufferInfo sDstBufInfo_;
-  SDecodingParam sDecParam_{};
+  std::unique_ptr<Decoder> pDecoder_;
+  bool preRoll_{true};
+  // Annex-B parameter sets from the SDP, decoded ahead of the first unit
+  std::vector<uint8_t> sdpParameterSets_;
 
+  // Annex-B access unit being assembled in receiveBuffer_[0, auSize_)
   std::vector<u_int8_t> receiveBuffer_;
+  size_t auSize_{0};
+  timeval auTime_{};
+  bool auDamaged_{false};
   unsigned int frameCount_{0};
   MediaSubsession &rSubsession_;
   Live555VideoSource &rVideoSource_;
@@ -312,6 +370,17 @@ Live555VideoSource::Live555VideoSource(std::shared_ptr<TaskScheduler> pSched,
 
 Live555VideoSource::~Live555VideoSource() { StopStream_Impl(); }
 
+auto Live555VideoSource::ParseTransport(std::string_view name) -> Transport {
+  if (boost::iequals(name, "udp"sv)) {
+    return Transport::Udp;
+  } else if (boost::iequals(name, "tcp"sv)) {
+    return Transport::Tcp;
+  } else if (boost::iequals(name, "auto"sv)) {
+    return Transport::Auto;
+  }
+  throw std::invalid_argument(std::format("Unknown RTSP transport '{}'", name));
+}
+
 void Live555VideoSource::StartStream(unsigned long long maxFrames) {
   if (url_.empty()) {
     throw std::runtime_error("No URL specified");
@@ -333,45 +402,63 @@ void Live555VideoSource::StartStream(unsigned long long maxFrames) {
 
 void Live555VideoSource::StopStream() { StopStream_Impl(); }
 
-void Live555VideoSource::SetYUVFrame(uint8_t **pDataYUV, int width, int height,
-                                     int strideY, int strideUV, int) {
-
-  thread_local cv::Mat Y, U, V, YUV;
-  Y = cv::Mat(cv::Size(width, height), CV_8UC1, pDataYUV[0],
-              strideY); // non-owning buffer, set to thread local to persist
-                        // outside scope
-
-  if (this->fullColor) {
-    const cv::Mat U2(cv::Size(width / 2, height / 2), CV_8UC1, pDataYUV[1],
-                     strideUV);
-    const cv::Mat V2(cv::Size(width / 2, height / 2), CV_8UC1, pDataYUV[2],
-                     strideUV);
-
-    thread_local cv::Mat U, V, YUV;
-    cv::resize(U2, U, Y.size());
-    cv::resize(V2, V, Y.size());
-  } else {
-    U = cv::Mat();
-    V = cv::Mat();
-    YUV = cv::Mat();
+void Live555VideoSource::SetYUVFrame(const YuvPicture &picture,
+                                     bool synchronized) {
+  if (!picture.planes[0]) {
+    return;
   }
+  // non-owning view of the decoder's buffer, only valid during this call, so
+  // every path below leaves the frame with its own copy
+  const cv::Mat fullY(cv::Size(picture.width, picture.height), CV_8UC1,
+                      picture.planes[0], picture.strideY);
+  // a whole factor takes OpenCV's fast path for area resampling, and at 2 the
+  // chroma planes already have the output size
+  const int factor =
+      maxWidth > 0 ? std::max(1, (picture.width + maxWidth - 1) / maxWidth) : 1;
+  const cv::Size size(picture.width / factor, picture.height / factor);
 
   try {
     auto frame = GetCurrentFrame();
 
     if (this->fullColor) {
-      cv::merge(std::array{Y, U, V}, YUV);
+      const cv::Size chromaSize(picture.width / 2, picture.height / 2);
+      const cv::Mat U2(chromaSize, CV_8UC1, picture.planes[1],
+                       picture.strideUV);
+      const cv::Mat V2(chromaSize, CV_8UC1, picture.planes[2],
+                       picture.strideUV);
+      // a plane already at the output size is used in place, the buffers
+      // kept between calls only ever hold scaled copies, never a view of
+      // the decoder's memory
+      const auto scale = [&size](const cv::Mat &plane,
+                                 cv::Mat &scaled) -> cv::Mat {
+        if (plane.size() == size) {
+          return plane;
+        }
+        cv::resize(plane, scaled, size, 0, 0,
+                   plane.cols < size.width ? cv::INTER_LINEAR
+                                           : cv::INTER_AREA);
+        return scaled;
+      };
+      thread_local cv::Mat Y, U, V, YUV;
+      cv::merge(std::array{scale(fullY, Y), scale(U2, U), scale(V2, V)}, YUV);
       cv::cvtColor(YUV, frame.img, cv::COLOR_YUV2BGR);
+    } else if (factor == 1) {
+      // the decoder reuses its buffer once this returns, while the frame is
+      // read later by subscribers and GetCurrentFrame
+      frame.img = fullY.clone();
     } else {
-      if (!Y.empty()) {
-        frame.img = Y;
-      }
+      // scaled straight out of the decoder's buffer, the full size picture is
+      // never copied
+      cv::resize(fullY, frame.img, size, 0, 0, cv::INTER_AREA);
     }
     ++frame.id;
     frame.timeStamp = std::chrono::steady_clock::now();
+    frame.presentationTime = std::chrono::microseconds{picture.timeStamp};
+    frame.synchronized = synchronized;
     this->SetFrame(frame);
   } catch (const std::exception &e) {
-    LOGGER->error(e.what());
+    LOGGER_RATE_LIMITED(std::chrono::seconds(5), spdlog::level::err, "{}",
+                        e.what());
   }
 }
 
@@ -433,11 +520,6 @@ void continueAfterDESCRIBE(RTSPClient *rtspClient, int resultCode,
   frameRtspClient->rVideoSource_.StopStream();
 }
 
-// By default, we request that the server stream its data using RTP/UDP.
-// If, instead, you want to request that the server stream via RTP-over-TCP,
-// change the following to True:
-#define REQUEST_STREAMING_OVER_TCP False
-
 void setupNextSubsession(RTSPClient *rtspClient) {
   auto *frameRtspClient = dynamic_cast<FrameRtspClient *>(rtspClient);
   if (!frameRtspClient) {
@@ -466,7 +548,7 @@ void setupNextSubsession(RTSPClient *rtspClient) {
       // Continue setting up this subsession, by sending a RTSP "SETUP"
       // command:
       rtspClient->sendSetupCommand(*scs.subsession, continueAfterSETUP, False,
-                                   REQUEST_STREAMING_OVER_TCP);
+                                   frameRtspClient->rVideoSource_.UsesTcp());
     }
     return;
   }
@@ -485,6 +567,27 @@ void setupNextSubsession(RTSPClient *rtspClient) {
   }
 }
 
+void configureReceiver(FrameRtspClient &client, MediaSubsession &subsession) {
+  const Live555VideoSource &source = client.rVideoSource_;
+  RTPSource *pRtpSource = subsession.rtpSource();
+  if (!pRtpSource) {
+    return;
+  }
+  pRtpSource->setPacketReorderingThresholdTime(
+      unsigned(source.reorderThreshold.count()));
+  // interleaved packets arrive on the RTSP connection instead
+  if (source.socketReceiveBufferSize > 0 && !source.UsesTcp()) {
+    const unsigned granted = increaseReceiveBufferTo(
+        client.envir(), pRtpSource->RTPgs()->socketNum(),
+        source.socketReceiveBufferSize);
+    if (granted < source.socketReceiveBufferSize) {
+      LOGGER->warn("{} Asked for a {} byte receive buffer and got {}, the "
+                   "system limit may need raising",
+                   client, source.socketReceiveBufferSize, granted);
+    }
+  }
+}
+
 void continueAfterSETUP(RTSPClient *rtspClient, int resultCode,
                         char *resultString) {
   auto upResultString = std::unique_ptr<char>(resultString);
@@ -499,6 +602,8 @@ void continueAfterSETUP(RTSPClient *rtspClient, int resultCode,
     if (resultCode != 0) {
       LOGGER->error("{} Failed to set up the \"{}\" subsession: {}",
                     *rtspClient, *scs.subsession, resultString);
+      frameRtspClient->FallBackToTcp(
+          fmt::format("{} Setup over UDP failed", *rtspClient));
       break;
     }
 
@@ -516,9 +621,19 @@ void continueAfterSETUP(RTSPClient *rtspClient, int resultCode,
     // happening until later, after we've sent a RTSP "PLAY" command.)
 
     if ("video"sv == scs.subsession->mediumName() &&
-        "H264"sv == scs.subsession->codecName()) {
-      scs.subsession->sink = FrameSetterSink::CreateNew(
-          env, *scs.subsession, frameRtspClient->rVideoSource_);
+        ("H264"sv == scs.subsession->codecName() ||
+         "H265"sv == scs.subsession->codecName())) {
+      const Codec codec =
+          "H264"sv == scs.subsession->codecName() ? Codec::H264 : Codec::H265;
+      configureReceiver(*frameRtspClient, *scs.subsession);
+      try {
+        scs.subsession->sink = FrameSetterSink::CreateNew(
+            env, *scs.subsession, frameRtspClient->rVideoSource_, codec);
+      } catch (const std::exception &e) {
+        LOGGER->error("{} Cannot decode the \"{}\" subsession: {}",
+                      *rtspClient, *scs.subsession, e.what());
+        break;
+      }
       if (!scs.subsession->sink) {
         LOGGER->error(
             "{} Failed to create a data sink for the \"{}\" subsession: {}",
@@ -644,6 +759,10 @@ void streamWatchdogHandler(void *clientData) {
   if (std::chrono::steady_clock::now() - client->lastUpdate > timeout) {
     LOGGER->error("Timeout waiting for next frame ({}) closing stream...",
                   timeout.count());
+    if (!client->receivedFrame) {
+      client->FallBackToTcp(
+          fmt::format("{} No frames arrived over UDP", *client));
+    }
     client->rVideoSource_.StopStream();
     return;
   }
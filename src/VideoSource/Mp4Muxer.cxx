@@ -0,0 +1,575 @@
+#include "VideoSource/Mp4Muxer.h"
+
+#include <algorithm>
+#include <array>
+#include <string_view>
+
+namespace {
+constexpr uint8_t nalTypeIdr{5};
+constexpr uint8_t nalTypeSei{6};
+constexpr uint8_t nalTypeSps{7};
+constexpr uint8_t nalTypePps{8};
+
+// as many as the avcC counts can hold
+constexpr size_t maxSpsSets{31};
+constexpr size_t maxPpsSets{255};
+
+constexpr uint32_t sampleFlagsSync{0x0200'0000};
+constexpr uint32_t sampleFlagsNonSync{0x0101'0000};
+
+constexpr std::array<uint32_t, 9> unityMatrix{
+    0x0001'0000, 0, 0, 0, 0x0001'0000, 0, 0, 0, 0x4000'0000};
+
+std::span<const uint8_t> StripStartCode(std::span<const uint8_t> nalUnit) {
+  size_t i{0};
+  while (i < nalUnit.size() && i < 3 && nalUnit[i] == 0x00) {
+    ++i;
+  }
+  if (i >= 2 && i < nalUnit.size() && nalUnit[i] == 0x01) {
+    return nalUnit.subspan(i + 1);
+  }
+  return nalUnit;
+}
+
+// writes big-endian fields and sizes each box once it is closed
+class BoxWriter {
+public:
+  explicit BoxWriter(std::vector<uint8_t> &out) : out_{out} {}
+
+  void U8(uint8_t v) { out_.push_back(v); }
+  void U16(uint16_t v) {
+    U8(uint8_t(v >> 8));
+    U8(uint8_t(v));
+  }
+  void U24(uint32_t v) {
+    U8(uint8_t(v >> 16));
+    U16(uint16_t(v));
+  }
+  void U32(uint32_t v) {
+    U16(uint16_t(v >> 16));
+    U16(uint16_t(v));
+  }
+  void U64(uint64_t v) {
+    U32(uint32_t(v >> 32));
+    U32(uint32_t(v));
+  }
+  void Zeros(size_t n) { out_.insert(out_.end(), n, 0); }
+  void Bytes(std::span<const uint8_t> bytes) {
+    out_.insert(out_.end(), bytes.begin(), bytes.end());
+  }
+  void FourCC(std::string_view fourCC) {
+    out_.insert(out_.end(), fourCC.begin(), fourCC.begin() + 4);
+  }
+  void Matrix() {
+    for (const uint32_t v : unityMatrix) {
+      U32(v);
+    }
+  }
+
+  void Begin(std::string_view type) {
+    starts_.push_back(out_.size());
+    U32(0);
+    FourCC(type);
+  }
+  void BeginFull(std::string_view type, uint8_t version, uint32_t flags) {
+    Begin(type);
+    U8(version);
+    U24(flags);
+  }
+  size_t End() {
+    const size_t start = starts_.back();
+    starts_.pop_back();
+    const size_t size = out_.size() - start;
+    Patch32(start, uint32_t(size));
+    return size;
+  }
+
+  [[nodiscard]] size_t Position() const { return out_.size(); }
+  void Patch32(size_t pos, uint32_t v) {
+    out_[pos] = uint8_t(v >> 24);
+    out_[pos + 1] = uint8_t(v >> 16);
+    out_[pos + 2] = uint8_t(v >> 8);
+    out_[pos + 3] = uint8_t(v);
+  }
+
+private:
+  std::vector<uint8_t> &out_;
+  std::vector<size_t> starts_;
+};
+
+// reads the exp-Golomb coded fields of an RBSP
+class BitReader {
+public:
+  explicit BitReader(std::span<const uint8_t> nalUnit) {
+    // drop emulation prevention bytes
+    rbsp_.reserve(nalUnit.size());
+    for (size_t i = 0; i < nalUnit.size(); ++i) {
+      if (i >= 2 && nalUnit[i] == 0x03 && nalUnit[i - 1] == 0x00 &&
+          nalUnit[i - 2] == 0x00) {
+        continue;
+      }
+      rbsp_.push_back(nalUnit[i]);
+    }
+  }
+
+  bool Ok() const { return !failed_ && pos_ <= rbsp_.size() * 8; }
+
+  uint32_t Bits(int n) {
+    uint32_t v{0};
+    for (int i = 0; i < n; ++i) {
+      const size_t byte = pos_ / 8;
+      const uint32_t bit =
+          byte < rbsp_.size() ? (rbsp_[byte] >> (7 - pos_ % 8)) & 1 : 0;
+      v = (v << 1) | bit;
+      ++pos_;
+    }
+    return v;
+  }
+  uint32_t Ue() {
+    int zeros{0};
+    while (Ok() && Bits(1) == 0) {
+      // more than 31 leading zeros can't be a 32 bit value, the data is
+      // corrupt
+      if (++zeros > 31) {
+        failed_ = true;
+        return 0;
+      }
+    }
+    return (uint32_t(1) << zeros) - 1 + Bits(zeros);
+  }
+  int32_t Se() {
+    const uint32_t v = Ue();
+    return (v & 1) ? int32_t((v + 1) / 2) : -int32_t(v / 2);
+  }
+
+private:
+  std::vector<uint8_t> rbsp_;
+  size_t pos_{0};
+  bool failed_{false};
+};
+} // namespace
+
+namespace video_source {
+
+std::optional<Mp4Muxer::Dimensions>
+Mp4Muxer::ParseSpsDimensions(std::span<const uint8_t> sps) {
+  if (sps.size() < 4) {
+    return std::nullopt;
+  }
+  BitReader br(sps);
+  br.Bits(8); // NAL header
+  const uint32_t profileIdc = br.Bits(8);
+  br.Bits(16); // constraint flags and level
+  br.Ue();     // seq_parameter_set_id
+
+  uint32_t chromaFormatIdc{1};
+  bool separateColourPlane{false};
+  switch (profileIdc) {
+  case 100:
+  case 110:
+  case 122:
+  case 244:
+  case 44:
+  case 83:
+  case 86:
+  case 118:
+  case 128:
+  case 138:
+  case 139:
+  case 134:
+  case 135:
+    chromaFormatIdc = br.Ue();
+    if (chromaFormatIdc == 3) {
+      separateColourPlane = br.Bits(1);
+    }
+    br.Ue();    // bit_depth_luma_minus8
+    br.Ue();    // bit_depth_chroma_minus8
+    br.Bits(1); // qpprime_y_zero_transform_bypass_flag
+    // seq_scaling_matrix_present_flag, the lists only need skipping
+    if (br.Bits(1)) {
+      const int lists = chromaFormatIdc != 3 ? 8 : 12;
+      for (int i = 0; i < lists; ++i) {
+        if (!br.Bits(1)) {
+          continue;
+        }
+        const int size = i < 6 ? 16 : 64;
+        int32_t lastScale{8};
+        int32_t nextScale{8};
+        for (int j = 0; j < size; ++j) {
+          if (nextScale != 0) {
+            nextScale = (lastScale + br.Se() + 256) % 256;
+          }
+          lastScale = nextScale == 0 ? lastScale : nextScale;
+        }
+      }
+    }
+    break;
+  default:
+    break;
+  }
+
+  br.Ue(); // log2_max_frame_num_minus4
+  const uint32_t picOrderCntType = br.Ue();
+  if (picOrderCntType == 0) {
+    br.Ue(); // log2_max_pic_order_cnt_lsb_minus4
+  } else if (picOrderCntType == 1) {
+    br.Bits(1); // delta_pic_order_always_zero_flag
+    br.Se();    // offset_for_non_ref_pic
+    br.Se();    // offset_for_top_to_bottom_field
+    const uint32_t cycle = br.Ue();
+    for (uint32_t i = 0; i < cycle && br.Ok(); ++i) {
+      br.Se();
+    }
+  }
+  br.Ue();    // max_num_ref_frames
+  br.Bits(1); // gaps_in_frame_num_value_allowed_flag
+  const uint32_t widthInMbs = br.Ue() + 1;
+  const uint32_t heightInMapUnits = br.Ue() + 1;
+  const uint32_t frameMbsOnly = br.Bits(1);
+  if (!frameMbsOnly) {
+    br.Bits(1); // mb_adaptive_frame_field_flag
+  }
+  br.Bits(1); // direct_8x8_inference_flag
+
+  uint32_t cropLeft{0}, cropRight{0}, cropTop{0}, cropBottom{0};
+  if (br.Bits(1)) {
+    cropLeft = br.Ue();
+    cropRight = br.Ue();
+    cropTop = br.Ue();
+    cropBottom = br.Ue();
+  }
+  if (!br.Ok()) {
+    return std::nullopt;
+  }
+
+  const bool monochrome = chromaFormatIdc == 0 || separateColourPlane;
+  const uint32_t cropUnitX = monochrome ? 1 : (chromaFormatIdc == 3 ? 1 : 2);
+  const uint32_t cropUnitY =
+      (monochrome ? 1 : (chromaFormatIdc == 1 ? 2 : 1)) * (2 - frameMbsOnly);
+
+  return Dimensions{
+      .width = int(widthInMbs * 16 - (cropLeft + cropRight) * cropUnitX),
+      .height = int((2 - frameMbsOnly) * heightInMapUnits * 16 -
+                    (cropTop + cropBottom) * cropUnitY)};
+}
+
+void Mp4Muxer::AddNalUnit(std::span<const uint8_t> nalUnit,
+                          std::chrono::microseconds timeStamp) {
+  const auto payload = StripStartCode(nalUnit);
+  if (payload.empty()) {
+    return;
+  }
+  const uint8_t type = payload[0] & 0x1F;
+  // parameter sets go in the init segment, delimiters and the like are
+  // implied by the sample table
+  if (type == nalTypeSps) {
+    if (payload.size() >= 4) {
+      AddParameterSet(spsSets_, payload, maxSpsSets);
+    }
+    return;
+  }
+  if (type == nalTypePps) {
+    AddParameterSet(ppsSets_, payload, maxPpsSets);
+    return;
+  }
+  if (type == 0 || type > nalTypeSei) {
+    return;
+  }
+
+  // scaled by the reduced ratio, so wall clock timestamps don't overflow
+  const int64_t pts = std::chrono::duration_cast<Ticks>(timeStamp).count();
+  if (frameOpen_ && pts != frame_.pts) {
+    CloseFrame();
+  }
+
+  if (!frameOpen_) {
+    if (!firstPts_) {
+      // playback has to start on an IDR frame with its parameter sets
+      if (type != nalTypeIdr || spsSets_.empty() || ppsSets_.empty()) {
+        return;
+      }
+      firstPts_ = pts;
+    }
+    const bool fragmentFull =
+        !samples_.empty() && pts - samples_.front().pts >=
+                                 maxFragmentDuration.count() * timescale / 1000;
+    if (!samples_.empty() && (type == nalTypeIdr || fragmentFull)) {
+      WriteFragment(pts);
+    }
+    // new parameter sets take effect from an IDR frame, which then starts a
+    // new file whose init segment carries them
+    if (initStale_ && type == nalTypeIdr && !splitAt_) {
+      splitAt_ = output_.size();
+      initWritten_ = false;
+      initStale_ = false;
+      decodeTime_ = 0;
+      sequence_ = 1;
+    }
+    frameOpen_ = true;
+    frame_ = {.offset = sampleData_.size(), .pts = pts};
+  }
+
+  frame_.keyFrame |= type == nalTypeIdr;
+  BoxWriter(sampleData_).U32(uint32_t(payload.size()));
+  sampleData_.insert(sampleData_.end(), payload.begin(), payload.end());
+}
+
+void Mp4Muxer::AddParameterSet(std::vector<std::vector<uint8_t>> &sets,
+                               std::span<const uint8_t> payload,
+                               size_t maxSets) {
+  const auto it = std::ranges::find_if(sets, [payload](const auto &set) {
+    return std::ranges::equal(set, payload);
+  });
+  if (it != sets.end()) {
+    // keep the one in use last
+    std::rotate(it, it + 1, sets.end());
+    return;
+  }
+  if (sets.size() == maxSets) {
+    sets.erase(sets.begin());
+  }
+  sets.emplace_back(payload.begin(), payload.end());
+  initStale_ = initWritten_;
+}
+
+void Mp4Muxer::CloseFrame() {
+  frame_.size = uint32_t(sampleData_.size() - frame_.offset);
+  samples_.push_back(frame_);
+  frameOpen_ = false;
+}
+
+void Mp4Muxer::Flush() {
+  if (frameOpen_) {
+    CloseFrame();
+  }
+  WriteFragment(std::nullopt);
+}
+
+void Mp4Muxer::TakeOutput(std::vector<uint8_t> &out) {
+  const auto end = output_.begin() + splitAt_.value_or(output_.size());
+  out.insert(out.end(), output_.begin(), end);
+  output_.erase(output_.begin(), end);
+  if (splitAt_) {
+    splitAt_ = 0;
+  }
+}
+
+bool Mp4Muxer::StartNewFile() {
+  if (splitAt_ != size_t{0}) {
+    return false;
+  }
+  splitAt_.reset();
+  return true;
+}
+
+void Mp4Muxer::WriteInitSegment() {
+  const auto &sps = spsSets_.back();
+  const auto dims = ParseSpsDimensions(sps).value_or(Dimensions{});
+  BoxWriter bw(output_);
+
+  bw.Begin("ftyp");
+  bw.FourCC("isom");
+  bw.U32(0x200);
+  for (const auto brand : {"isom", "iso6", "avc1", "mp41"}) {
+    bw.FourCC(brand);
+  }
+  bw.End();
+
+  bw.Begin("moov");
+  {
+    bw.BeginFull("mvhd", 0, 0);
+    bw.U32(0);    // creation_time
+    bw.U32(0);    // modification_time
+    bw.U32(1000); // timescale
+    bw.U32(0);    // duration, unknown for fragmented files
+    bw.U32(0x0001'0000); // rate
+    bw.U16(0x0100);      // volume
+    bw.Zeros(10);
+    bw.Matrix();
+    bw.Zeros(24);
+    bw.U32(2); // next_track_ID
+    bw.End();
+
+    bw.Begin("trak");
+    {
+      bw.BeginFull("tkhd", 0, 0x3); // enabled, in movie
+      bw.U32(0);
+      bw.U32(0);
+      bw.U32(1); // track_ID
+      bw.Zeros(4);
+      bw.U32(0); // duration
+      bw.Zeros(8);
+      bw.U16(0); // layer
+      bw.U16(0); // alternate_group
+      bw.U16(0); // volume
+      bw.Zeros(2);
+      bw.Matrix();
+      bw.U32(uint32_t(dims.width) << 16);
+      bw.U32(uint32_t(dims.height) << 16);
+      bw.End();
+
+      bw.Begin("mdia");
+      {
+        bw.BeginFull("mdhd", 0, 0);
+        bw.U32(0);
+        bw.U32(0);
+        bw.U32(timescale);
+        bw.U32(0);
+        bw.U16(0x55C4); // und
+        bw.U16(0);
+        bw.End();
+
+        bw.BeginFull("hdlr", 0, 0);
+        bw.U32(0);
+        bw.FourCC("vide");
+        bw.Zeros(12);
+        constexpr std::string_view name{"VideoHandler"};
+        bw.Bytes(std::span(reinterpret_cast<const uint8_t *>(name.data()),
+                           name.size()));
+        bw.U8(0);
+        bw.End();
+
+        bw.Begin("minf");
+        {
+          bw.BeginFull("vmhd", 0, 1);
+          bw.Zeros(8);
+          bw.End();
+
+          bw.Begin("dinf");
+          bw.BeginFull("dref", 0, 0);
+          bw.U32(1);
+          bw.BeginFull("url ", 0, 1); // media is in this file
+          bw.End();
+          bw.End();
+          bw.End();
+
+          bw.Begin("stbl");
+          {
+            bw.BeginFull("stsd", 0, 0);
+            bw.U32(1);
+            bw.Begin("avc1");
+            bw.Zeros(6);
+            bw.U16(1); // data_reference_index
+            bw.Zeros(16);
+            bw.U16(uint16_t(dims.width));
+            bw.U16(uint16_t(dims.height));
+            bw.U32(0x0048'0000); // 72 dpi
+            bw.U32(0x0048'0000);
+            bw.U32(0);
+            bw.U16(1); // frame_count
+            bw.Zeros(32);
+            bw.U16(0x0018); // depth
+            bw.U16(0xFFFF);
+
+            bw.Begin("avcC");
+            bw.U8(1); // configurationVersion
+            bw.U8(sps[1]);
+            bw.U8(sps[2]);
+            bw.U8(sps[3]);
+            bw.U8(0xFF); // 4 byte NAL lengths
+            bw.U8(uint8_t(0xE0 | spsSets_.size()));
+            for (const auto &set : spsSets_) {
+              bw.U16(uint16_t(set.size()));
+              bw.Bytes(set);
+            }
+            bw.U8(uint8_t(ppsSets_.size()));
+            for (const auto &set : ppsSets_) {
+              bw.U16(uint16_t(set.size()));
+              bw.Bytes(set);
+            }
+            bw.End();
+
+            bw.End(); // avc1
+            bw.End(); // stsd
+
+            // samples are described by the fragments
+            for (const auto box : {"stts", "stsc", "stco"}) {
+              bw.BeginFull(box, 0, 0);
+              bw.U32(0);
+              bw.End();
+            }
+            bw.BeginFull("stsz", 0, 0);
+            bw.U32(0);
+            bw.U32(0);
+            bw.End();
+          }
+          bw.End(); // stbl
+        }
+        bw.End(); // minf
+      }
+      bw.End(); // mdia
+    }
+    bw.End(); // trak
+
+    bw.Begin("mvex");
+    bw.BeginFull("trex", 0, 0);
+    bw.U32(1); // track_ID
+    bw.U32(1); // default_sample_description_index
+    bw.U32(0);
+    bw.U32(0);
+    bw.U32(0);
+    bw.End();
+    bw.End();
+  }
+  bw.End(); // moov
+
+  initWritten_ = true;
+}
+
+void Mp4Muxer::WriteFragment(std::optional<int64_t> endPts) {
+  if (samples_.empty()) {
+    return;
+  }
+  if (!initWritten_) {
+    WriteInitSegment();
+  }
+
+  BoxWriter bw(output_);
+  bw.Begin("moof");
+
+  bw.BeginFull("mfhd", 0, 0);
+  bw.U32(sequence_++);
+  bw.End();
+
+  bw.Begin("traf");
+  bw.BeginFull("tfhd", 0, 0x02'0000); // default-base-is-moof
+  bw.U32(1);
+  bw.End();
+
+  bw.BeginFull("tfdt", 1, 0);
+  bw.U64(decodeTime_);
+  bw.End();
+
+  // data offset, duration, size and flags for every sample
+  bw.BeginFull("trun", 0, 0x00'0701);
+  bw.U32(uint32_t(samples_.size()));
+  const size_t dataOffsetPos = bw.Position();
+  bw.U32(0);
+  for (size_t i = 0; i < samples_.size(); ++i) {
+    const auto &sample = samples_[i];
+    const std::optional<int64_t> nextPts =
+        i + 1 < samples_.size() ? samples_[i + 1].pts : endPts;
+    // a timestamp jump keeps the last frame interval
+    if (nextPts && *nextPts > sample.pts) {
+      lastDuration_ = uint32_t(*nextPts - sample.pts);
+    }
+    decodeTime_ += lastDuration_;
+    bw.U32(lastDuration_);
+    bw.U32(sample.size);
+    bw.U32(sample.keyFrame ? sampleFlagsSync : sampleFlagsNonSync);
+  }
+  bw.End(); // trun
+  bw.End(); // traf
+  const size_t moofSize = bw.End();
+  // samples start right after the mdat header
+  bw.Patch32(dataOffsetPos, uint32_t(moofSize + 8));
+
+  bw.Begin("mdat");
+  bw.Bytes(sampleData_);
+  bw.End();
+
+  samples_.clear();
+  sampleData_.clear();
+}
+
+} // namespace video_source
@@ -0,0 +1,117 @@
+#include "VideoSource/OpenH264Decoder.h"
+
+#include <cstring>
+#include <format>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+
+using namespace std::string_view_literals;
+
+namespace {
+[[nodiscard]] std::string MakeDecoderError(DECODING_STATE state, unsigned int) {
+  thread_local std::vector<std::string_view> errors;
+  errors.clear();
+  if (state & dsFramePending) {
+    errors.push_back("FramePending"sv);
+  }
+  if (state & dsRefLost) {
+    errors.push_back("RefLost"sv);
+  }
+  if (state & dsBitstreamError) {
+    errors.push_back("BitstreamError"sv);
+  }
+  if (state & dsDepLayerLost) {
+    errors.push_back("DepLayerLost"sv);
+  }
+  if (state & dsNoParamSets) {
+    errors.push_back("NoParamSets"sv);
+  }
+  if (state & dsDataErrorConcealed) {
+    errors.push_back("DataErrorConcealed"sv);
+  }
+  if (state & dsRefListNullPtrs) {
+    errors.push_back("RefListNullPtrs"sv);
+  }
+  if (state & dsInvalidArgument) {
+    errors.push_back("InvalidArgument"sv);
+  }
+  if (state & dsInitialOptExpected) {
+    errors.push_back("InitialOptExpected"sv);
+  }
+  if (state & dsOutOfMemory) {
+    errors.push_back("OutOfMemory"sv);
+  }
+  if (state & dsDstBufNeedExpan) {
+    errors.push_back("DstBufNeedExpan"sv);
+  }
+  std::stringstream ss;
+  for (size_t i = 0; auto error : errors) {
+    ss << error << (++i < errors.size() ? ", "sv : ""sv);
+  }
+
+  return std::format("Errors decoding stream ({:X}): {}"sv, int(state),
+                     ss.str());
+}
+} // namespace
+
+namespace video_source {
+
+// OpenH264 decodes on the calling thread and has no skip modes, the options
+// only apply to libavcodec
+OpenH264Decoder::OpenH264Decoder(const Options &) {
+  if (const int res = WelsCreateDecoder(&pSvcDecoder_); res != 0) {
+    throw std::runtime_error(
+        std::format("Failed to create code with error code {}", res));
+  }
+  sDecParam_.uiTargetDqLayer = (uint8_t)-1;
+  sDecParam_.eEcActiveIdc = ERROR_CON_SLICE_COPY;
+  sDecParam_.sVideoProperty.eVideoBsType = VIDEO_BITSTREAM_AVC;
+
+  pSvcDecoder_->Initialize(&sDecParam_);
+}
+
+OpenH264Decoder::~OpenH264Decoder() noexcept {
+  if (pSvcDecoder_) {
+    pSvcDecoder_->Uninitialize();
+    WelsDestroyDecoder(pSvcDecoder_);
+  }
+}
+
+void OpenH264Decoder::Decode(std::span<const uint8_t> accessUnit,
+                             int64_t timeStamp,
+                             const PictureCallback &onPicture) {
+  memset(&sDstBufInfo_, 0, sizeof(SBufferInfo));
+  sDstBufInfo_.uiInBsTimeStamp = uint64_t(timeStamp);
+  pDataYUV_[0] = pDataYUV_[1] = pDataYUV_[2] = nullptr;
+  const auto res = pSvcDecoder_->DecodeFrameNoDelay(
+      accessUnit.data(), int(accessUnit.size()), pDataYUV_, &sDstBufInfo_);
+
+  constexpr unsigned int errMask =
+      dsBitstreamError | dsNoParamSets | dsDepLayerLost;
+  if (res != 0 && (res & errMask) && LOGGER->should_log(spdlog::level::warn)) {
+    // a damaged stream fails on every frame, it is reported every few
+    // seconds and only formatted when it is
+    if (const auto suppressed = errorLimit_.Allow()) {
+      if (*suppressed > 0) {
+        LOGGER->warn("{} ({} more since the last report)",
+                     MakeDecoderError(res, errMask), *suppressed);
+      } else {
+        LOGGER->warn(MakeDecoderError(res, errMask));
+      }
+    }
+  }
+
+  if (sDstBufInfo_.iBufferStatus == 1) {
+    const auto &buffer = sDstBufInfo_.UsrData.sSystemBuffer;
+    onPicture({.planes = {pDataYUV_[0], pDataYUV_[1], pDataYUV_[2]},
+               .width = buffer.iWidth,
+               .height = buffer.iHeight,
+               .strideY = buffer.iStride[0],
+               .strideUV = buffer.iStride[1],
+               .timeStamp = int64_t(sDstBufInfo_.uiOutYuvTimeStamp)});
+  }
+}
+
+} // namespace video_source
@@ -0,0 +1,153 @@
+#include "VideoSource/PreRollBuffer.h"
+
+#include <algorithm>
+
+namespace {
+constexpr uint8_t nalTypeIdr{5};
+constexpr uint8_t nalTypeSps{7};
+constexpr uint8_t nalTypePps{8};
+} // namespace
+
+namespace video_source {
+
+PreRollBuffer::PreRollBuffer(std::chrono::milliseconds duration,
+                             size_t maxBytes)
+    : duration{duration}, maxBytes{maxBytes} {}
+
+uint8_t PreRollBuffer::NalType(std::span<const uint8_t> nalUnit) {
+  const size_t header = HeaderOffset(nalUnit);
+  return header == 0 ? 0 : nalUnit[header] & 0x1F;
+}
+
+bool PreRollBuffer::StartsPicture(std::span<const uint8_t> nalUnit) {
+  // the slice header opens with first_mb_in_slice as ue(v), which is 0 exactly
+  // when its first bit is set
+  const size_t header = HeaderOffset(nalUnit);
+  return header != 0 && header + 1 < nalUnit.size() &&
+         (nalUnit[header + 1] & 0x80) != 0;
+}
+
+size_t PreRollBuffer::HeaderOffset(std::span<const uint8_t> nalUnit) {
+  // skip a 3 or 4 byte start code
+  size_t i{0};
+  while (i < nalUnit.size() && i < 3 && nalUnit[i] == 0x00) {
+    ++i;
+  }
+  if (i < 2 || i >= nalUnit.size() || nalUnit[i] != 0x01 ||
+      i + 1 >= nalUnit.size()) {
+    return 0;
+  }
+  return i + 1;
+}
+
+void PreRollBuffer::Push(std::span<const uint8_t> nalUnit,
+                         Clock::time_point timeStamp,
+                         std::chrono::microseconds pts) {
+  const uint8_t type = NalType(nalUnit);
+  if (type == nalTypeSps) {
+    sps_.assign(nalUnit.begin(), nalUnit.end());
+  } else if (type == nalTypePps) {
+    pps_.assign(nalUnit.begin(), nalUnit.end());
+  }
+
+  Unit &unit = units_.emplace_back();
+  if (!spareData_.empty()) {
+    unit.data = std::move(spareData_.back());
+    spareData_.pop_back();
+  }
+  unit.data.assign(nalUnit.begin(), nalUnit.end());
+  unit.timeStamp = timeStamp;
+  unit.pts = pts;
+  unit.seq = nextSeq_++;
+  // only the first slice of an IDR picture starts a GOP, the picture's other
+  // slices belong to it
+  unit.keyFrame = type == nalTypeIdr && StartsPicture(nalUnit);
+  bytes_ += unit.data.size();
+
+  Evict();
+}
+
+void PreRollBuffer::Evict() {
+  // nothing before the first IDR can be decoded, parameter sets are kept aside
+  while (!units_.empty() && !units_.front().keyFrame) {
+    PopFront();
+  }
+
+  // drop the oldest GOP while the rest still covers the duration
+  while (!units_.empty()) {
+    const bool overBytes = bytes_ > maxBytes;
+    if (!overBytes &&
+        units_.back().timeStamp - units_.front().timeStamp < duration) {
+      break;
+    }
+    const auto next = std::find_if(units_.begin() + 1, units_.end(),
+                                   [](const Unit &u) { return u.keyFrame; });
+    if (next == units_.end()) {
+      // a single GOP over the limit cannot be kept whole
+      if (overBytes) {
+        Clear();
+      }
+      break;
+    }
+    if (!overBytes && units_.back().timeStamp - next->timeStamp < duration) {
+      break;
+    }
+    for (auto count = next - units_.begin(); count > 0; --count) {
+      PopFront();
+    }
+  }
+}
+
+void PreRollBuffer::PopFront() {
+  bytes_ -= units_.front().data.size();
+  if (spareData_.size() < 64) {
+    spareData_.push_back(std::move(units_.front().data));
+  }
+  units_.pop_front();
+}
+
+uint64_t PreRollBuffer::VisitAll(const Visitor &visitor) const {
+  const auto pts =
+      units_.empty() ? std::chrono::microseconds{0} : units_.front().pts;
+  if (!sps_.empty()) {
+    visitor(sps_, pts);
+  }
+  if (!pps_.empty()) {
+    visitor(pps_, pts);
+  }
+  for (const auto &unit : units_) {
+    visitor(unit.data, unit.pts);
+  }
+  return nextSeq_ - 1;
+}
+
+uint64_t PreRollBuffer::VisitSince(uint64_t seq,
+                                   const Visitor &visitor) const {
+  if (units_.empty()) {
+    return nextSeq_ - 1;
+  }
+  // sequence numbers are contiguous, so the first unit after seq is found
+  // by offset, if it was already evicted the clip has a gap
+  const uint64_t firstSeq = units_.front().seq;
+  const size_t start = seq + 1 > firstSeq ? size_t(seq + 1 - firstSeq) : 0;
+  for (size_t i = start; i < units_.size(); ++i) {
+    visitor(units_[i].data, units_[i].pts);
+  }
+  return nextSeq_ - 1;
+}
+
+void PreRollBuffer::Clear() {
+  while (!units_.empty()) {
+    PopFront();
+  }
+}
+
+std::chrono::milliseconds PreRollBuffer::GetBufferedDuration() const {
+  if (units_.empty()) {
+    return std::chrono::milliseconds{0};
+  }
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+      units_.back().timeStamp - units_.front().timeStamp);
+}
+
+} // namespace video_source
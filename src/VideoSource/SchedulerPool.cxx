@@ -0,0 +1,101 @@
+#include "Logger.h"
+#include "WindowsWrapper.h"
+
+#include "VideoSource/SchedulerPool.h"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <thread>
+
+#include <BasicUsageEnvironment.hh>
+
+namespace video_source {
+
+SchedulerPool::SchedulerPool(size_t size) {
+  if (size == 0) {
+    throw std::invalid_argument("A scheduler pool needs at least one loop");
+  }
+  for (size_t i = 0; i < size; ++i) {
+    auto pShard = std::make_unique<Shard>();
+    pShard->index = i;
+    pShard->pPool = this;
+    pShard->pSched =
+        std::shared_ptr<TaskScheduler>(BasicTaskScheduler::createNew());
+    shards_.push_back(std::move(pShard));
+  }
+}
+
+std::shared_ptr<TaskScheduler> SchedulerPool::Assign() {
+  // lag under a millisecond is noise, those loops count as equally loaded
+  const auto load = [](const std::unique_ptr<Shard> &pShard) {
+    return std::pair(pShard->lagUs.load() / 1000, pShard->feeds.load());
+  };
+  auto &pShard = *std::ranges::min_element(
+      shards_, [&load](const auto &a, const auto &b) {
+        return load(a) < load(b);
+      });
+  ++pShard->feeds;
+  LOGGER->debug("Assigned a feed to event loop {} ({} feeds)", pShard->index,
+                pShard->feeds.load());
+  return pShard->pSched;
+}
+
+std::shared_ptr<TaskScheduler> SchedulerPool::At(size_t index) const {
+  return shards_.at(index)->pSched;
+}
+
+size_t SchedulerPool::GetFeedCount(size_t index) const {
+  return shards_.at(index)->feeds;
+}
+
+std::chrono::microseconds SchedulerPool::GetLag(size_t index) const {
+  return std::chrono::microseconds(shards_.at(index)->lagUs.load());
+}
+
+void SchedulerPool::Run(EventLoopWatchVariable *pWatchVar) {
+  // schedulers are not thread safe, start the probes before the threads
+  for (auto &pShard : shards_) {
+    ScheduleProbe(*pShard);
+  }
+
+  std::vector<std::jthread> threads;
+  for (size_t i = 1; i < shards_.size(); ++i) {
+    threads.emplace_back([pSched = shards_[i]->pSched, pWatchVar, i] {
+#ifdef _WIN32
+      const auto desc = std::format(L"Event Loop {}", i);
+      SetThreadDescription(GetCurrentThread(), desc.c_str());
+#endif
+      pSched->doEventLoop(pWatchVar);
+    });
+  }
+  shards_.front()->pSched->doEventLoop(pWatchVar);
+  // every loop watches the same variable, so they all stop together
+  threads.clear();
+
+  for (auto &pShard : shards_) {
+    pShard->pSched->unscheduleDelayedTask(pShard->probeToken);
+  }
+}
+
+void SchedulerPool::ScheduleProbe(Shard &shard) {
+  shard.probeDue = std::chrono::steady_clock::now() + lagProbeInterval;
+  shard.probeToken = shard.pSched->scheduleDelayedTask(
+      std::chrono::duration_cast<std::chrono::microseconds>(lagProbeInterval)
+          .count(),
+      LagProbeProc, &shard);
+}
+
+void SchedulerPool::LagProbeProc(void *shard_clientData) {
+  if (shard_clientData) {
+    auto &shard = *static_cast<Shard *>(shard_clientData);
+    const auto lag = std::chrono::duration_cast<std::chrono::microseconds>(
+                         std::chrono::steady_clock::now() - shard.probeDue)
+                         .count();
+    // exponential moving average, a single slow step does not move feeds
+    shard.lagUs = (shard.lagUs * 7 + std::max<int64_t>(lag, 0)) / 8;
+    shard.pPool->ScheduleProbe(shard);
+  }
+}
+
+} // namespace video_source
@@ -1,7 +1,5 @@
 #include "VideoSource/VideoSource.h"
 
-#include <ranges>
-
 namespace video_source {
 
 VideoSource::VideoSource() noexcept {
@@ -9,14 +7,11 @@ VideoSource::VideoSource() noexcept {
 }
 
 double VideoSource::GetFramesPerSecond() const {
-  // use exponential moving average
-  return fps_;
+  return decodedRate.GetRate();
 }
 
 void VideoSource::SetFrame(Frame frame) {
-  const auto delta = std::chrono::duration_cast<std::chrono::duration<double>>(
-      frame.timeStamp - frame_.timeStamp);
-  fps_ = 0.1 / delta.count() + fps_ * (1.0 - fpsAlpha);
+  decodedRate.Add(frame.GetStreamTime());
   frame_ = frame;
   ++frameCount_;
   OnEvent(frame_);
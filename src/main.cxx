@@ -1,6 +1,7 @@
 #include "Logger.h"
 #include "WindowsWrapper.h"
 
+#include <algorithm>
 #include <array>
 #include <chrono>
 #include <csignal>
@@ -9,20 +10,32 @@
 #include <memory>
 #include <ranges>
 #include <thread>
+#include <tuple>
 #include <vector>
 
 #include <BasicUsageEnvironment.hh>
+#include <gsl/gsl>
+#define JSON_USE_IMPLICIT_CONVERSIONS 0
+#include <nlohmann/json.hpp>
 
 #include "Callback/AsyncFileSave.h"
 #include "Callback/AsyncHassHandler.h"
+#include "Callback/RetentionManager.h"
 #include "Callback/SyncHassHandler.h"
 #include "Callback/ThreadedHassHandler.h"
+#include "Callback/WebSocketHassHandler.h"
+#include "Detector/DetectorPool.h"
 #include "Detector/MotionDetector.h"
+#include "Detector/RoiMapper.h"
+#include "Detector/Zones.h"
+#include "Gui/LiveView.h"
 #include "Gui/WebHandler.h"
+#include "Util/MediaCatalog.h"
 #include "Util/ProgramOptions.h"
 #include "VideoSource/Http.h"
 #include "VideoSource/Live555.h"
 #include "VideoSource/RestartWatcher.h"
+#include "VideoSource/SchedulerPool.h"
 #include "VideoSource/VideoSource.h"
 
 using namespace std::string_view_literals;
@@ -40,12 +53,18 @@ struct ExitSignalHandler {
 };
 
 struct SourceAndHandlers {
+  std::string feedId;
   std::shared_ptr<video_source::VideoSource> pSource;
+  // set when detection runs on a separate sub-stream
+  std::shared_ptr<video_source::VideoSource> pDetectionSource;
   std::shared_ptr<detector::MOGMotionDetector> pDetector;
+  std::shared_ptr<detector::DetectorPool::Strand> pDetectorStrand;
   std::shared_ptr<callback::BaseHassHandler> pHassHandler;
   std::shared_ptr<callback::AsyncFileSave> pFileSaveHandler;
   std::unique_ptr<video_source::RestartWatcher<callback::BaseHassHandler>>
       pRestartWatcher;
+  std::unique_ptr<video_source::RestartWatcher<callback::BaseHassHandler>>
+      pDetectionRestartWatcher;
 };
 
 static ExitSignalHandler exitSignalHandler;
@@ -58,8 +77,14 @@ void SignalHandlerWrapper(int signal) {
 
 void App(const util::ProgramOptions &opts) {
 
-  std::shared_ptr<TaskScheduler> pSched =
-      std::shared_ptr<TaskScheduler>(BasicTaskScheduler::createNew());
+  // one event loop per core, but no more loops than feeds
+  const size_t eventLoops =
+      opts.eventLoopThreads > 0
+          ? opts.eventLoopThreads
+          : std::clamp<size_t>(std::thread::hardware_concurrency(), 1,
+                               std::max<size_t>(opts.feeds.size(), 1));
+  video_source::SchedulerPool schedulers(eventLoops);
+  LOGGER->info("Running feeds on {} event loops", eventLoops);
 
   std::shared_ptr<gui::WebHandler> pWebHandler;
   if (opts.webUiPort > 0 && !opts.webUiHost.empty()) {
@@ -69,63 +94,181 @@ void App(const util::ProgramOptions &opts) {
     pWebHandler->Start();
   }
 
+  std::shared_ptr<callback::RetentionManager> pRetention;
+  if (!opts.saveDestination.empty()) {
+    pRetention = std::make_shared<callback::RetentionManager>(
+        opts.saveDestination,
+        callback::RetentionManager::Budget{.maxBytes = opts.saveMaxBytes,
+                                           .maxAge = opts.saveMaxAge});
+    if (pWebHandler) {
+      gui::WebHandler::SetStorageUsageProvider(
+          [pRetention] { return pRetention->DumpUsage(); });
+    }
+  }
+  // the provider holds the retention manager, drop it so its thread is
+  // joined here rather than at static destruction
+  const auto clearStorageUsage = gsl::finally([] {
+    gui::WebHandler::SetStorageUsageProvider({});
+  });
+
   std::vector<SourceAndHandlers> sources;
 
+  // declared after the sources so the workers stop before the strands go
+  const size_t detectorThreads =
+      opts.detectorThreads > 0
+          ? opts.detectorThreads
+          : std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  detector::DetectorPool detectors(detectorThreads);
+  LOGGER->info("Running motion detection on {} threads", detectorThreads);
+
   for (const auto &[feedId, feedOpts] : opts.feeds) {
     LOGGER->info("Processing feed: {}", feedId);
+    // everything for this feed is scheduled on its own loop
+    const std::shared_ptr<TaskScheduler> pSched = schedulers.Assign();
+
+    const auto makeRtspSource = [&](const boost::url &url) {
+      auto pLive555Source = std::make_shared<video_source::Live555VideoSource>(
+          pSched, url, feedOpts.sourceUsername, feedOpts.sourcePassword);
+      pLive555Source->transport =
+          video_source::Live555VideoSource::ParseTransport(
+              feedOpts.rtspTransport);
+      pLive555Source->socketReceiveBufferSize = feedOpts.rtspSocketBufferSize;
+      pLive555Source->reorderThreshold = feedOpts.rtspReorderThreshold;
+      pLive555Source->decoderBackend =
+          video_source::Decoder::ParseBackend(feedOpts.decoder);
+      pLive555Source->decoderOptions.threads = feedOpts.decoderThreads;
+      return pLive555Source;
+    };
 
     std::shared_ptr<video_source::VideoSource> pSource{nullptr};
+    std::shared_ptr<video_source::VideoSource> pDetectionSource{nullptr};
     if (feedOpts.sourceUrl.scheme() == "http"sv ||
         feedOpts.sourceUrl.scheme() == "https"sv) {
       pSource = std::make_shared<video_source::HttpVideoSource>(
           feedOpts.sourceUrl, feedOpts.sourceUsername, feedOpts.sourcePassword);
     } else if (feedOpts.sourceUrl.scheme() == "rtsp"sv) {
-      auto pLive555Source = std::make_shared<video_source::Live555VideoSource>(
-          pSched, feedOpts.sourceUrl, feedOpts.sourceUsername,
-          feedOpts.sourcePassword);
+      auto pLive555Source = makeRtspSource(feedOpts.sourceUrl);
+      if (feedOpts.saveClips) {
+        pLive555Source->pPreRollBuffer =
+            std::make_shared<video_source::PreRollBuffer>(feedOpts.clipPreRoll);
+      }
       pSource = pLive555Source;
     } else {
       LOGGER->error(std::format("Invalid scheme {} for URL",
                                 std::string_view(feedOpts.sourceUrl.scheme())));
       continue;
     }
+
+    // both streams run on this feed's loop, so the detection callbacks can
+    // read the main stream's latest frame
+    if (!feedOpts.detectionSourceUrl.empty()) {
+      if (feedOpts.sourceUrl.scheme() == "rtsp"sv &&
+          feedOpts.detectionSourceUrl.scheme() == "rtsp"sv) {
+        LOGGER->info("Detecting motion on {}", feedOpts.detectionSourceUrl);
+        pDetectionSource = makeRtspSource(feedOpts.detectionSourceUrl);
+        // the main stream is only decoded when there is a use for its frames
+        std::static_pointer_cast<video_source::Live555VideoSource>(pSource)
+            ->decode = pWebHandler || feedOpts.saveDetectionFrame;
+      } else {
+        LOGGER->warn("A detection source needs RTSP for both streams, "
+                     "detecting motion on {}",
+                     feedOpts.sourceUrl);
+      }
+    }
+
     sources.push_back(
-        {.pSource = pSource,
+        {.feedId = feedId,
+         .pSource = pSource,
+         .pDetectionSource = pDetectionSource,
          .pRestartWatcher = std::make_unique<
              video_source::RestartWatcher<callback::BaseHassHandler>>(
              std::format("Source-{}", sources.size()), pSource, pSched)});
+    if (pDetectionSource) {
+      sources.back().pDetectionRestartWatcher = std::make_unique<
+          video_source::RestartWatcher<callback::BaseHassHandler>>(
+          std::format("Source-{}-Detection", sources.size() - 1),
+          pDetectionSource, pSched);
+    } else {
+      pDetectionSource = pSource;
+    }
+    if (auto pLive555Source =
+            std::dynamic_pointer_cast<video_source::Live555VideoSource>(
+                pDetectionSource)) {
+      pLive555Source->decoderOptions.skipNonReference =
+          feedOpts.decoderSkipNonReference;
+      pLive555Source->decoderOptions.skipLoopFilter =
+          feedOpts.decoderSkipLoopFilter;
+      pLive555Source->maxWidth = feedOpts.detectionWidth;
+    }
 
     auto pDetector = std::make_shared<detector::MOGMotionDetector>(
         detector::MOGMotionDetector::Options{.detectionSize =
                                                  feedOpts.detectionSize});
 
-    auto onFrameCallback =
-        [pDetector, mask = cv::Mat()](video_source::Frame frame) mutable {
-          if (mask.size() != frame.img.size()) {
-            mask = cv::Mat::zeros(frame.img.size(), frame.img.type());
-            cv::rectangle(mask,
-                          cv::Rect(mask.cols * 0.05, mask.rows * 0.08,
-                                   mask.cols * 0.9, mask.rows * 0.84),
-                          cv::Scalar(0xFF), -1);
-            pDetector->mask = mask;
+    // detection runs on the shared pool, the subscribers below still run on
+    // this feed's loop
+    auto pDetectorStrand = detectors.MakeStrand(feedId, pDetector, pSched);
+    // the zones are rasterised at the analysed size, again only when they
+    // are edited or the resolution changes
+    auto pZones = std::make_shared<detector::Zones>(feedOpts.zones);
+    pDetectorStrand->prepare =
+        [pZones, version = uint64_t{0}, size = cv::Size()](
+            detector::Detector &detector,
+            const video_source::Frame &frame) mutable {
+          if (pZones->GetVersion() != version || frame.img.size() != size) {
+            version = pZones->GetVersion();
+            size = frame.img.size();
+            detector.mask = pZones->Rasterise(size);
           }
-          pDetector->FeedFrame(frame);
         };
 
-    pSource->Subscribe(onFrameCallback);
+    if (feedOpts.detectionIdleAfter.count() > 0 &&
+        feedOpts.detectionIdleStride > 1) {
+      pDetectorStrand->pGate =
+          std::make_shared<detector::MotionGate>(detector::MotionGate::Options{
+              .idleAfter = feedOpts.detectionIdleAfter,
+              .idleStride = feedOpts.detectionIdleStride});
+    }
+
+    auto onFrameCallback = [pDetectorStrand](video_source::Frame frame) {
+      pDetectorStrand->Post(frame);
+    };
+
+    pDetectionSource->Subscribe(onFrameCallback);
     sources.back().pDetector = pDetector;
 
+    // detections on a sub-stream are moved onto the main stream's latest
+    // frame for saving and the web UI, each subscriber keeps its own regions
+    const auto toMainStream = [pSource, pDetectionSource](
+                                  detector::RoiMapper &mapper,
+                                  const detector::Payload &data) {
+      return pSource == pDetectionSource
+                 ? data
+                 : mapper.Map(data, pSource->GetCurrentFrame());
+    };
+    sources.back().pDetectorStrand = pDetectorStrand;
+
     std::shared_ptr<callback::BaseHassHandler> pHassHandler;
     if (opts.CanSetupHass(feedOpts)) {
       LOGGER->info(
           "Setting up Home Assistant status update for {} hosted at {}",
           feedOpts.hassEntityId, opts.hassUrl);
-      if (std::dynamic_pointer_cast<video_source::HttpVideoSource>(pSource)) {
+      if (opts.hassWebSocket) {
+        LOGGER->info("Publishing Home Assistant events over a websocket");
+        auto pWebSocketHassHandler =
+            std::make_shared<callback::WebSocketHassHandler>(
+                opts.hassUrl, opts.hassToken, feedOpts.hassEntityId);
+
+        pWebSocketHassHandler->Start();
+        pHassHandler = pWebSocketHassHandler;
+      } else if (std::dynamic_pointer_cast<video_source::HttpVideoSource>(
+                     pSource)) {
         // Require Threaded
         LOGGER->info("Running Home Assistant callbacks in separate thread");
         auto pThreadedHassHandler =
             std::make_shared<callback::ThreadedHassHandler>(
                 opts.hassUrl, opts.hassToken, feedOpts.hassEntityId);
+        pThreadedHassHandler->useHttp2 = opts.hassHttp2;
 
         pThreadedHassHandler->Start();
         pHassHandler = pThreadedHassHandler;
@@ -134,6 +277,8 @@ void App(const util::ProgramOptions &opts) {
         LOGGER->info("Running Home Assistant callbacks in main event loop");
         auto pAsyncHassHandler = std::make_shared<callback::AsyncHassHandler>(
             pSched, opts.hassUrl, opts.hassToken, feedOpts.hassEntityId);
+        pAsyncHassHandler->useHttp2 = opts.hassHttp2;
+        pAsyncHassHandler->batchWindow = opts.hassBatchWindow;
         pAsyncHassHandler->Register();
         pHassHandler = pAsyncHassHandler;
       }
@@ -143,11 +288,15 @@ void App(const util::ProgramOptions &opts) {
 
       auto onMotionDetectionCallbackHass =
           [pHassHandler](detector::Payload data) {
-            pHassHandler->operator()(data.rois);
+            pHassHandler->operator()(data.rois, data.frame.GetCaptureTime());
           };
       pDetector->Subscribe(onMotionDetectionCallbackHass);
       sources.back().pHassHandler = pHassHandler;
-      sources.back().pRestartWatcher->wpCallbacks.push_back(pHassHandler);
+      // the entity follows the stream motion is detected on
+      auto &pWatcher = sources.back().pDetectionRestartWatcher
+                           ? sources.back().pDetectionRestartWatcher
+                           : sources.back().pRestartWatcher;
+      pWatcher->wpCallbacks.push_back(pHassHandler);
     }
 
     std::shared_ptr<callback::AsyncFileSave> pFileSaveHandler;
@@ -157,10 +306,34 @@ void App(const util::ProgramOptions &opts) {
             pSched, opts.saveDestination / feedId, feedOpts.saveSourceUrl,
             feedOpts.sourceUsername, feedOpts.sourcePassword);
         pFileSaveHandler->Register();
+        pFileSaveHandler->SetRetentionManager(pRetention);
         pFileSaveHandler->SetLimitSavedFilePaths(feedOpts.saveImageLimit);
+        auto pCatalog = std::make_shared<util::MediaCatalog>(
+            pFileSaveHandler->GetDstPath());
+        pCatalog->Load();
+        pFileSaveHandler->SetCatalog(pCatalog);
+        pRetention->AddFeed(feedId, pCatalog,
+                            {.maxBytes = feedOpts.saveMaxBytes,
+                             .maxFiles = feedOpts.saveImageLimit,
+                             .maxAge = feedOpts.saveMaxAge});
+        pFileSaveHandler->saveDetectionFrame = feedOpts.saveDetectionFrame;
+        pFileSaveHandler->drawRois = feedOpts.saveDrawRois;
+        pFileSaveHandler->thumbnailWidth = feedOpts.saveThumbnailWidth;
+        if (feedOpts.saveClips) {
+          auto pLive555Source =
+              std::dynamic_pointer_cast<video_source::Live555VideoSource>(
+                  pSource);
+          if (pLive555Source) {
+            pFileSaveHandler->clipPostRoll = feedOpts.clipPostRoll;
+            pFileSaveHandler->SetPreRollBuffer(pLive555Source->pPreRollBuffer);
+          } else {
+            LOGGER->warn("Clips can only be saved from RTSP sources");
+          }
+        }
         auto onMotionDetectionCallbackSave =
-            [pFileSaveHandler](detector::Payload data) {
-              (*pFileSaveHandler)(data);
+            [pFileSaveHandler, toMainStream,
+             mapper = detector::RoiMapper()](detector::Payload data) mutable {
+              (*pFileSaveHandler)(toMainStream(mapper, data));
             };
         pDetector->Subscribe(onMotionDetectionCallbackSave);
         LOGGER->info("Saving motion detection images to {}",
@@ -173,34 +346,86 @@ void App(const util::ProgramOptions &opts) {
       if (pFileSaveHandler) {
         gui::WebHandler::SetSavedFilesServePath(feedId,
                                                 pFileSaveHandler->GetDstPath());
+        gui::WebHandler::SetSavedFilesCatalog(feedId,
+                                              pFileSaveHandler->GetCatalog());
       }
-      auto onMotionDetectorCallbackGui = [pWebHandler, pDetector, pSource,
-                                          &feedId](detector::Payload data) {
-        (*pWebHandler)({.rois = data.rois,
-                        .frame = data.frame,
-                        .detail = pDetector->GetModel(),
-                        .fps = pSource->GetFramesPerSecond(),
-                        .feedId = feedId});
-      };
+      gui::WebHandler::SetZones(feedId, pZones);
+      // the live view follows the source, so frames the gate skips still
+      // show. The detector's subscribers run while its strand is still busy,
+      // so its model is only read there.
+      auto pLiveView = std::make_shared<gui::LiveView>(pWebHandler, feedId);
+      auto onMotionDetectorCallbackGui =
+          [pLiveView, pDetector, toMainStream,
+           mapper = detector::RoiMapper()](detector::Payload data) mutable {
+            pLiveView->OnDetection(toMainStream(mapper, data).rois,
+                                   pDetector->GetModel());
+          };
       pDetector->Subscribe(onMotionDetectorCallbackGui);
+      auto onFrameCallbackGui = [pLiveView,
+                                 pSource](video_source::Frame frame) {
+        pLiveView->OnFrame(std::move(frame), pSource->GetFramesPerSecond());
+      };
+      pSource->Subscribe(onFrameCallbackGui);
+    }
+  }
+
+  if (pWebHandler) {
+    // the provider shares the video sources rather than referring to the
+    // list, which is torn down with the rest of the feed
+    std::vector<std::tuple<std::string,
+                           std::shared_ptr<video_source::VideoSource>,
+                           std::shared_ptr<video_source::VideoSource>>>
+        rateSources;
+    for (const auto &source : sources) {
+      rateSources.emplace_back(source.feedId, source.pSource,
+                               source.pDetectionSource);
     }
+    gui::WebHandler::SetDetectorStatsProvider([&detectors, rateSources] {
+      auto stats = nlohmann::json::parse(detectors.DumpStats());
+      for (const auto &[feedId, pSource, pDetectionSource] : rateSources) {
+        auto &feed = stats["feeds"][feedId];
+        feed["inputRate"] = pSource->inputRate.GetSummary();
+        feed["decodedRate"] = pSource->decodedRate.GetSummary();
+        if (pDetectionSource) {
+          feed["detectionInputRate"] =
+              pDetectionSource->inputRate.GetSummary();
+          feed["detectionDecodedRate"] =
+              pDetectionSource->decodedRate.GetSummary();
+        }
+      }
+      return stats.dump();
+    });
   }
+  // the provider refers to the detector pool, so it has to go first
+  const auto clearDetectorStats = gsl::finally([] {
+    gui::WebHandler::SetDetectorStatsProvider({});
+  });
+  // nothing the web interface serves may outlive App, so the logger can be
+  // shut down once it returns
+  const auto clearFeeds = gsl::finally([&sources] {
+    for (const auto &source : sources) {
+      gui::WebHandler::SetSavedFilesCatalog(source.feedId, nullptr);
+      gui::WebHandler::SetZones(source.feedId, nullptr);
+    }
+  });
 
   std::signal(SIGINT, SignalHandlerWrapper);
   std::signal(SIGTERM, SignalHandlerWrapper);
-  for (auto pSource :
-       sources | std::views::transform(&SourceAndHandlers::pSource)) {
-    if (pSource) {
-      pSource->StartStream();
+  for (const auto &source : sources) {
+    for (const auto &pSource : {source.pSource, source.pDetectionSource}) {
+      if (pSource) {
+        pSource->StartStream();
+      }
     }
   }
 
-  pSched->doEventLoop(&exitSignalHandler.watchVar);
+  schedulers.Run(&exitSignalHandler.watchVar);
 
-  for (auto pSource :
-       sources | std::views::transform(&SourceAndHandlers::pSource)) {
-    if (pSource) {
-      pSource->StopStream();
+  for (const auto &source : sources) {
+    for (const auto &pSource : {source.pSource, source.pDetectionSource}) {
+      if (pSource) {
+        pSource->StopStream();
+      }
     }
   }
 
@@ -218,6 +443,7 @@ void App(const util::ProgramOptions &opts) {
 }
 
 int main(int argc, const char **argv) {
+  int exitCode{EXIT_SUCCESS};
   try {
     auto stdoutLogger = logger::InitStderrLogger();
     auto stderrLogger = logger::InitStdoutLogger();
@@ -229,7 +455,10 @@ int main(int argc, const char **argv) {
     }
   } catch (const std::exception &e) {
     ERR_LOGGER->critical(e.what());
-    return EXIT_FAILURE;
+    exitCode = EXIT_FAILURE;
   }
-  return EXIT_SUCCESS;
+  // the console logger is asynchronous, write out what is still queued and
+  // stop its thread before static destruction
+  spdlog::shutdown();
+  return exitCode;
 }
\ No newline at end of file
@@ -25,6 +25,7 @@ static boost::url url;
 
 static std::jthread listenerThread;
 static std::atomic_int hassApiCalls_{0};
+static std::atomic_bool closeWebSockets_{false};
 
 static std::atomic_int seed{1};
 
@@ -95,6 +96,8 @@ void SimServer::ev_handler(struct mg_connection *c, int ev, void *ev_data) {
       mg_send(c, jpgBuf.data(), jpgBuf.size());
     } else if (mg_match(hm->uri, mg_str("/api/hello"), nullptr)) {
       mg_http_reply(c, 200, "", "Hello There");
+    } else if (mg_match(hm->uri, mg_str("/api/websocket"), nullptr)) {
+      mg_ws_upgrade(c, hm, nullptr);
     } else if (mg_str entity_id[2];
                mg_match(hm->uri, mg_str("/api/states/*"), entity_id)) {
 
@@ -136,6 +139,49 @@ void SimServer::ev_handler(struct mg_connection *c, int ev, void *ev_data) {
         mg_http_reply(c, 401, "", "%s", "401: Unauthorized");
       }
     }
+  } else if (ev == MG_EV_WS_OPEN) {
+    // Home Assistant websocket API, the client must authenticate first
+    c->data[0] = 0;
+    const auto msg = json{{"type", "auth_required"}}.dump();
+    mg_ws_send(c, msg.data(), msg.size(), WEBSOCKET_OP_TEXT);
+  } else if (ev == MG_EV_WS_MSG) {
+    struct mg_ws_message *wm = (struct mg_ws_message *)ev_data;
+    const auto request =
+        json::parse(std::string_view(wm->data.buf, wm->data.len), nullptr,
+                    false);
+    if (request.is_discarded() || !request.contains("type")) {
+      return;
+    }
+    const auto type = request["type"].template get<std::string>();
+
+    json reply;
+    if (type == "auth"sv) {
+      const bool authorized =
+          request.contains("access_token") &&
+          request["access_token"].template get<std::string>() ==
+              sim_token::bearer;
+      c->data[0] = authorized ? 1 : 0;
+      reply["type"] = authorized ? "auth_ok" : "auth_invalid";
+    } else if (c->data[0] == 0) {
+      c->is_draining = 1;
+      return;
+    } else if (type == "ping"sv) {
+      reply["id"] = request["id"];
+      reply["type"] = "pong";
+    } else if (type == "fire_event"sv) {
+      ++hassApiCalls_;
+      reply["id"] = request["id"];
+      reply["type"] = "result";
+      reply["success"] = true;
+      reply["result"] = json::object();
+    } else {
+      reply["id"] = request["id"];
+      reply["type"] = "result";
+      reply["success"] = false;
+      reply["error"] = {{"code", "unknown_command"}, {"message", type}};
+    }
+    const auto msg = reply.dump();
+    mg_ws_send(c, msg.data(), msg.size(), WEBSOCKET_OP_TEXT);
   }
 }
 
@@ -175,6 +221,13 @@ void SimServer::Start(int port) noexcept {
       bool dropBar{true};
       while (!stopToken.stop_requested()) {
         mg_mgr_poll(&mgr, 1000);
+        if (closeWebSockets_.exchange(false)) {
+          for (mg_connection *conn = mgr.conns; conn; conn = conn->next) {
+            if (conn->is_websocket) {
+              conn->is_closing = 1;
+            }
+          }
+        }
         if (dropBar) { // do once
           dropBar = false;
           sync.arrive_and_drop();
@@ -194,6 +247,8 @@ void SimServer::Stop() { listenerThread = {}; }
 
 const boost::url &SimServer::GetBaseUrl() { return url; }
 
+void SimServer::CloseWebSockets() { closeWebSockets_ = true; }
+
 int SimServer::GetHassApiCount() { return hassApiCalls_.load(); }
 
 int SimServer::WaitForHassApiCount(int target, std::chrono::seconds timeout) {
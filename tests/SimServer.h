@@ -21,6 +21,8 @@ public:
   static void Start(int port) noexcept;
   static void Stop();
   static const boost::url &GetBaseUrl();
+  // Drop every open websocket, as Home Assistant does on restart
+  static void CloseWebSockets();
 
   SimServer(Token, int port);
   ~SimServer() noexcept = default;
@@ -3,22 +3,34 @@
 
 #include "Callback/AsyncFileSave.h"
 #include "Callback/AsyncHassHandler.h"
+#include "Callback/CurlMultiReactor.h"
+#include "Callback/HassStateBatcher.h"
+#include "Callback/RetentionManager.h"
+#include "Callback/SharedRegistry.h"
 #include "Callback/SyncHassHandler.h"
 #include "Callback/ThreadedHassHandler.h"
+#include "Callback/UringFileWriter.h"
+#include "Callback/WebSocketHassHandler.h"
 #include "SimServer.h"
+#include "Util/BufferOperations.h"
 #include "Util/CurlWrapper.h"
+#include "VideoSource/PreRollBuffer.h"
 
 #include <BasicUsageEnvironment.hh>
 #include <opencv2/imgcodecs.hpp>
 
+#include <array>
 #include <barrier>
 #include <bit>
 #include <chrono>
 #include <filesystem>
 #include <format>
+#include <fstream>
 #include <list>
 #include <random>
+#include <ranges>
 #include <string_view>
+#include <thread>
 
 using namespace std::chrono_literals;
 using namespace std::string_view_literals;
@@ -120,6 +132,95 @@ TEST_P(TestAsyncHassHandler, CanPostEntityUpdate) {
   }
 }
 
+TEST(TestSharedRegistry, SharesPerKeyAndDropsReleasedInstances) {
+  callback::SharedRegistry<int, int> registry;
+  auto pFirst = registry.GetOrCreate(1, 10);
+  EXPECT_EQ(pFirst, registry.GetOrCreate(1, 20));
+  EXPECT_EQ(10, *pFirst);
+  {
+    auto pSecond = registry.GetOrCreate(2, 30);
+    EXPECT_NE(pFirst, pSecond);
+    EXPECT_EQ(2, registry.Size());
+  }
+  // the released entry goes on the next lookup
+  EXPECT_EQ(pFirst, registry.GetOrCreate(1));
+  EXPECT_EQ(1, registry.Size());
+  pFirst.reset();
+  EXPECT_EQ(0, *registry.GetOrCreate(1));
+}
+
+TEST(TestCurlMultiReactor, SharedPerSchedulerAndCompletesTransfers) {
+  auto pSched = std::shared_ptr<TaskScheduler>(BasicTaskScheduler::createNew());
+  auto pOtherSched =
+      std::shared_ptr<TaskScheduler>(BasicTaskScheduler::createNew());
+
+  auto pReactor = callback::CurlMultiReactor::ForScheduler(pSched);
+  EXPECT_EQ(pReactor, callback::CurlMultiReactor::ForScheduler(pSched));
+  EXPECT_NE(pReactor, callback::CurlMultiReactor::ForScheduler(pOtherSched));
+
+  auto url = SimServer::GetBaseUrl();
+  url.set_path("/api/hello");
+
+  static constexpr int transferCount{3};
+  std::array<std::vector<char>, transferCount> bufs;
+  int completed{0};
+  EventLoopWatchVariable wv{0};
+
+  for (auto &buf : bufs) {
+    auto pWCurl = std::make_shared<util::CurlWrapper>();
+    (*pWCurl)(curl_easy_setopt, CURLOPT_URL, url.c_str());
+    (*pWCurl)(curl_easy_setopt, CURLOPT_WRITEFUNCTION,
+              util::FillBufferCallback);
+    (*pWCurl)(curl_easy_setopt, CURLOPT_WRITEDATA, &buf);
+    pReactor->Submit(pWCurl, [&](CURLcode result) {
+      EXPECT_EQ(CURLE_OK, result);
+      if (++completed == transferCount) {
+        wv.store(1);
+      }
+    });
+  }
+  EXPECT_EQ(transferCount, pReactor->GetPendingTransfers());
+
+  pSched->scheduleDelayedTask((10'000'000us).count(), EndLoop, &wv);
+  pSched->doEventLoop(&wv);
+
+  EXPECT_EQ(transferCount, completed);
+  EXPECT_EQ(0, pReactor->GetPendingTransfers());
+  for (const auto &buf : bufs) {
+    EXPECT_EQ(std::string_view(buf.data(), buf.size()), "Hello There");
+  }
+}
+
+TEST(TestHassStateBatcher, CoalescesUpdatesWithinWindow) {
+  auto pSched = std::shared_ptr<TaskScheduler>(BasicTaskScheduler::createNew());
+  auto pBatcher = callback::HassStateBatcher::ForScheduler(pSched);
+  EXPECT_EQ(pBatcher, callback::HassStateBatcher::ForScheduler(pSched));
+
+  int firstEntity{0};
+  int secondEntity{0};
+  const int keyA{0};
+  const int keyB{0};
+
+  pBatcher->Enqueue(&keyA, [&] { firstEntity = 1; }, 200ms);
+  // a newer state for the same entity replaces the queued one
+  pBatcher->Enqueue(&keyA, [&] { firstEntity = 2; }, 200ms);
+  // a tighter bound pulls the whole window in
+  pBatcher->Enqueue(&keyB, [&] { ++secondEntity; }, 20ms);
+  EXPECT_EQ(2, pBatcher->GetQueuedUpdates());
+
+  EventLoopWatchVariable wv{0};
+  const auto start = std::chrono::steady_clock::now();
+  pSched->scheduleDelayedTask((100'000us).count(), EndLoop, &wv);
+  pSched->doEventLoop(&wv);
+
+  EXPECT_LT(std::chrono::steady_clock::now() - start, 200ms);
+  EXPECT_EQ(2, firstEntity);
+  EXPECT_EQ(1, secondEntity);
+  EXPECT_EQ(0, pBatcher->GetQueuedUpdates());
+  EXPECT_EQ(1, pBatcher->GetFlushedBatches());
+  EXPECT_EQ(2, pBatcher->GetFlushedUpdates());
+}
+
 class TestSyncHassHandler : public testing::TestWithParam<std::string_view> {};
 
 TEST_P(TestSyncHassHandler, CanPostEntityUpdate) {
@@ -135,6 +236,131 @@ TEST_P(TestSyncHassHandler, CanPostEntityUpdate) {
             SimServer::WaitForHassApiCount(startApiCalls + 2, 10s));
 }
 
+class HassStateProbe : public callback::BaseHassHandler {
+public:
+  using BaseHassHandler::BaseHassHandler;
+  using BaseHassHandler::GetNextState;
+  using BaseHassHandler::SerializeState;
+
+protected:
+  void UpdateState_Impl(const callback::HassState &state) override {
+    UpdateStateInternal(state);
+  }
+};
+
+TEST(TestHassState, ComparesCompactlyAndSerializesOnDemand) {
+  HassStateProbe binarySensor(SimServer::GetBaseUrl(), sim_token::bearer,
+                              "binary_sensor.motion_detector");
+  binarySensor.friendlyName = "Front \"Door\"";
+
+  const std::vector rois = {cv::Rect(1, 2, 3, 4), cv::Rect(5, 6, 7, 8)};
+  binarySensor(rois);
+  const callback::HassState first = binarySensor.GetNextState();
+  EXPECT_EQ(callback::HassState::Value::On, first.value);
+  // a later frame with the same regions is the same state
+  binarySensor(rois, std::chrono::system_clock::time_point(
+                         std::chrono::milliseconds(1'700'000'000'250)));
+  EXPECT_EQ(first, binarySensor.GetNextState());
+  const callback::HassState timed = binarySensor.GetNextState();
+  binarySensor(detector::RegionsOfInterest{});
+  EXPECT_NE(first, binarySensor.GetNextState());
+
+  std::string payload;
+  binarySensor.SerializeState(first, payload);
+  const auto parsed = nlohmann::json::parse(payload);
+  EXPECT_EQ("binary_sensor.motion_detector",
+            parsed["entity_id"].get<std::string>());
+  EXPECT_EQ("on", parsed["state"].get<std::string>());
+  EXPECT_EQ("motion", parsed["attributes"]["device_class"].get<std::string>());
+  EXPECT_EQ("Front \"Door\"",
+            parsed["attributes"]["friendly_name"].get<std::string>());
+  ASSERT_EQ(2u, parsed["attributes"]["rois"].size());
+  EXPECT_EQ(7, parsed["attributes"]["rois"][1]["width"].get<int>());
+  EXPECT_FALSE(parsed["attributes"].contains("frame_time"));
+  binarySensor.SerializeState(timed, payload);
+  EXPECT_EQ("2023-11-14T22:13:20.250Z",
+            nlohmann::json::parse(payload)["attributes"]["frame_time"]
+                .get<std::string>());
+
+  HassStateProbe sensor(SimServer::GetBaseUrl(), sim_token::bearer,
+                        "sensor.motion_objects");
+  sensor(rois);
+  sensor.SerializeState(sensor.GetNextState(), payload);
+  EXPECT_EQ(
+      R"({"entity_id":"sensor.motion_objects","state":"2","attributes":{}})",
+      payload);
+  sensor({});
+  sensor.SerializeState(sensor.GetNextState(), payload);
+  EXPECT_EQ("unknown",
+            nlohmann::json::parse(payload)["state"].get<std::string>());
+
+  HassStateProbe quoted(SimServer::GetBaseUrl(), sim_token::bearer,
+                        "sensor.\"quoted\"");
+  quoted.SerializeState(quoted.GetNextState(), payload);
+  EXPECT_EQ("sensor.\"quoted\"",
+            nlohmann::json::parse(payload)["entity_id"].get<std::string>());
+}
+
+TEST(TestWebSocketHassHandler, PublishesStateAndReconnects) {
+  using sc = std::chrono::steady_clock;
+  const int startApiCalls = SimServer::GetHassApiCount();
+
+  callback::WebSocketHassHandler binarySensor(
+      SimServer::GetBaseUrl(), sim_token::bearer,
+      "binary_sensor.motion_detector");
+  binarySensor.debounceTime = 0s;
+  binarySensor.Start();
+  EXPECT_TRUE(binarySensor.IsConnected());
+
+  binarySensor(std::vector{cv::Rect(50, 50, 50, 50)});
+  EXPECT_EQ(startApiCalls + 1,
+            SimServer::WaitForHassApiCount(startApiCalls + 1, 10s));
+  // let the result come back before the connection goes away
+  std::this_thread::sleep_for(250ms);
+
+  SimServer::CloseWebSockets();
+  for (const auto start = sc::now();
+       binarySensor.GetReconnects() == 0 && sc::now() - start < 10s;) {
+    std::this_thread::sleep_for(10ms);
+  }
+  EXPECT_EQ(1, binarySensor.GetReconnects());
+
+  binarySensor(std::vector<cv::Rect>{});
+  EXPECT_EQ(startApiCalls + 2,
+            SimServer::WaitForHassApiCount(startApiCalls + 2, 10s));
+}
+
+TEST(TestWebSocketHassHandler, SharesOneConnectionPerInstance) {
+  const int startApiCalls = SimServer::GetHassApiCount();
+
+  callback::WebSocketHassHandler binarySensor(
+      SimServer::GetBaseUrl(), sim_token::bearer,
+      "binary_sensor.motion_detector");
+  callback::WebSocketHassHandler sensor(SimServer::GetBaseUrl(),
+                                        sim_token::bearer,
+                                        "sensor.motion_objects");
+  EXPECT_EQ(binarySensor.GetConnection(), sensor.GetConnection());
+
+  binarySensor.debounceTime = 0s;
+  sensor.debounceTime = 0s;
+  binarySensor.Start();
+  sensor.Start();
+  EXPECT_TRUE(sensor.IsConnected());
+
+  binarySensor(std::vector{cv::Rect(50, 50, 50, 50)});
+  sensor(std::vector{cv::Rect(50, 50, 50, 50)});
+  EXPECT_EQ(startApiCalls + 2,
+            SimServer::WaitForHassApiCount(startApiCalls + 2, 10s));
+  EXPECT_EQ(0, sensor.GetReconnects());
+}
+
+TEST(TestWebSocketHassHandler, FailsWithoutBearerToken) {
+  callback::WebSocketHassHandler binarySensor(
+      SimServer::GetBaseUrl(), "invalid_token",
+      "binary_sensor.motion_detector");
+  EXPECT_THROW(binarySensor.Start(), std::runtime_error);
+}
+
 static constexpr auto binary_sensor__missing{"binary_sensor.missing"sv};
 static constexpr auto binary_sensor__motion_detector{
     "binary_sensor.motion_detector"sv};
@@ -191,6 +417,63 @@ protected:
   }
 };
 
+#ifdef __linux__
+TEST_F(TestAsyncFileSave, UringFileWriterWritesChains) {
+  auto pWriter = callback::UringFileWriter::ForScheduler(pSched_);
+  EXPECT_EQ(pWriter, callback::UringFileWriter::ForScheduler(pSched_));
+  if (!pWriter->IsAsync()) {
+    LOGGER->warn("io_uring unavailable, testing the synchronous fallback");
+  }
+
+  // more files than descriptor slots, so some chains wait for a slot
+  static constexpr size_t fileCount{callback::UringFileWriter::maxOpenFiles +
+                                    8};
+  std::vector<std::string> contents;
+  for (size_t i = 0; i < fileCount; ++i) {
+    contents.push_back(std::string(4096 + i, char('a' + i % 26)));
+  }
+
+  size_t completed{0};
+  size_t outstanding{fileCount + 1};
+  for (size_t i = 0; i < fileCount; ++i) {
+    pWriter->WriteFile(
+        downloadDir_ / std::format("{}.bin", i), contents[i],
+        [&, i](int result) {
+          EXPECT_EQ(int(contents[i].size()), result);
+          ++completed;
+          if (--outstanding == 0) {
+            wv_.store(1);
+          }
+        },
+        i % 2 == 0);
+  }
+  // a failing chain still completes and releases its slot
+  int missingDirResult{0};
+  pWriter->WriteFile(downloadDir_ / "missing" / "x.bin", contents[0],
+                     [&](int result) {
+                       missingDirResult = result;
+                       if (--outstanding == 0) {
+                         wv_.store(1);
+                       }
+                     });
+
+  if (outstanding > 0) {
+    pSched_->scheduleDelayedTask((10'000'000us).count(), EndLoop, &wv_);
+    pSched_->doEventLoop(&wv_);
+  }
+
+  EXPECT_EQ(fileCount, completed);
+  EXPECT_EQ(-ENOENT, missingDirResult);
+  EXPECT_EQ(0, pWriter->GetPendingWrites());
+  for (size_t i = 0; i < fileCount; ++i) {
+    std::ifstream ifs(downloadDir_ / std::format("{}.bin", i),
+                      std::ios::binary);
+    const std::string readBack{std::istreambuf_iterator<char>(ifs), {}};
+    EXPECT_EQ(contents[i], readBack);
+  }
+}
+#endif
+
 TEST_F(TestAsyncFileSave, CanSaveSimultaneousImages) {
   GTEST_SKIP() << "Low-priority test that has regressed";
   static constexpr int width{680};
@@ -306,4 +589,250 @@ TEST_F(TestAsyncFileSave, CanSaveALargeImage) {
   EXPECT_EQ(asyncFileSave->GetPendingRequestOperations(), 0);
   EXPECT_EQ(asyncFileSave->GetPendingFileOperations(), 0);
   EXPECT_LT(asyncFileSave->GetSavedFilePaths().size(), imgLimit);
-}
\ No newline at end of file
+}
+
+TEST_F(TestAsyncFileSave, SavesDetectionFrame) {
+  static constexpr int width{640};
+  static constexpr int height{360};
+
+  auto asyncFileSave =
+      std::make_shared<callback::AsyncFileSave>(pSched_, downloadDir_);
+  asyncFileSave->debounceTime = 0s;
+  asyncFileSave->saveDetectionFrame = true;
+  asyncFileSave->drawRois = true;
+  asyncFileSave->thumbnailWidth = 160;
+  asyncFileSave->Register();
+
+  // the detector analyses the luma plane, so the saved frame is grayscale
+  detector::Payload data;
+  data.frame.img = cv::Mat(height, width, CV_8UC1, cv::Scalar(0x40));
+  const std::array<cv::Rect, 1> rois{cv::Rect(100, 100, 50, 50)};
+  data.rois = rois;
+  asyncFileSave->SaveFrame(data, "detection.jpg");
+  // the frame is copied, so the caller may reuse its buffer straight away
+  data.frame.img.setTo(cv::Scalar(0));
+
+  TryEndLoopData tryEndLoopData{asyncFileSave.get(), &wv_, pSched_.get()};
+  pSched_->scheduleDelayedTask(1000, TryEndLoop, &tryEndLoopData);
+  pSched_->scheduleDelayedTask((10'000'000us).count(), EndLoop, &wv_);
+  pSched_->doEventLoop(&wv_);
+
+  EXPECT_EQ(asyncFileSave->GetPendingFileOperations(), 0);
+  ASSERT_EQ(asyncFileSave->GetSavedFilePaths().size(), 1);
+  EXPECT_EQ(asyncFileSave->GetSavedFilePaths().front(),
+            downloadDir_ / "detection.jpg");
+
+  const cv::Mat readImg = cv::imread(
+      (downloadDir_ / "detection.jpg").string(), cv::IMREAD_UNCHANGED);
+  ASSERT_FALSE(readImg.empty());
+  EXPECT_EQ(readImg.cols, width);
+  EXPECT_EQ(readImg.rows, height);
+  EXPECT_EQ(readImg.channels(), 1);
+  // background survives the copy and the ROI outline is drawn
+  EXPECT_NEAR(readImg.at<uchar>(10, 10), 0x40, 8);
+  EXPECT_GT(readImg.at<uchar>(100, 125), 0xC0);
+
+  const cv::Mat thumbnail = cv::imread(
+      (downloadDir_ / "thumbs" / "detection.jpg.jpg").string(),
+      cv::IMREAD_UNCHANGED);
+  ASSERT_FALSE(thumbnail.empty());
+  EXPECT_EQ(thumbnail.cols, 160);
+  EXPECT_EQ(thumbnail.rows, 90);
+  // thumbnails are not counted as saved files
+  EXPECT_EQ(asyncFileSave->GetSavedFilePaths().size(), 1);
+}
+
+TEST_F(TestAsyncFileSave, SavesClipWithPreRoll) {
+  const auto nal = [](uint8_t header, uint8_t payload) {
+    return std::vector<uint8_t>{0x00, 0x00, 0x01, header, payload};
+  };
+  auto pPreRoll = std::make_shared<video_source::PreRollBuffer>(1s);
+
+  auto asyncFileSave =
+      std::make_shared<callback::AsyncFileSave>(pSched_, downloadDir_);
+  asyncFileSave->clipPostRoll = 2s;
+  asyncFileSave->SetPreRollBuffer(pPreRoll);
+  asyncFileSave->Register();
+
+  const auto t0 = std::chrono::steady_clock::now();
+  pPreRoll->Push(std::vector<uint8_t>{0x00, 0x00, 0x01, 0x67, 0x42, 0xC0, 0x1E,
+                                      0xDA, 0x02, 0x80, 0xBF, 0xE5, 0x40},
+                 t0);
+  pPreRoll->Push(std::vector<uint8_t>{0x00, 0x00, 0x01, 0x68, 0xCE, 0x38, 0x80},
+                 t0);
+
+  // 10 fps with an IDR every second, motion from 3s to 4s
+  const cv::Mat img(8, 8, CV_8UC1, cv::Scalar(0));
+  const std::array<cv::Rect, 1> rois{cv::Rect(0, 0, 4, 4)};
+  for (int i = 0; i < 100; ++i) {
+    const auto ts = t0 + 100ms * i;
+    pPreRoll->Push(nal(i % 10 == 0 ? 0x65 : 0x41, uint8_t(0x80 | i)), ts,
+                   100ms * i);
+
+    detector::Payload data;
+    data.frame.img = img;
+    data.frame.timeStamp = ts;
+    if (i >= 30 && i < 40) {
+      data.rois = rois;
+    }
+    (*asyncFileSave)(data);
+    // pre-roll starts at the IDR 2s in, post-roll ends 2s after 3.9s
+    EXPECT_EQ(asyncFileSave->IsRecordingClip(), i >= 30 && i < 59) << i;
+  }
+
+  TryEndLoopData tryEndLoopData{asyncFileSave.get(), &wv_, pSched_.get()};
+  pSched_->scheduleDelayedTask(1000, TryEndLoop, &tryEndLoopData);
+  pSched_->scheduleDelayedTask((10'000'000us).count(), EndLoop, &wv_);
+  pSched_->doEventLoop(&wv_);
+
+  ASSERT_EQ(asyncFileSave->GetSavedFilePaths().size(), 1);
+  const auto &clipPath = asyncFileSave->GetSavedFilePaths().front();
+  EXPECT_EQ(clipPath.extension(), ".mp4");
+  std::ifstream ifs(clipPath, std::ios::binary);
+  const std::string clip{std::istreambuf_iterator<char>(ifs), {}};
+
+  // init segment, then one fragment per GOP from 2s to 5.9s, each written
+  // by its own append
+  ASSERT_GT(clip.size(), 8);
+  EXPECT_EQ(clip.substr(4, 4), "ftyp");
+  size_t fragments{0};
+  for (size_t pos = clip.find("moof"); pos != std::string::npos;
+       pos = clip.find("moof", pos + 4)) {
+    ++fragments;
+  }
+  EXPECT_EQ(fragments, 4);
+  // 40 frames of one 2 byte slice each, with a 4 byte length
+  size_t mdatBytes{0};
+  for (size_t pos = clip.find("mdat"); pos != std::string::npos;
+       pos = clip.find("mdat", pos + 4)) {
+    const auto *p = reinterpret_cast<const uint8_t *>(clip.data() + pos - 4);
+    mdatBytes += (uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 |
+                  uint32_t(p[2]) << 8 | uint32_t(p[3])) -
+                 8;
+  }
+  EXPECT_EQ(mdatBytes, 40 * 6);
+}
+
+TEST_F(TestAsyncFileSave, SplitsClipWhenParameterSetsChange) {
+  const std::vector<uint8_t> sps{0x00, 0x00, 0x01, 0x67, 0x42, 0xC0, 0x1E,
+                                 0xDA, 0x02, 0x80, 0xBF, 0xE5, 0x40};
+  // the same stream at a higher level
+  const std::vector<uint8_t> sps2{0x00, 0x00, 0x01, 0x67, 0x42, 0xC0, 0x1F,
+                                  0xDA, 0x02, 0x80, 0xBF, 0xE5, 0x40};
+  const std::vector<uint8_t> pps{0x00, 0x00, 0x01, 0x68, 0xCE, 0x38, 0x80};
+  auto pPreRoll = std::make_shared<video_source::PreRollBuffer>(1s);
+
+  auto asyncFileSave =
+      std::make_shared<callback::AsyncFileSave>(pSched_, downloadDir_);
+  asyncFileSave->clipPostRoll = 2s;
+  asyncFileSave->SetPreRollBuffer(pPreRoll);
+  asyncFileSave->Register();
+
+  // 10 fps with an IDR every second, motion throughout and the camera
+  // reconfigured at 2s
+  const cv::Mat img(8, 8, CV_8UC1, cv::Scalar(0));
+  const std::array<cv::Rect, 1> rois{cv::Rect(0, 0, 4, 4)};
+  const auto t0 = std::chrono::steady_clock::now();
+  for (int i = 0; i < 40; ++i) {
+    const auto ts = t0 + 100ms * i;
+    if (i % 10 == 0) {
+      pPreRoll->Push(i < 20 ? sps : sps2, ts, 100ms * i);
+      pPreRoll->Push(pps, ts, 100ms * i);
+    }
+    pPreRoll->Push(std::vector<uint8_t>{0x00, 0x00, 0x01,
+                                        uint8_t(i % 10 == 0 ? 0x65 : 0x41),
+                                        0x80},
+                   ts, 100ms * i);
+
+    detector::Payload data;
+    data.frame.img = img;
+    data.frame.timeStamp = ts;
+    data.rois = rois;
+    (*asyncFileSave)(data);
+  }
+  // the source going down ends the clip
+  detector::Payload end;
+  end.frame.timeStamp = t0 + 4s;
+  (*asyncFileSave)(end);
+
+  TryEndLoopData tryEndLoopData{asyncFileSave.get(), &wv_, pSched_.get()};
+  pSched_->scheduleDelayedTask(1000, TryEndLoop, &tryEndLoopData);
+  pSched_->scheduleDelayedTask((10'000'000us).count(), EndLoop, &wv_);
+  pSched_->doEventLoop(&wv_);
+
+  // each file has a single init segment
+  const auto &paths = asyncFileSave->GetSavedFilePaths();
+  ASSERT_EQ(paths.size(), 2);
+  for (const auto &path : paths) {
+    EXPECT_EQ(path.extension(), ".mp4");
+    std::ifstream ifs(path, std::ios::binary);
+    const std::string clip{std::istreambuf_iterator<char>(ifs), {}};
+    EXPECT_EQ(clip.find("moov"), clip.rfind("moov")) << path;
+    EXPECT_NE(clip.find("moof"), std::string::npos) << path;
+  }
+}
+
+TEST(TestRetentionManager, RemovesOldestFilesOverBudget) {
+  const auto dir =
+      std::filesystem::temp_directory_path() / "TestRetentionManager";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir / "a");
+  std::filesystem::create_directories(dir / "b");
+
+  const auto now = std::chrono::system_clock::now();
+  const auto fill = [&](util::MediaCatalog &catalog, int first) {
+    for (int i = first; i < first + 10; i += 2) {
+      const auto name = std::format("{}.jpg", i);
+      std::ofstream(catalog.GetDirectory() / name) << std::string(100, 'x');
+      catalog.Add({.timeStamp = now - std::chrono::hours(20 - i),
+                   .path = name,
+                   .size = 100});
+    }
+  };
+  auto pCatalogA = std::make_shared<util::MediaCatalog>(dir / "a");
+  auto pCatalogB = std::make_shared<util::MediaCatalog>(dir / "b");
+  pCatalogA->Load();
+  pCatalogB->Load();
+  fill(*pCatalogA, 0); // 0, 2, 4, 6, 8
+  fill(*pCatalogB, 1); // 1, 3, 5, 7, 9
+
+  // a keeps its newest 4, b nothing over 16h old, then 600 bytes across both
+  callback::RetentionManager retention(dir, {.maxBytes = 600});
+  retention.AddFeed("a", pCatalogA, {.maxFiles = 4});
+  retention.AddFeed("b", pCatalogB, {.maxAge = std::chrono::hours(16)});
+
+  const auto removedFiles = [&retention] {
+    size_t removed{0};
+    for (const auto &usage : retention.GetUsage() | std::views::values) {
+      removed += usage.removedFiles;
+    }
+    return removed;
+  };
+  const auto start = std::chrono::steady_clock::now();
+  while (removedFiles() < 4 && std::chrono::steady_clock::now() - start < 5s) {
+    std::this_thread::sleep_for(10ms);
+  }
+
+  const auto names = [](const util::MediaCatalog &catalog) {
+    std::vector<std::string> res;
+    for (const auto &entry : catalog.GetEntries()) {
+      res.push_back(entry.path.generic_string());
+    }
+    return res;
+  };
+  EXPECT_EQ((std::vector<std::string>{"4.jpg", "6.jpg", "8.jpg"}),
+            names(*pCatalogA));
+  EXPECT_EQ((std::vector<std::string>{"5.jpg", "7.jpg", "9.jpg"}),
+            names(*pCatalogB));
+  EXPECT_FALSE(std::filesystem::exists(dir / "a" / "0.jpg"));
+  EXPECT_FALSE(std::filesystem::exists(dir / "b" / "3.jpg"));
+  EXPECT_TRUE(std::filesystem::exists(dir / "b" / "5.jpg"));
+
+  const auto usage = retention.GetUsage();
+  ASSERT_EQ(2, usage.size());
+  EXPECT_EQ(300, usage[0].second.bytes);
+  EXPECT_EQ(2, usage[0].second.removedFiles);
+  EXPECT_EQ(2, usage[1].second.removedFiles);
+
+  std::filesystem::remove_all(dir);
+}
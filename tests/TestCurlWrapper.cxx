@@ -4,6 +4,7 @@
 
 #include "Util/BufferOperations.h"
 #include "Util/CurlMultiWrapper.h"
+#include "Util/CurlShareWrapper.h"
 #include "Util/CurlWrapper.h"
 
 #include "SimServer.h"
@@ -60,4 +61,33 @@ TEST(CurlWrapperTests, CanMakeGetRequest) {
   ASSERT_NO_THROW(wCurl(curl_easy_perform));
 
   EXPECT_EQ(std::string_view(buffer.data(), buffer.size()), "Hello There");
-}
\ No newline at end of file
+}
+
+TEST(CurlShareWrapperTests, ConnectionIsReusedAcrossHandles) {
+  util::CurlShareWrapper wShare;
+  ASSERT_TRUE(wShare);
+  EXPECT_NO_THROW(
+      wShare(curl_share_setopt, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT));
+  EXPECT_THROW(wShare(curl_share_setopt, CURLSHOPT_SHARE, -1),
+               util::CurlShareWrapper::CurlShareError);
+
+  boost::url url = SimServer::GetBaseUrl();
+  url.set_path("/api/hello");
+
+  for (const long expectedConnects : {1L, 0L}) {
+    // a fresh easy handle each time, only the share keeps the connection
+    util::CurlWrapper wCurl;
+    std::vector<char> buffer;
+    wCurl(curl_easy_setopt, CURLOPT_SHARE, wShare.pCurl_);
+    wCurl(curl_easy_setopt, CURLOPT_URL, url.c_str());
+    wCurl(curl_easy_setopt, CURLOPT_TIMEOUT, 5L);
+    wCurl(curl_easy_setopt, CURLOPT_WRITEFUNCTION, util::FillBufferCallback);
+    wCurl(curl_easy_setopt, CURLOPT_WRITEDATA, &buffer);
+    ASSERT_NO_THROW(wCurl(curl_easy_perform));
+
+    long numConnects{-1};
+    wCurl(curl_easy_getinfo, CURLINFO_NUM_CONNECTS, &numConnects);
+    EXPECT_EQ(expectedConnects, numConnects);
+    EXPECT_EQ(std::string_view(buffer.data(), buffer.size()), "Hello There");
+  }
+}
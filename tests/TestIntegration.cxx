@@ -179,6 +179,37 @@ TEST_F(RTSPServerFixture, Live555VideoSourceTest) {
   RecordProperty("Null Payload Updates", watcher.GetNullPayloadUpdates());
 }
 
+TEST_F(RTSPServerFixture, Live555VideoSourceOverTcpTest) {
+  auto pSched = std::shared_ptr<TaskScheduler>(BasicTaskScheduler::createNew());
+  auto pSource = std::make_shared<video_source::Live555VideoSource>(
+      pSched, rtspServerUrl_);
+  pSource->transport = video_source::Live555VideoSource::Transport::Tcp;
+  // small enough that the first key frame is truncated and grows it
+  pSource->frameBufferSize = 1024;
+  pSource->maxWidth = 320;
+
+  EventLoopWatchVariable wv{0};
+  asio::post(ioCtx_, [&] {
+    pSource->StartStream();
+    pSched->scheduleDelayedTask(
+        std::chrono::microseconds(args.duration / 2).count(), StopEventLoop,
+        &wv);
+    pSched->doEventLoop(&wv);
+    pSource->StopStream();
+  });
+
+  ioCtx_.run_for(args.duration);
+  EXPECT_TRUE(pSource->UsesTcp());
+  EXPECT_GT(pSource->GetFrameCount(), 0);
+  EXPECT_GT(pSource->GetTruncatedFrames(), 0);
+  EXPECT_GT(pSource->frameBufferSize, size_t{1024});
+  EXPECT_GT(pSource->GetCurrentFrame().img.cols, 0);
+  EXPECT_LE(pSource->GetCurrentFrame().img.cols, 320);
+
+  RecordProperty("Frame Count", pSource->GetFrameCount());
+  RecordProperty("Truncated Frames", pSource->GetTruncatedFrames());
+}
+
 TEST_F(RTSPServerFixture, EndToEnd) {
   const auto config = std::invoke([this] {
     json config;
@@ -1,6 +1,17 @@
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <array>
+#include <format>
+#include <thread>
+
+#include <BasicUsageEnvironment.hh>
+
+#include "Detector/DetectorPool.h"
 #include "Detector/MotionDetector.h"
+#include "Detector/MotionGate.h"
+#include "Detector/RoiMapper.h"
+#include "Detector/Zones.h"
 
 template <typename T> class MotionDetectorTests : public ::testing::Test {};
 
@@ -45,4 +56,152 @@ TYPED_TEST(MotionDetectorTests, TestObjectDetection) {
 
     EXPECT_NO_THROW([&] { motionDetector.ResetModel(); });
   }
-}
\ No newline at end of file
+}
+
+TEST(DetectorPoolTests, KeepsEachFeedInOrderOnItsLoop) {
+  std::shared_ptr<TaskScheduler> pSched(BasicTaskScheduler::createNew());
+  detector::DetectorPool pool(2);
+
+  constexpr size_t framesPerFeed{50};
+  EventLoopWatchVariable wv{0};
+  std::vector<std::vector<size_t>> publishedIds(3);
+  std::vector<std::shared_ptr<detector::DetectorPool::Strand>> strands;
+  for (size_t feed = 0; feed < publishedIds.size(); ++feed) {
+    auto pDetector = std::make_shared<detector::MOGMotionDetector>(
+        detector::MOGMotionDetector::Options{});
+    pDetector->Subscribe([&, feed, loopThread = std::this_thread::get_id()](
+                             detector::Payload data) {
+      EXPECT_EQ(std::this_thread::get_id(), loopThread);
+      publishedIds[feed].push_back(data.frame.id);
+      if (std::ranges::all_of(publishedIds, [](const auto &ids) {
+            return ids.size() == framesPerFeed;
+          })) {
+        wv.store(1);
+      }
+    });
+    strands.push_back(
+        pool.MakeStrand(std::format("feed-{}", feed), pDetector, pSched));
+    // keep every frame so the order can be checked
+    strands.back()->maxQueuedFrames = 0;
+  }
+
+  cv::Mat img = cv::Mat::zeros(120, 160, CV_8UC1);
+  for (size_t id = 1; id <= framesPerFeed; ++id) {
+    for (auto &pStrand : strands) {
+      pStrand->Post({.id = id, .img = img});
+    }
+  }
+  const auto timeout = pSched->scheduleDelayedTask(
+      10'000'000,
+      [](void *clientData) {
+        static_cast<EventLoopWatchVariable *>(clientData)->store(1);
+      },
+      &wv);
+  pSched->doEventLoop(&wv);
+  pSched->unscheduleDelayedTask(timeout);
+
+  for (const auto &ids : publishedIds) {
+    ASSERT_EQ(ids.size(), framesPerFeed);
+    EXPECT_TRUE(std::ranges::is_sorted(ids));
+  }
+  EXPECT_EQ(pool.GetDetected(), framesPerFeed * publishedIds.size());
+  EXPECT_EQ(pool.GetQueueDepth(), 0);
+  EXPECT_EQ(pool.GetDropped(), 0);
+}
+
+TEST(MotionGateTests, SkipsStaticFramesUntilSomethingChanges) {
+  using namespace std::chrono_literals;
+  detector::MotionGate gate({.idleAfter = 1s, .idleStride = 4});
+
+  const auto start = std::chrono::steady_clock::now();
+  const cv::Mat bgFrame = cv::Mat::zeros(480, 640, CV_8UC1);
+  cv::Mat fgFrame = bgFrame.clone();
+  cv::rectangle(fgFrame, cv::Rect(100, 100, 40, 40), cv::Scalar(0xFF), -1);
+
+  EXPECT_TRUE(gate.ShouldAnalyse({.img = bgFrame, .timeStamp = start}));
+  gate.OnResult(false, start);
+  EXPECT_EQ(gate.GetState(), detector::MotionGate::State::Active);
+  gate.OnResult(false, start + 2s);
+  EXPECT_EQ(gate.GetState(), detector::MotionGate::State::Idle);
+
+  // the first idle frame is the reference, then every 4th frame
+  std::vector<bool> analysed;
+  for (int i = 0; i < 8; ++i) {
+    analysed.push_back(gate.ShouldAnalyse({.img = bgFrame}));
+  }
+  EXPECT_EQ(analysed, std::vector<bool>({true, false, false, false, true,
+                                         false, false, false}));
+  EXPECT_EQ(gate.GetSkipped(), 6);
+
+  // a change is analysed straight away and motion makes the gate active
+  EXPECT_TRUE(gate.ShouldAnalyse({.img = fgFrame}));
+  gate.OnResult(true, start + 3s);
+  EXPECT_EQ(gate.GetState(), detector::MotionGate::State::Active);
+  EXPECT_TRUE(gate.ShouldAnalyse({.img = bgFrame}));
+  EXPECT_EQ(gate.GetIdleTransitions(), 1);
+  EXPECT_EQ(gate.GetActiveTransitions(), 1);
+}
+
+TEST(RoiMapperTests, ScalesRegionsToTheMainStream) {
+  const cv::Mat subFrame = cv::Mat::zeros(360, 640, CV_8UC1);
+  const cv::Mat mainFrame = cv::Mat::zeros(2160, 3840, CV_8UC1);
+  const std::array rois{cv::Rect(10, 20, 30, 40), cv::Rect(600, 300, 50, 70)};
+
+  detector::RoiMapper mapper;
+  const auto mapped = mapper.Map({.frame = {.id = 1, .img = subFrame},
+                                  .rois = rois},
+                                 {.id = 7, .img = mainFrame});
+  EXPECT_EQ(mapped.frame.id, 7);
+  ASSERT_EQ(mapped.rois.size(), 2);
+  EXPECT_EQ(mapped.rois[0], cv::Rect(60, 120, 180, 240));
+  // clipped to the main frame
+  EXPECT_EQ(mapped.rois[1], cv::Rect(3600, 1800, 240, 360));
+
+  // rounds out rather than losing a partly covered pixel
+  EXPECT_EQ(detector::RoiMapper::Scale(cv::Rect(1, 1, 1, 1), {3, 3}, {4, 4}),
+            cv::Rect(1, 1, 2, 2));
+
+  // without a main stream frame the detection frame is kept
+  const auto unmapped = mapper.Map({.frame = {.id = 1, .img = subFrame},
+                                    .rois = rois},
+                                   {});
+  EXPECT_EQ(unmapped.frame.id, 1);
+  EXPECT_EQ(unmapped.rois[0], rois[0]);
+}
+
+TEST(ZonesTests, MasksMotionOutsideTheZones) {
+  using Kind = util::Zone::Kind;
+  detector::Zones zones(
+      {{.points = {{0.0, 0.0}, {0.5, 0.0}, {0.5, 1.0}, {0.0, 1.0}}},
+       {.kind = Kind::Exclude,
+        .points = {{0.0, 0.0}, {0.25, 0.0}, {0.25, 0.5}, {0.0, 0.5}}}});
+  const cv::Mat mask = zones.Rasterise({640, 480});
+  ASSERT_EQ(mask.size(), cv::Size(640, 480));
+  EXPECT_EQ(mask.at<uchar>(300, 200), 0xFF);
+  EXPECT_EQ(mask.at<uchar>(100, 100), 0);
+  EXPECT_EQ(mask.at<uchar>(100, 500), 0);
+
+  const auto version = zones.GetVersion();
+  zones.Set({});
+  EXPECT_NE(zones.GetVersion(), version);
+  EXPECT_TRUE(zones.Rasterise({640, 480}).empty());
+
+  // an object inside an exclude zone is not reported
+  zones.Set({{.kind = Kind::Exclude,
+              .points = {{0.1, 0.1}, {0.6, 0.1}, {0.6, 0.7}, {0.1, 0.7}}}});
+  const cv::Mat bgFrame = cv::Mat::zeros(480, 640, CV_8UC1);
+  cv::Mat fgFrame = bgFrame.clone();
+  cv::rectangle(fgFrame, cv::Rect(100, 100, 200, 200), cv::Scalar(255), -1);
+
+  detector::MOGMotionDetector motionDetector({});
+  motionDetector.mask = zones.Rasterise(bgFrame.size());
+  for (size_t i = 0; i < 100; ++i) {
+    motionDetector.FeedFrame({.id = i, .img = bgFrame});
+  }
+  motionDetector.FeedFrame({.id = 100, .img = fgFrame});
+  EXPECT_EQ(motionDetector.GetRois().size(), 0);
+
+  motionDetector.mask = cv::Mat();
+  motionDetector.FeedFrame({.id = 101, .img = fgFrame});
+  EXPECT_EQ(motionDetector.GetRois().size(), 1);
+}
@@ -9,6 +9,9 @@
 
 #include "Util/ProgramOptions.h"
 
+#define JSON_USE_IMPLICIT_CONVERSIONS 0
+#include <nlohmann/json.hpp>
+
 using namespace std::string_literals;
 using namespace std::string_view_literals;
 using namespace std::chrono_literals;
@@ -48,10 +51,62 @@ TEST(ProgramOptionsTests, ParseMultiple) {
   EXPECT_THAT(progOpts.feeds.at("feed_2").detectionSize,
               testing::VariantWith<int>(1500));
   EXPECT_THAT(progOpts.feeds.at("feed_2").detectionDebounce, 30s);
+  EXPECT_EQ(progOpts.feeds.at("feed_2").detectionSourceUrl.c_str(),
+            "rtsp://feed_2.example.com:554/sub"sv);
+  EXPECT_TRUE(progOpts.feeds.at("feed_1").detectionSourceUrl.empty());
+  EXPECT_EQ(progOpts.feeds.at("feed_2").detectionWidth, 640);
+  EXPECT_EQ(progOpts.feeds.at("feed_1").detectionWidth, 0);
+  EXPECT_EQ(progOpts.feeds.at("feed_2").detectionIdleAfter, 120s);
+  EXPECT_EQ(progOpts.feeds.at("feed_2").detectionIdleStride, 5);
+  EXPECT_EQ(progOpts.feeds.at("feed_1").detectionIdleAfter, 60s);
+  EXPECT_EQ(progOpts.feeds.at("feed_2").rtspTransport, "auto"sv);
+  EXPECT_EQ(progOpts.feeds.at("feed_2").decoder, "ffmpeg"sv);
+  EXPECT_EQ(progOpts.feeds.at("feed_1").decoder, "auto"sv);
+  EXPECT_EQ(progOpts.feeds.at("feed_2").decoderThreads, 4);
+  EXPECT_TRUE(progOpts.feeds.at("feed_2").decoderSkipLoopFilter);
+  EXPECT_FALSE(progOpts.feeds.at("feed_2").decoderSkipNonReference);
+  EXPECT_EQ(progOpts.feeds.at("feed_1").rtspTransport, "udp"sv);
+  EXPECT_EQ(progOpts.feeds.at("feed_2").rtspSocketBufferSize, 4096 * 1024);
+  EXPECT_EQ(progOpts.feeds.at("feed_2").rtspReorderThreshold, 250ms);
   EXPECT_EQ(progOpts.feeds.at("feed_2").hassEntityId, "binary_sensor.feed_2"sv);
   EXPECT_EQ(progOpts.feeds.at("feed_2").hassFriendlyName, "Feed 2"sv);
   EXPECT_EQ(progOpts.feeds.at("feed_2").sourcePassword, "a_fine_word"sv);
   EXPECT_EQ(progOpts.feeds.at("feed_2").sourceUsername, "username"sv);
+  EXPECT_TRUE(progOpts.feeds.at("feed_2").saveDetectionFrame);
+  EXPECT_TRUE(progOpts.feeds.at("feed_2").saveDrawRois);
+  EXPECT_FALSE(progOpts.feeds.at("feed_1").saveDetectionFrame);
+  EXPECT_TRUE(progOpts.feeds.at("feed_2").saveClips);
+  EXPECT_EQ(progOpts.feeds.at("feed_2").clipPreRoll, 3s);
+  EXPECT_EQ(progOpts.feeds.at("feed_2").clipPostRoll, 8s);
+  EXPECT_EQ(progOpts.feeds.at("feed_2").saveMaxBytes, 512 * 1024 * 1024);
+  EXPECT_EQ(progOpts.feeds.at("feed_2").saveMaxAge, 48h);
+  EXPECT_EQ(progOpts.feeds.at("feed_1").saveMaxBytes, 0);
+  EXPECT_EQ(progOpts.feeds.at("feed_2").saveThumbnailWidth, 240);
+  EXPECT_EQ(progOpts.feeds.at("feed_1").saveThumbnailWidth, 320);
+  ASSERT_EQ(progOpts.feeds.at("feed_2").zones.size(), 1);
+  EXPECT_EQ(progOpts.feeds.at("feed_2").zones[0].kind,
+            util::Zone::Kind::Exclude);
+  EXPECT_EQ(progOpts.feeds.at("feed_2").zones[0].points[2],
+            (std::array{0.3, 0.1}));
+  // the default include zone leaves out the edges of the frame
+  ASSERT_EQ(progOpts.feeds.at("feed_1").zones.size(), 1);
+  EXPECT_EQ(progOpts.feeds.at("feed_1").zones[0].kind,
+            util::Zone::Kind::Include);
+}
+
+TEST(ProgramOptionsTests, RejectsInvalidZones) {
+  const auto parse = [](std::string_view zone) {
+    return nlohmann::json::parse(zone).template get<util::Zone>();
+  };
+  EXPECT_EQ(parse(R"({"points": [[0, 0], [1, 0], [1, 1]]})").kind,
+            util::Zone::Kind::Include);
+  EXPECT_THROW(parse(R"({"points": [[0, 0], [1, 1]]})"),
+               std::invalid_argument);
+  EXPECT_THROW(parse(R"({"points": [[0, 0], [1.5, 0], [1, 1]]})"),
+               std::invalid_argument);
+  EXPECT_THROW(
+      parse(R"({"type": "ignore", "points": [[0, 0], [1, 0], [1, 1]]})"),
+      std::invalid_argument);
 }
 
 TEST(ProgramOptionsTests, CanSetupHass) {
@@ -1,5 +1,13 @@
 #include <gtest/gtest.h>
 
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <thread>
+
+#include "Logger.h"
+#include "Util/MediaCatalog.h"
+#include "Util/RateStatistics.h"
 #include "Util/Tools.h"
 
 TEST(ToolsTests, TestNoCaseCmp) {
@@ -11,4 +19,122 @@ TEST(ToolsTests, TestNoCaseCmp) {
   EXPECT_TRUE(util::NoCaseCmp("RED", "RED"));
   EXPECT_FALSE(util::NoCaseCmp("RED", "REDDER"));
   EXPECT_FALSE(util::NoCaseCmp("yellow", "purple"));
-}
\ No newline at end of file
+}
+
+TEST(MediaCatalogTests, PagesAndSurvivesReload) {
+  using namespace std::chrono;
+  const auto dir =
+      std::filesystem::temp_directory_path() / "MediaCatalogTests_Reload";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  const auto touch = [&dir](const std::string &name) {
+    std::ofstream(dir / name) << name;
+  };
+
+  const system_clock::time_point t0{seconds(1'700'000'000)};
+  {
+    util::MediaCatalog catalog(dir);
+    catalog.Load();
+    EXPECT_EQ(0, catalog.Size());
+    for (int i = 0; i < 5; ++i) {
+      const auto name = std::format("{}.jpg", i);
+      touch(name);
+      catalog.Add({.timeStamp = t0 + seconds(i),
+                   .path = name,
+                   .size = 5,
+                   .roiCount = uint32_t(i),
+                   .roiBounds = {i, i, 10, 10},
+                   .captureTime = i % 2 == 0 ? t0 + milliseconds(i * 999)
+                                             : system_clock::time_point{}});
+    }
+    EXPECT_TRUE(catalog.Remove("1.jpg"));
+    EXPECT_FALSE(catalog.Remove("1.jpg"));
+    std::filesystem::remove(dir / "1.jpg");
+
+    auto page = catalog.Query({}, {}, {}, 2);
+    EXPECT_EQ(4, page.total);
+    ASSERT_EQ(2, page.entries.size());
+    EXPECT_EQ("4.jpg", page.entries[0].path.generic_string());
+    EXPECT_EQ("3.jpg", page.entries[1].path.generic_string());
+    ASSERT_TRUE(page.next.has_value());
+
+    page = catalog.Query({}, {}, page.next, 2);
+    ASSERT_EQ(2, page.entries.size());
+    EXPECT_EQ("2.jpg", page.entries[0].path.generic_string());
+    EXPECT_EQ("0.jpg", page.entries[1].path.generic_string());
+    EXPECT_FALSE(page.next.has_value());
+
+    page = catalog.Query(t0 + seconds(2), t0 + seconds(3), {}, 10);
+    ASSERT_EQ(2, page.entries.size());
+    EXPECT_EQ(3, page.entries[0].roiCount);
+  }
+
+  // files changed while not running are picked up on the next load
+  std::filesystem::remove(dir / "0.jpg");
+  touch("5.mp4");
+  touch("notes.txt");
+  {
+    util::MediaCatalog catalog(dir);
+    catalog.Load();
+    const auto entries = catalog.GetEntries();
+    ASSERT_EQ(4, entries.size());
+    EXPECT_EQ("2.jpg", entries[0].path.generic_string());
+    EXPECT_EQ(t0 + seconds(2), entries[0].timeStamp);
+    EXPECT_EQ((std::array{2, 2, 10, 10}), entries[0].roiBounds);
+    EXPECT_EQ(t0 + milliseconds(1998), entries[0].captureTime);
+    EXPECT_EQ(system_clock::time_point{}, entries[1].captureTime);
+    EXPECT_EQ("5.mp4", entries.back().path.generic_string());
+    EXPECT_GT(entries.back().id, entries[2].id);
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
+TEST(LoggerTests, RateLimitCountsSuppressedMessages) {
+  using namespace std::chrono_literals;
+  logger::RateLimit rateLimit(100ms);
+
+  EXPECT_EQ(rateLimit.Allow(), 0);
+  for (int i = 0; i < 3; ++i) {
+    EXPECT_FALSE(rateLimit.Allow());
+  }
+  std::this_thread::sleep_for(150ms);
+  EXPECT_EQ(rateLimit.Allow(), 3);
+  EXPECT_FALSE(rateLimit.Allow());
+}
+
+TEST(RateStatisticsTests, MeasuresRateAndGapsByStreamTime) {
+  using namespace std::chrono;
+  util::RateStatistics rate(seconds(10));
+  EXPECT_EQ(rate.GetRate(), 0.0);
+
+  // 25 fps with the frame at 2 s lost, added out of order near the end
+  const microseconds start{1'000'000};
+  for (int i = 0; i <= 100; ++i) {
+    if (i != 50 && i != 98) {
+      rate.Add(start + milliseconds(40 * i));
+    }
+  }
+  rate.Add(start + milliseconds(40 * 98));
+
+  const auto summary = rate.GetSummary();
+  EXPECT_EQ(summary.samples, 100);
+  EXPECT_DOUBLE_EQ(summary.fps, 99 / 4.0);
+  EXPECT_EQ(summary.gapP50, 40ms);
+  EXPECT_EQ(summary.gapP95, 40ms);
+  EXPECT_EQ(summary.gapP99, 80ms);
+  EXPECT_EQ(summary.gapMax, 80ms);
+  EXPECT_EQ(summary.jitter, 800us);
+
+  // only the window is kept
+  for (int i = 101; i <= 400; ++i) {
+    rate.Add(start + milliseconds(40 * i));
+  }
+  EXPECT_EQ(rate.GetSummary().samples, 251);
+  EXPECT_DOUBLE_EQ(rate.GetRate(), 25.0);
+
+  // a timestamp far behind is a new timeline
+  rate.Add(start);
+  EXPECT_EQ(rate.GetSummary().samples, 1);
+  EXPECT_EQ(rate.GetRate(), 0.0);
+}
@@ -3,11 +3,24 @@
 #include <BasicUsageEnvironment.hh>
 #include <gtest/gtest.h>
 
+#include "VideoSource/Decoder.h"
 #include "VideoSource/Http.h"
 #include "VideoSource/Live555.h"
+#include "VideoSource/Mp4Muxer.h"
+#include "VideoSource/PreRollBuffer.h"
+#include "VideoSource/SchedulerPool.h"
 
 #include "SimServer.h"
 
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <set>
+#include <string_view>
+#include <thread>
+#include <tuple>
+
 using namespace std::chrono_literals;
 
 struct HttpVideoSourceTestsParams {
@@ -117,4 +130,333 @@ TEST(Live555VideoSourceTests, BadUrl) {
                                            boost::url("http://localhost"));
   EXPECT_NO_THROW(live555.StartStream())
       << "Expected Stream to fail due to incorrect protocol";
-}
\ No newline at end of file
+}
+TEST(DecoderTests, PicksABackendForEachCodec) {
+  using video_source::Codec;
+  using video_source::Decoder;
+
+  EXPECT_NE(Decoder::Create(Decoder::Backend::Auto, Codec::H264, {}), nullptr);
+  EXPECT_THROW(std::ignore = Decoder::Create(Decoder::Backend::OpenH264,
+                                             Codec::H265, {}),
+               std::invalid_argument);
+  if (Decoder::IsAvailable(Decoder::Backend::Avcodec)) {
+    EXPECT_NE(Decoder::Create(Decoder::Backend::Auto, Codec::H265,
+                              {.threads = 2, .skipLoopFilter = true}),
+              nullptr);
+  } else {
+    EXPECT_THROW(
+        std::ignore = Decoder::Create(Decoder::Backend::Auto, Codec::H265, {}),
+        std::invalid_argument);
+  }
+
+  EXPECT_EQ(Decoder::ParseBackend("FFmpeg"), Decoder::Backend::Avcodec);
+  EXPECT_EQ(Decoder::ParseBackend("openh264"), Decoder::Backend::OpenH264);
+  EXPECT_THROW(std::ignore = Decoder::ParseBackend("vaapi"),
+               std::invalid_argument);
+}
+
+TEST(DecoderTests, DecodesAnAnnexBStreamWithOpenH264) {
+  std::ifstream file(std::filesystem::path(__FILE__).parent_path() / "res" /
+                         "test.264",
+                     std::ios::binary);
+  ASSERT_TRUE(file);
+  const std::vector<uint8_t> stream{std::istreambuf_iterator<char>(file), {}};
+
+  // OpenH264 takes the stream a NAL unit at a time as well as whole pictures
+  std::vector<size_t> starts;
+  for (size_t i = 0; i + 3 < stream.size(); ++i) {
+    if (stream[i] == 0 && stream[i + 1] == 0 && stream[i + 2] == 1) {
+      starts.push_back(i);
+    }
+  }
+  starts.push_back(stream.size());
+
+  auto pDecoder = video_source::Decoder::Create(
+      video_source::Decoder::Backend::OpenH264, video_source::Codec::H264, {});
+  size_t pictures{0};
+  for (size_t i = 0; i + 1 < starts.size() && pictures < 10; ++i) {
+    pDecoder->Decode(std::span(stream).subspan(starts[i],
+                                               starts[i + 1] - starts[i]),
+                     int64_t(i),
+                     [&](const video_source::YuvPicture &picture) {
+                       EXPECT_GT(picture.width, 0);
+                       EXPECT_GT(picture.height, 0);
+                       EXPECT_GE(picture.strideY, picture.width);
+                       EXPECT_NE(picture.planes[2], nullptr);
+                       ++pictures;
+                     });
+  }
+  EXPECT_EQ(pictures, 10);
+}
+
+TEST(PreRollBufferTests, EvictsWholeGopsAndStartsOnKeyFrame) {
+  // 4 byte start code, NAL header, one byte of payload, which starts the
+  // picture while its top bit is set
+  const auto nal = [](uint8_t type, uint8_t payload = 0xAB) {
+    return std::vector<uint8_t>{0x00, 0x00, 0x00, 0x01, uint8_t(0x60 | type),
+                                payload};
+  };
+  video_source::PreRollBuffer preRoll(2s);
+  const auto t0 = video_source::PreRollBuffer::Clock::now();
+
+  // slices before the first IDR can't be decoded and are dropped
+  preRoll.Push(nal(7), t0);
+  preRoll.Push(nal(8), t0);
+  preRoll.Push(nal(1), t0);
+  EXPECT_FALSE(preRoll.HasKeyFrame());
+  EXPECT_EQ(0, preRoll.GetBufferedUnits());
+
+  // 1 GOP per second, 10 frames each
+  for (int gop = 0; gop < 5; ++gop) {
+    for (int frame = 0; frame < 10; ++frame) {
+      preRoll.Push(nal(frame == 0 ? 5 : 1, uint8_t(0x80 | gop)),
+                   t0 + 1s * gop + 100ms * frame);
+    }
+  }
+  EXPECT_TRUE(preRoll.HasKeyFrame());
+  EXPECT_GE(preRoll.GetBufferedDuration(), 2s);
+  EXPECT_LT(preRoll.GetBufferedDuration(), 3s);
+  EXPECT_EQ(30, preRoll.GetBufferedUnits());
+
+  // parameter sets are visited ahead of the oldest kept GOP
+  std::vector<std::vector<uint8_t>> clip;
+  const auto collect = [](std::vector<std::vector<uint8_t>> &out) {
+    return [&out](std::span<const uint8_t> nalUnit, std::chrono::microseconds) {
+      out.emplace_back(nalUnit.begin(), nalUnit.end());
+    };
+  };
+  const auto seq = preRoll.VisitAll(collect(clip));
+  ASSERT_EQ(clip.size(), 32);
+  EXPECT_EQ(video_source::PreRollBuffer::NalType(clip[0]), 7);
+  EXPECT_EQ(clip[2], nal(5, 0x82));
+
+  std::vector<std::vector<uint8_t>> more;
+  EXPECT_EQ(seq, preRoll.VisitSince(seq, collect(more)));
+  EXPECT_TRUE(more.empty());
+  preRoll.Push(nal(1), t0 + 5s);
+  EXPECT_EQ(seq + 1, preRoll.VisitSince(seq, collect(more)));
+  ASSERT_EQ(more.size(), 1);
+  EXPECT_EQ(more[0], nal(1));
+
+  // the later slices of a multi-slice IDR don't start a GOP of their own
+  preRoll.Clear();
+  for (int gop = 0; gop < 3; ++gop) {
+    const auto ts = t0 + 10s + 1s * gop;
+    preRoll.Push(nal(5, 0x80), ts);
+    preRoll.Push(nal(5, 0x40), ts);
+    for (int frame = 1; frame < 10; ++frame) {
+      preRoll.Push(nal(1), ts + 100ms * frame);
+    }
+  }
+  EXPECT_EQ(33, preRoll.GetBufferedUnits());
+  std::vector<std::vector<uint8_t>> slices;
+  preRoll.VisitAll(collect(slices));
+  ASSERT_EQ(slices.size(), 35);
+  EXPECT_EQ(slices[2], nal(5, 0x80));
+  EXPECT_EQ(slices[3], nal(5, 0x40));
+
+  // a GOP that can't fit is dropped whole
+  preRoll.maxBytes = 100;
+  preRoll.Push(nal(5), t0 + 6s);
+  for (int i = 0; i < 20; ++i) {
+    preRoll.Push(nal(1), t0 + 6s + 10ms * i);
+  }
+  EXPECT_LE(preRoll.GetBufferedBytes(), 100);
+}
+
+TEST(Mp4MuxerTests, WritesInitSegmentAndFragmentPerGop) {
+  // baseline 640x360, cropped from 23 macroblock rows
+  const std::vector<uint8_t> sps{0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xC0,
+                                 0x1E, 0xDA, 0x02, 0x80, 0xBF, 0xE5, 0x40};
+  const std::vector<uint8_t> pps{0x00, 0x00, 0x00, 0x01, 0x68, 0xCE, 0x38,
+                                 0x80};
+  const auto dims = video_source::Mp4Muxer::ParseSpsDimensions(
+      std::span(sps).subspan(4));
+  ASSERT_TRUE(dims);
+  EXPECT_EQ(640, dims->width);
+  EXPECT_EQ(360, dims->height);
+  // an exp-Golomb code longer than 32 bits is rejected
+  const std::vector<uint8_t> corruptSps{0x67, 0x42, 0xC0, 0x1E, 0x00, 0x00,
+                                        0x00, 0x00, 0x00, 0x01};
+  EXPECT_FALSE(video_source::Mp4Muxer::ParseSpsDimensions(corruptSps));
+
+  video_source::Mp4Muxer muxer;
+  std::vector<uint8_t> out;
+
+  // frames before the first IDR are dropped
+  muxer.AddNalUnit(std::vector<uint8_t>{0x00, 0x00, 0x01, 0x41, 0x01}, 0us);
+  muxer.AddNalUnit(sps, 0us);
+  muxer.AddNalUnit(pps, 0us);
+  for (int i = 0; i < 20; ++i) {
+    const uint8_t header = i % 10 == 0 ? 0x65 : 0x41;
+    // two slices per frame
+    for (uint8_t slice = 0; slice < 2; ++slice) {
+      muxer.AddNalUnit(std::vector<uint8_t>{0x00, 0x00, 0x01, header, slice},
+                       100ms * i);
+    }
+  }
+  muxer.TakeOutput(out);
+  // the second GOP is still open
+  EXPECT_EQ(1, muxer.GetFragmentCount());
+  muxer.Flush();
+  muxer.TakeOutput(out);
+  EXPECT_EQ(2, muxer.GetFragmentCount());
+
+  const auto read32 = [&](size_t pos) {
+    return uint32_t(out[pos]) << 24 | uint32_t(out[pos + 1]) << 16 |
+           uint32_t(out[pos + 2]) << 8 | uint32_t(out[pos + 3]);
+  };
+  std::vector<std::string> boxes;
+  std::vector<uint32_t> mdatSizes;
+  for (size_t pos = 0; pos + 8 <= out.size();) {
+    const uint32_t size = read32(pos);
+    ASSERT_GE(size, 8);
+    boxes.emplace_back(out.begin() + pos + 4, out.begin() + pos + 8);
+    if (boxes.back() == "mdat") {
+      mdatSizes.push_back(size);
+    }
+    pos += size;
+    ASSERT_LE(pos, out.size());
+  }
+  EXPECT_EQ(boxes, (std::vector<std::string>{"ftyp", "moov", "moof", "mdat",
+                                             "moof", "mdat"}));
+  // 10 frames of 2 length prefixed 2 byte slices
+  EXPECT_EQ(mdatSizes, (std::vector<uint32_t>{8 + 10 * 2 * 6, 8 + 10 * 2 * 6}));
+}
+
+TEST(Mp4MuxerTests, TimesFramesFromWallClockTimestamps) {
+  const std::vector<uint8_t> sps{0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xC0,
+                                 0x1E, 0xDA, 0x02, 0x80, 0xBF, 0xE5, 0x40};
+  const std::vector<uint8_t> pps{0x00, 0x00, 0x00, 0x01, 0x68, 0xCE, 0x38,
+                                 0x80};
+  // microseconds since the epoch, as RTCP synchronised sources report them
+  const std::chrono::microseconds t0{1'700'000'000'123'456};
+
+  video_source::Mp4Muxer muxer;
+  muxer.AddNalUnit(sps, t0);
+  muxer.AddNalUnit(pps, t0);
+  for (int i = 0; i < 3; ++i) {
+    muxer.AddNalUnit(std::vector<uint8_t>{0x00, 0x00, 0x01,
+                                          uint8_t(i == 0 ? 0x65 : 0x41), 0x80},
+                     t0 + 40ms * i);
+  }
+  muxer.Flush();
+  std::vector<uint8_t> out;
+  muxer.TakeOutput(out);
+  ASSERT_EQ(1, muxer.GetFragmentCount());
+
+  const auto read32 = [&](size_t pos) {
+    return uint32_t(out[pos]) << 24 | uint32_t(out[pos + 1]) << 16 |
+           uint32_t(out[pos + 2]) << 8 | uint32_t(out[pos + 3]);
+  };
+  const std::string_view bytes(reinterpret_cast<const char *>(out.data()),
+                               out.size());
+  const size_t trun = bytes.find("trun");
+  ASSERT_NE(trun, std::string_view::npos);
+  // version and flags, sample count and data offset, then duration, size
+  // and flags per sample
+  ASSERT_EQ(3, read32(trun + 8));
+  for (size_t i = 0; i < 3; ++i) {
+    EXPECT_EQ(40 * video_source::Mp4Muxer::timescale / 1000,
+              read32(trun + 16 + i * 12))
+        << i;
+  }
+}
+
+TEST(Mp4MuxerTests, StartsNewFileWhenParameterSetsChange) {
+  const std::vector<uint8_t> sps{0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xC0,
+                                 0x1E, 0xDA, 0x02, 0x80, 0xBF, 0xE5, 0x40};
+  // the same stream at a higher level
+  const std::vector<uint8_t> sps2{0x00, 0x00, 0x00, 0x01, 0x67, 0x42, 0xC0,
+                                  0x1F, 0xDA, 0x02, 0x80, 0xBF, 0xE5, 0x40};
+  const std::vector<uint8_t> pps{0x00, 0x00, 0x00, 0x01, 0x68, 0xCE, 0x38,
+                                 0x80};
+
+  video_source::Mp4Muxer muxer;
+  for (int i = 0; i < 30; ++i) {
+    if (i % 10 == 0) {
+      // cameras repeat their parameter sets ahead of each IDR
+      muxer.AddNalUnit(i < 20 ? sps : sps2, 100ms * i);
+      muxer.AddNalUnit(pps, 100ms * i);
+    }
+    const uint8_t header = i % 10 == 0 ? 0x65 : 0x41;
+    muxer.AddNalUnit(std::vector<uint8_t>{0x00, 0x00, 0x01, header, 0x80},
+                     100ms * i);
+  }
+  std::vector<uint8_t> first;
+  EXPECT_FALSE(muxer.StartNewFile());
+  muxer.TakeOutput(first);
+  EXPECT_TRUE(muxer.StartNewFile());
+  EXPECT_FALSE(muxer.StartNewFile());
+  muxer.Flush();
+  std::vector<uint8_t> second;
+  muxer.TakeOutput(second);
+  EXPECT_EQ(1, muxer.GetFragmentCount());
+
+  const auto boxesOf = [](const std::vector<uint8_t> &file) {
+    std::vector<std::string> boxes;
+    for (size_t pos = 0; pos + 8 <= file.size();) {
+      const uint32_t size =
+          uint32_t(file[pos]) << 24 | uint32_t(file[pos + 1]) << 16 |
+          uint32_t(file[pos + 2]) << 8 | uint32_t(file[pos + 3]);
+      if (size < 8) {
+        break;
+      }
+      boxes.emplace_back(file.begin() + pos + 4, file.begin() + pos + 8);
+      pos += size;
+    }
+    return boxes;
+  };
+  EXPECT_EQ(boxesOf(first), (std::vector<std::string>{"ftyp", "moov", "moof",
+                                                      "mdat", "moof", "mdat"}));
+  EXPECT_EQ(boxesOf(second),
+            (std::vector<std::string>{"ftyp", "moov", "moof", "mdat"}));
+
+  // the new file's avcC carries both SPS, the one in use last
+  const std::string_view bytes(reinterpret_cast<const char *>(second.data()),
+                               second.size());
+  const size_t avcC = bytes.find("avcC");
+  ASSERT_NE(avcC, std::string_view::npos);
+  EXPECT_EQ(0x1F, second[avcC + 7]);
+  EXPECT_EQ(0xE2, second[avcC + 9]);
+  EXPECT_EQ(1, second[avcC + 10 + 2 * (2 + sps.size() - 4)]);
+}
+
+TEST(SchedulerPoolTests, SpreadsFeedsAndRunsEachLoopOnItsOwnThread) {
+  video_source::SchedulerPool pool(3);
+  std::vector<std::shared_ptr<TaskScheduler>> assigned;
+  for (int i = 0; i < 6; ++i) {
+    assigned.push_back(pool.Assign());
+  }
+  for (size_t i = 0; i < pool.Size(); ++i) {
+    EXPECT_EQ(pool.GetFeedCount(i), 2);
+  }
+
+  struct TaskData {
+    std::mutex *pMtx;
+    std::set<std::thread::id> *pThreadIds;
+  };
+  std::mutex mtx;
+  std::set<std::thread::id> threadIds;
+  TaskData taskData{&mtx, &threadIds};
+  for (size_t i = 0; i < pool.Size(); ++i) {
+    pool.At(i)->scheduleDelayedTask(
+        0,
+        [](void *clientData) {
+          auto *pData = static_cast<TaskData *>(clientData);
+          std::scoped_lock lk(*pData->pMtx);
+          pData->pThreadIds->insert(std::this_thread::get_id());
+        },
+        &taskData);
+  }
+
+  EventLoopWatchVariable wv{0};
+  std::jthread stopper([&wv] {
+    std::this_thread::sleep_for(200ms);
+    wv.store(1);
+  });
+  pool.Run(&wv);
+
+  EXPECT_EQ(threadIds.size(), 3);
+  EXPECT_TRUE(threadIds.contains(std::this_thread::get_id()));
+}
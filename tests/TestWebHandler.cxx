@@ -1,19 +1,26 @@
 #include "WindowsWrapper.h"
 
+#include <array>
 #include <filesystem>
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_set>
+#include <vector>
 
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #define JSON_USE_IMPLICIT_CONVERSIONS 0
 #include <nlohmann/json.hpp>
 
+#include "Gui/LiveView.h"
+#include "Gui/LogRing.h"
 #include "Gui/Payload.h"
 #include "Gui/WebHandler.h"
 #include "Util/BufferOperations.h"
 #include "Util/CurlWrapper.h"
+#include "Util/MediaCatalog.h"
 
 using namespace std::string_literals;
 using namespace std::string_view_literals;
@@ -33,7 +40,7 @@ struct ImageTypeAllowed {
 class WebHandlerTests : public testing::TestWithParam<ImageTypeAllowed> {
 protected:
   void SetUp() override {
-    pWh_ = std::make_unique<gui::WebHandler>(32836, "localhost");
+    pWh_ = std::make_shared<gui::WebHandler>(32836, "localhost");
     pWh_->Start();
   }
 
@@ -43,7 +50,16 @@ protected:
     return {pWh_->GetUrl().data(), pWh_->GetUrl().size()};
   }
 
-  std::unique_ptr<gui::WebHandler> pWh_;
+  std::shared_ptr<gui::WebHandler> pWh_;
+};
+
+// Publishes frames pushed by the test
+class PushedVideoSource : public video_source::VideoSource {
+public:
+  void StartStream(unsigned long long) override {}
+  void StopStream() override {}
+  bool IsActive() override { return true; }
+  void Push(video_source::Frame frame) { SetFrame(std::move(frame)); }
 };
 
 TEST_P(WebHandlerTests, CanSetImage) {
@@ -66,6 +82,35 @@ TEST_P(WebHandlerTests, CanSetImage) {
   }
 }
 
+TEST_F(WebHandlerTests, LiveViewKeepsDetectionFedBeforeTheFirstModel) {
+  PushedVideoSource source;
+  auto pLiveView = std::make_shared<gui::LiveView>(pWh_, "live"sv);
+
+  // subscribed as in main, the detector's queue first and the live view
+  // second, whichever order they are called in
+  std::vector<video_source::Frame> posted;
+  source.Subscribe(
+      [&posted](video_source::Frame frame) { posted.push_back(frame); });
+  source.Subscribe([pLiveView, &source](video_source::Frame frame) {
+    pLiveView->OnFrame(std::move(frame), source.GetFramesPerSecond());
+  });
+
+  const cv::Mat img(120, 160, CV_8UC1, cv::Scalar(0x80));
+  for (size_t i = 0; i < 3; ++i) {
+    EXPECT_NO_THROW(source.Push({.id = i, .img = img.clone()}));
+  }
+  EXPECT_EQ(3, posted.size());
+
+  // once a detection has published its model it is drawn on later frames
+  const std::array<cv::Rect, 1> rois{cv::Rect(10, 10, 20, 20)};
+  cv::Mat model(120, 160, CV_8UC1, cv::Scalar(0xFF));
+  pLiveView->OnDetection(rois, model);
+  // the detector reuses its model for the next frame
+  model.setTo(cv::Scalar(0));
+  EXPECT_NO_THROW(source.Push({.id = 3, .img = img.clone()}));
+  EXPECT_EQ(4, posted.size());
+}
+
 TEST_F(WebHandlerTests, CanAccessPackedFilesystem) {
   // read the packed index.html to compare later
   const auto indexPath =
@@ -154,8 +199,122 @@ TEST_F(WebHandlerTests, FailToGetSavedMedia) {
   EXPECT_EQ(404, code);
 }
 
+TEST_F(WebHandlerTests, ServesSavedClipsInRanges) {
+  const auto savedDir =
+      std::filesystem::temp_directory_path() / "WebHandlerTests_Clips";
+  std::filesystem::create_directories(savedDir);
+  {
+    std::ofstream ofs(savedDir / "clip.mp4", std::ios::binary);
+    for (int i = 0; i < 1000; ++i) {
+      ofs.put(char(i % 251));
+    }
+  }
+  gui::WebHandler::SetSavedFilesServePath("clips"sv, savedDir);
+
+  std::vector<char> buf;
+  util::CurlWrapper wCurl;
+  EXPECT_NO_THROW(std::invoke([&] {
+    const auto url = GetServerUrl() + "/media/saved/clips/clip.mp4"s;
+    wCurl(curl_easy_setopt, CURLOPT_URL, url.c_str());
+    wCurl(curl_easy_setopt, CURLOPT_RANGE, "100-199");
+    wCurl(curl_easy_setopt, CURLOPT_WRITEDATA, &buf);
+    wCurl(curl_easy_setopt, CURLOPT_WRITEFUNCTION, util::FillBufferCallback);
+    wCurl(curl_easy_perform);
+  }));
+  int code{0};
+  wCurl(curl_easy_getinfo, CURLINFO_HTTP_CODE, &code);
+  EXPECT_EQ(206, code);
+  ASSERT_EQ(100, buf.size());
+  EXPECT_EQ(char(100), buf.front());
+  curl_header *hdr;
+  curl_easy_header(&wCurl, "Content-Type", 0, CURLH_HEADER, -1, &hdr);
+  EXPECT_THAT(hdr->value, testing::HasSubstr("video/mp4"sv));
+
+  std::filesystem::remove_all(savedDir);
+}
+
+TEST_F(WebHandlerTests, PagesSavedMediaCatalog) {
+  const auto savedDir =
+      std::filesystem::temp_directory_path() / "WebHandlerTests_Catalog";
+  std::filesystem::remove_all(savedDir);
+  std::filesystem::create_directories(savedDir);
+  auto pCatalog = std::make_shared<util::MediaCatalog>(savedDir);
+  pCatalog->Load();
+  for (int i = 0; i < 3; ++i) {
+    pCatalog->Add({.timeStamp = std::chrono::system_clock::time_point(
+                       std::chrono::seconds(i)),
+                   .path = std::format("{}.jpg", i)});
+  }
+  gui::WebHandler::SetSavedFilesCatalog("catalog"sv, pCatalog);
+
+  std::vector<char> buf;
+  util::CurlWrapper wCurl;
+  EXPECT_NO_THROW(std::invoke([&] {
+    const auto url = GetServerUrl() + "/media/catalog/catalog?limit=2"s;
+    wCurl(curl_easy_setopt, CURLOPT_URL, url.c_str());
+    wCurl(curl_easy_setopt, CURLOPT_WRITEDATA, &buf);
+    wCurl(curl_easy_setopt, CURLOPT_WRITEFUNCTION, util::FillBufferCallback);
+    wCurl(curl_easy_perform);
+  }));
+  int code{0};
+  wCurl(curl_easy_getinfo, CURLINFO_HTTP_CODE, &code);
+  ASSERT_EQ(200, code);
+  const auto reply = json::parse(buf);
+  EXPECT_EQ(3, reply["total"].template get<size_t>());
+  ASSERT_EQ(2, reply["entries"].size());
+  EXPECT_EQ("/media/saved/catalog/2.jpg",
+            reply["entries"][0]["path"].template get<std::string>());
+  EXPECT_EQ(2000, reply["entries"][0]["timestamp"].template get<int64_t>());
+  EXPECT_EQ("/media/thumbs/catalog/2.jpg",
+            reply["entries"][0]["thumbnail"].template get<std::string>());
+  EXPECT_EQ(reply["entries"][1]["id"], reply["next"]);
+
+  std::filesystem::remove_all(savedDir);
+}
+
 INSTANTIATE_TEST_SUITE_P(ImageTypes, WebHandlerTests,
                          testing::Values(ImageTypeAllowed{CV_8UC1, true},
                                          ImageTypeAllowed{CV_8UC2, false},
                                          ImageTypeAllowed{CV_8UC3, true},
-                                         ImageTypeAllowed{CV_8UC4, true}));
\ No newline at end of file
+                                         ImageTypeAllowed{CV_8UC4, true}));
+
+TEST(LogRingTests, KeepsEachWritersOrderAndCountsDrops) {
+  gui::LogRing ring(64);
+  ASSERT_EQ(ring.Capacity(), 64);
+
+  constexpr int writers{4};
+  constexpr int linesPerWriter{1000};
+  std::atomic_int finished{0};
+  std::vector<std::jthread> threads;
+  for (int w = 0; w < writers; ++w) {
+    threads.emplace_back([&ring, &finished, w] {
+      for (int i = 0; i < linesPerWriter; ++i) {
+        const auto payload = std::format("{} {}", w, i);
+        ring.Push({"test", spdlog::level::info, payload});
+      }
+      ++finished;
+    });
+  }
+
+  std::vector<int> lastLine(writers, -1);
+  size_t drained{0};
+  const auto drain = [&] {
+    return ring.Drain(
+        [&](const gui::LogRing::Record &record) {
+          int w{0}, i{0};
+          std::istringstream(record.payload) >> w >> i;
+          EXPECT_GT(i, lastLine[w]) << "Lines of writer " << w << " reordered";
+          lastLine[w] = i;
+          ++drained;
+        },
+        16);
+  };
+  // read while the writers run, then whatever is left
+  while (finished < writers) {
+    drain();
+  }
+  threads.clear();
+  while (drain() > 0) {
+  }
+  EXPECT_EQ(drained + ring.GetDropped(), writers * linesPerWriter);
+}